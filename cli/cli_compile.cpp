@@ -0,0 +1,148 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Compile traces into a flat stream of calls which can be replayed straight
+ * from memory.  See trace_compiled.hpp for the layout.
+ */
+
+
+#include <limits.h> // for CHAR_MAX
+#include <string.h>
+#include <getopt.h>
+
+#include <iostream>
+#include <string>
+
+#include "cli.hpp"
+
+#include "trace_compiled.hpp"
+#include "trace_parser.hpp"
+
+
+static const char *synopsis = "Compile a trace for replaying with the least overhead.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace compile [OPTIONS] TRACE_FILE\n"
+        << synopsis << "\n"
+        "\n"
+        "    -h, --help           show this help message and exit\n"
+        "    -o, --output=FILE    output file [default: TRACE_FILE with .ctrace extension]\n"
+        "\n"
+        "Writes the calls uncompressed, with values in their native form, and\n"
+        "strings and blobs in place, which the retracers replay from memory\n"
+        "without decompressing nor parsing the original trace format.  Compiled\n"
+        "traces can only be dumped or replayed, on the kind of machine they\n"
+        "were compiled on.\n"
+    ;
+}
+
+const static char *
+shortOptions = "ho:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"output", required_argument, 0, 'o'},
+    {0, 0, 0, 0}
+};
+
+
+static int
+command(int argc, char *argv[])
+{
+    std::string output;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc != optind + 1) {
+        std::cerr << "error: a single trace file must be specified\n";
+        usage();
+        return 1;
+    }
+
+    std::string input = argv[optind];
+    if (output.empty()) {
+        output = input;
+        size_t dot = output.rfind(".trace");
+        if (dot != std::string::npos && dot + strlen(".trace") == output.size()) {
+            output.resize(dot);
+        }
+        output += ".ctrace";
+    }
+
+    trace::Parser p;
+    p.setCallArenas(true);
+    if (!p.open(input.c_str())) {
+        return 1;
+    }
+
+    trace::CompiledWriter writer;
+    if (!writer.open(output.c_str(), p.getVersion())) {
+        std::cerr << "error: failed to create " << output << "\n";
+        return 1;
+    }
+
+    trace::Call *call;
+    while ((call = p.parse_call())) {
+        writer.writeCall(call);
+        delete call;
+    }
+
+    // Signatures belong to the parser, so write them before closing it
+    if (!writer.close(p.api)) {
+        std::cerr << "error: failed to write " << output << "\n";
+        return 1;
+    }
+
+    std::cerr << "Compiled trace is available as " << output << "\n";
+
+    return 0;
+}
+
+const Command compile_command = {
+    "compile",
+    synopsis,
+    usage,
+    command
+};
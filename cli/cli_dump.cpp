@@ -35,6 +35,7 @@
 
 #include <memory>
 #include <fstream>
+#include <sstream>
 #include <string>
 
 #include "cxx_compat.hpp" // for std::to_string, std::make_unique
@@ -43,6 +44,7 @@
 #include "cli_pager.hpp"
 
 #include "trace_parser.hpp"
+#include "trace_parser_parallel.hpp"
 #include "trace_dump_internal.hpp"
 #include "trace_callset.hpp"
 #include "trace_option.hpp"
@@ -79,6 +81,7 @@ usage(void)
         "    --call-nos[=BOOL]    dump call numbers[default: yes]\n"
         "    --arg-names[=BOOL]   dump argument names [default: yes]\n"
         "    --blobs              dump blobs into files\n"
+        "    -j, --threads[=N]    parse and format calls on N threads [default: number of cores]\n"
         "\n"
     ;
 }
@@ -93,7 +96,7 @@ enum {
 };
 
 const static char *
-shortOptions = "hv";
+shortOptions = "hvj::";
 
 const static struct option
 longOptions[] = {
@@ -106,6 +109,7 @@ longOptions[] = {
     {"call-nos", optional_argument, 0, CALL_NOS_OPT},
     {"arg-names", optional_argument, 0, ARG_NAMES_OPT},
     {"blobs", no_argument, 0, BLOBS_OPT},
+    {"threads", optional_argument, 0, 'j'},
     {0, 0, 0, 0}
 };
 
@@ -146,11 +150,80 @@ public:
 };
 
 
+static std::unique_ptr<trace::Dumper>
+createDumper(std::ostream &os, trace::DumpFlags dumpFlags, bool blobs)
+{
+    if (blobs) {
+        return std::make_unique<BlobDumper>(os, dumpFlags);
+    } else {
+        return std::make_unique<trace::Dumper>(os, dumpFlags);
+    }
+}
+
+
+static inline bool
+shouldDump(trace::Call *call)
+{
+    return calls.contains(*call) &&
+           (verbose || !(call->flags & trace::CALL_FLAG_VERBOSE));
+}
+
+
+/*
+ * Formats calls on the parser's worker threads, and writes them out in order.
+ */
+class ParallelDumper : public trace::ParallelParser::Visitor
+{
+    struct DumpBatch : public trace::ParallelParser::Batch {
+        std::vector<std::string> text;
+    };
+
+    trace::DumpFlags dumpFlags;
+    bool blobs;
+
+public:
+    ParallelDumper(trace::DumpFlags _dumpFlags, bool _blobs) :
+        dumpFlags(_dumpFlags),
+        blobs(_blobs)
+    {
+    }
+
+    trace::ParallelParser::Batch *createBatch(void) override {
+        return new DumpBatch;
+    }
+
+    void visitBatch(trace::ParallelParser::Batch &batch) override {
+        DumpBatch &dumpBatch = static_cast<DumpBatch &>(batch);
+        std::ostringstream os;
+        std::unique_ptr<trace::Dumper> dumper = createDumper(os, dumpFlags, blobs);
+        dumpBatch.text.resize(batch.calls.size());
+        for (size_t i = 0; i < batch.calls.size(); ++i) {
+            trace::Call *call = batch.calls[i];
+            if (shouldDump(call)) {
+                dumper->visit(call);
+                dumpBatch.text[i] = os.str();
+                os.str(std::string());
+            }
+            // Only the text is needed from now on
+            delete call;
+            batch.calls[i] = nullptr;
+        }
+    }
+
+    void visitCall(trace::ParallelParser::Batch &batch, size_t index) override {
+        DumpBatch &dumpBatch = static_cast<DumpBatch &>(batch);
+        std::cout << dumpBatch.text[index];
+    }
+};
+
+
 static int
 command(int argc, char *argv[])
 {
     trace::DumpFlags dumpFlags = 0;
     bool blobs = false;
+    bool parallel = false;
+    unsigned numThreads = 0;
 
     int opt;
     while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
@@ -201,6 +274,10 @@ command(int argc, char *argv[])
         case BLOBS_OPT:
             blobs = true;
             break;
+        case 'j':
+            parallel = true;
+            numThreads = optarg ? atoi(optarg) : 0;
+            break;
         default:
             std::cerr << "error: unexpected option `" << (char)opt << "`\n";
             usage();
@@ -221,28 +298,54 @@ command(int argc, char *argv[])
         dumpFlags |= trace::DUMP_FLAG_NO_COLOR;
     }
 
-    std::unique_ptr<trace::Dumper> dumper;
-
-    if (blobs) {
-        dumper = std::make_unique<BlobDumper>(std::cout, dumpFlags);
-    } else {
-        dumper = std::make_unique<trace::Dumper>(std::cout, dumpFlags);
-    }
+    std::unique_ptr<trace::Dumper> dumper = createDumper(std::cout, dumpFlags, blobs);
 
     for (int i = optind; i < argc; ++i) {
+        if (trace::isCompiledTrace(argv[i])) {
+            std::unique_ptr<trace::AbstractParser> p(trace::compiledParser());
+            if (!p->open(argv[i])) {
+                return 1;
+            }
+
+            trace::Call *call;
+            while ((call = p->parse_call())) {
+                if (shouldDump(call)) {
+                    dumper->visit(call);
+                }
+                delete call;
+            }
+            continue;
+        }
+
+        if (parallel) {
+            trace::ParallelParser p;
+            p.setCallArenas(true);
+            if (!p.open(argv[i])) {
+                return 1;
+            }
+
+            ParallelDumper parallelDumper(dumpFlags, blobs);
+            p.parse(parallelDumper, numThreads);
+            continue;
+        }
+
         trace::Parser p;
+        p.setCallArenas(true);
 
         if (!p.open(argv[i])) {
             return 1;
         }
 
+        // Skip straight to the first call if the trace was indexed
+        trace::CallNo first = calls.getFirst();
+        if (first > 0 && p.getIndex(false)) {
+            p.jumpToCall(first);
+        }
+
         trace::Call *call;
         while ((call = p.parse_call())) {
-            if (calls.contains(*call)) {
-                if (verbose ||
-                    !(call->flags & trace::CALL_FLAG_VERBOSE)) {
-                    dumper->visit(call);
-                }
+            if (shouldDump(call)) {
+                dumper->visit(call);
             }
             delete call;
         }
@@ -0,0 +1,497 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Export calls as columns, for loading into data analysis tools.  See
+ * docs/EXPORT.markdown for the file layout.
+ */
+
+
+#include <assert.h>
+#include <limits.h> // for CHAR_MAX
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "os_thread.hpp"
+
+#include "cli.hpp"
+
+#include "trace_parser_parallel.hpp"
+
+
+static const char *synopsis = "Export calls as columns, for data analysis.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace export [OPTIONS] TRACE_FILE\n"
+        << synopsis << "\n"
+        "\n"
+        "    -h, --help           show this help message and exit\n"
+        "    -o, --output=FILE    output file [default: TRACE_FILE with .columns extension]\n"
+        "    -j, --threads=N      parse and encode calls on N threads [default: number of cores]\n"
+        "\n"
+        "Writes call numbers, threads, functions, flags, frame numbers, scalar\n"
+        "arguments, and blob sizes as columns, in row groups which are encoded\n"
+        "in parallel.  See docs/EXPORT.markdown for the layout, and\n"
+        "scripts/columns.py for a reader.\n"
+    ;
+}
+
+const static char *
+shortOptions = "ho:j:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"output", required_argument, 0, 'o'},
+    {"threads", required_argument, 0, 'j'},
+    {0, 0, 0, 0}
+};
+
+
+#define EXPORT_MAGIC "APITRCOL"
+#define EXPORT_VERSION 1
+
+// Argument index of return values
+#define EXPORT_RETURN_VALUE 0xffff
+
+enum ColumnId {
+    COLUMN_CALL_NO = 0,
+    COLUMN_THREAD,
+    COLUMN_FUNCTION,
+    COLUMN_FLAGS,
+    COLUMN_FRAME,
+    COLUMN_ARG_OFFSETS,
+    COLUMN_ARG_INDEX,
+    COLUMN_ARG_TYPE,
+    COLUMN_ARG_VALUE,
+    COLUMN_BLOB_OFFSETS,
+    COLUMN_BLOB_SIZE,
+    NUM_COLUMNS
+};
+
+enum ScalarType {
+    SCALAR_BOOL = 1,
+    SCALAR_SINT,
+    SCALAR_UINT,
+    SCALAR_FLOAT,
+    SCALAR_DOUBLE,
+    SCALAR_ENUM,
+    SCALAR_BITMASK,
+    SCALAR_POINTER,
+};
+
+
+/*
+ * Little-endian array of fixed size elements.
+ */
+class Column
+{
+public:
+    unsigned elementSize;
+    std::string data;
+
+    Column(unsigned _elementSize = 0) :
+        elementSize(_elementSize)
+    {}
+
+    inline void
+    put(uint64_t value) {
+        for (unsigned i = 0; i < elementSize; ++i) {
+            data.push_back(static_cast<char>(value >> (8 * i)));
+        }
+    }
+
+    size_t
+    size(void) const {
+        return data.size() / elementSize;
+    }
+};
+
+
+static void
+writeUInt(std::ostream &os, uint64_t value, unsigned size)
+{
+    Column column(size);
+    column.put(value);
+    os.write(column.data.data(), column.data.size());
+}
+
+
+static void
+writePadding(std::ostream &os, size_t size)
+{
+    static const char zeros[8] = {};
+    os.write(zeros, (8 - size % 8) % 8);
+}
+
+
+/*
+ * Flatten scalar values, and collect blob sizes from any value.
+ */
+class ValueEncoder : public trace::Visitor
+{
+public:
+    // Of the top level value being visited
+    ScalarType type;
+    uint64_t bits;
+    bool scalar;
+
+    Column *blobSizes;
+
+    void
+    encode(trace::Value *value) {
+        scalar = false;
+        depth = 0;
+        value->visit(*this);
+    }
+
+    void visit(trace::Null *) override {}
+    void visit(trace::Bool *node) override { set(SCALAR_BOOL, node->value); }
+    void visit(trace::SInt *node) override { set(SCALAR_SINT, node->value); }
+    void visit(trace::UInt *node) override { set(SCALAR_UINT, node->value); }
+    void visit(trace::Enum *node) override { set(SCALAR_ENUM, node->value); }
+    void visit(trace::Bitmask *node) override { set(SCALAR_BITMASK, node->value); }
+    void visit(trace::Pointer *node) override { set(SCALAR_POINTER, node->value); }
+
+    void visit(trace::Float *node) override {
+        setDouble(SCALAR_FLOAT, node->value);
+    }
+
+    void visit(trace::Double *node) override {
+        setDouble(SCALAR_DOUBLE, node->value);
+    }
+
+    void visit(trace::String *) override {}
+    void visit(trace::WString *) override {}
+
+    void visit(trace::Struct *node) override {
+        ++depth;
+        for (auto member : node->members) {
+            _visit(member);
+        }
+        --depth;
+    }
+
+    void visit(trace::Array *node) override {
+        ++depth;
+        for (auto value : node->values) {
+            _visit(value);
+        }
+        --depth;
+    }
+
+    void visit(trace::Blob *node) override {
+        blobSizes->put(node->size);
+    }
+
+    void visit(trace::Repr *node) override {
+        _visit(node->machineValue);
+    }
+
+private:
+    unsigned depth;
+
+    inline void
+    set(ScalarType _type, uint64_t _bits) {
+        if (depth == 0) {
+            type = _type;
+            bits = _bits;
+            scalar = true;
+        }
+    }
+
+    inline void
+    setDouble(ScalarType _type, double value) {
+        uint64_t _bits;
+        memcpy(&_bits, &value, sizeof _bits);
+        set(_type, _bits);
+    }
+};
+
+
+/*
+ * Encodes each range's calls as a row group on the parser's worker threads,
+ * fills in frame numbers in call order, and writes out row groups as soon as
+ * all their calls were visited.
+ */
+class Exporter : public trace::ParallelParser::Visitor
+{
+    struct RowGroup : public trace::ParallelParser::Batch {
+        Column columns[NUM_COLUMNS];
+        std::vector<bool> endFrame;
+        size_t numRows = 0;
+        size_t numVisited = 0;
+    };
+
+    struct RowGroupInfo {
+        uint64_t offset;
+        uint64_t numRows;
+    };
+
+    std::ostream &os;
+
+    os::mutex mutex;
+    std::map<unsigned, std::string> functions;
+
+    std::vector<RowGroupInfo> rowGroups;
+    unsigned frame = 0;
+
+public:
+    Exporter(std::ostream &_os) :
+        os(_os)
+    {
+        os.write(EXPORT_MAGIC, 8);
+        writeUInt(os, EXPORT_VERSION, 4);
+        writeUInt(os, 0, 4);
+    }
+
+    trace::ParallelParser::Batch *createBatch(void) override {
+        return new RowGroup;
+    }
+
+    void visitBatch(trace::ParallelParser::Batch &batch) override {
+        RowGroup &rowGroup = static_cast<RowGroup &>(batch);
+        Column *columns = rowGroup.columns;
+
+        columns[COLUMN_CALL_NO] = Column(4);
+        columns[COLUMN_THREAD] = Column(4);
+        columns[COLUMN_FUNCTION] = Column(4);
+        columns[COLUMN_FLAGS] = Column(4);
+        columns[COLUMN_FRAME] = Column(4);
+        columns[COLUMN_ARG_OFFSETS] = Column(8);
+        columns[COLUMN_ARG_INDEX] = Column(2);
+        columns[COLUMN_ARG_TYPE] = Column(1);
+        columns[COLUMN_ARG_VALUE] = Column(8);
+        columns[COLUMN_BLOB_OFFSETS] = Column(8);
+        columns[COLUMN_BLOB_SIZE] = Column(8);
+
+        rowGroup.numRows = batch.calls.size();
+        rowGroup.endFrame.resize(rowGroup.numRows);
+
+        ValueEncoder encoder;
+        encoder.blobSizes = &columns[COLUMN_BLOB_SIZE];
+
+        std::map<unsigned, const char *> batchFunctions;
+
+        columns[COLUMN_ARG_OFFSETS].put(0);
+        columns[COLUMN_BLOB_OFFSETS].put(0);
+        for (size_t i = 0; i < batch.calls.size(); ++i) {
+            trace::Call *call = batch.calls[i];
+
+            columns[COLUMN_CALL_NO].put(call->no);
+            columns[COLUMN_THREAD].put(call->thread_id);
+            columns[COLUMN_FUNCTION].put(call->sig->id);
+            columns[COLUMN_FLAGS].put(call->flags);
+            batchFunctions[call->sig->id] = call->sig->name;
+
+            for (size_t j = 0; j <= call->args.size(); ++j) {
+                trace::Value *value;
+                unsigned index;
+                if (j < call->args.size()) {
+                    value = call->args[j].value;
+                    index = j;
+                } else {
+                    value = call->ret;
+                    index = EXPORT_RETURN_VALUE;
+                }
+                if (!value) {
+                    continue;
+                }
+                encoder.encode(value);
+                if (encoder.scalar) {
+                    columns[COLUMN_ARG_INDEX].put(index);
+                    columns[COLUMN_ARG_TYPE].put(encoder.type);
+                    columns[COLUMN_ARG_VALUE].put(encoder.bits);
+                }
+            }
+            columns[COLUMN_ARG_OFFSETS].put(columns[COLUMN_ARG_VALUE].size());
+            columns[COLUMN_BLOB_OFFSETS].put(columns[COLUMN_BLOB_SIZE].size());
+
+            rowGroup.endFrame[i] = call->flags & trace::CALL_FLAG_END_FRAME;
+
+            // Only the columns are needed from now on
+            delete call;
+            batch.calls[i] = nullptr;
+        }
+
+        os::unique_lock<os::mutex> lock(mutex);
+        for (auto & function : batchFunctions) {
+            functions[function.first] = function.second;
+        }
+    }
+
+    void visitCall(trace::ParallelParser::Batch &batch, size_t index) override {
+        RowGroup &rowGroup = static_cast<RowGroup &>(batch);
+
+        // Calls are visited in order, but not necessarily all calls of a
+        // row group consecutively, so frame numbers are stored by row
+        Column &frames = rowGroup.columns[COLUMN_FRAME];
+        if (frames.data.empty()) {
+            frames.data.resize(rowGroup.numRows * frames.elementSize);
+        }
+        for (unsigned i = 0; i < frames.elementSize; ++i) {
+            frames.data[index * frames.elementSize + i] = static_cast<char>(frame >> (8 * i));
+        }
+        if (rowGroup.endFrame[index]) {
+            ++frame;
+        }
+
+        if (++rowGroup.numVisited == rowGroup.numRows) {
+            writeRowGroup(rowGroup);
+        }
+    }
+
+    void finish(void) {
+        uint64_t footerOffset = os.tellp();
+
+        writeUInt(os, rowGroups.size(), 8);
+        for (auto & rowGroup : rowGroups) {
+            writeUInt(os, rowGroup.offset, 8);
+            writeUInt(os, rowGroup.numRows, 8);
+        }
+
+        writeUInt(os, functions.size(), 8);
+        for (auto & function : functions) {
+            writeUInt(os, function.first, 4);
+            writeUInt(os, function.second.size(), 4);
+            os.write(function.second.data(), function.second.size());
+            writePadding(os, function.second.size());
+        }
+
+        writeUInt(os, footerOffset, 8);
+        os.write(EXPORT_MAGIC, 8);
+    }
+
+private:
+    void writeRowGroup(RowGroup &rowGroup) {
+        RowGroupInfo info;
+        info.offset = os.tellp();
+        info.numRows = rowGroup.numRows;
+        rowGroups.push_back(info);
+
+        writeUInt(os, rowGroup.numRows, 8);
+        writeUInt(os, NUM_COLUMNS, 4);
+        writeUInt(os, 0, 4);
+        for (unsigned id = 0; id < NUM_COLUMNS; ++id) {
+            Column &column = rowGroup.columns[id];
+            writeUInt(os, id, 4);
+            writeUInt(os, column.elementSize, 4);
+            writeUInt(os, column.data.size(), 8);
+            os.write(column.data.data(), column.data.size());
+            writePadding(os, column.data.size());
+
+            // Release memory early, as the batch may be kept alive a bit
+            // longer by the parser
+            std::string().swap(column.data);
+        }
+    }
+};
+
+
+static int
+command(int argc, char *argv[])
+{
+    std::string output;
+    unsigned numThreads = 0;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'o':
+            output = optarg;
+            break;
+        case 'j':
+            numThreads = atoi(optarg);
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc != optind + 1) {
+        std::cerr << "error: a single trace file must be specified\n";
+        usage();
+        return 1;
+    }
+
+    std::string input = argv[optind];
+    if (output.empty()) {
+        output = input;
+        size_t dot = output.rfind(".trace");
+        if (dot != std::string::npos && dot + strlen(".trace") == output.size()) {
+            output.resize(dot);
+        }
+        output += ".columns";
+    }
+
+    trace::ParallelParser p;
+    p.setCallArenas(true);
+    if (!p.open(input.c_str())) {
+        return 1;
+    }
+
+    std::ofstream os(output, std::ofstream::binary);
+    if (!os) {
+        std::cerr << "error: failed to create " << output << "\n";
+        return 1;
+    }
+
+    Exporter exporter(os);
+    p.parse(exporter, numThreads);
+    exporter.finish();
+
+    os.close();
+    if (!os) {
+        std::cerr << "error: failed to write " << output << "\n";
+        return 1;
+    }
+
+    std::cerr << "Exported calls are available as " << output << "\n";
+
+    return 0;
+}
+
+const Command export_command = {
+    "export",
+    synopsis,
+    usage,
+    command
+};
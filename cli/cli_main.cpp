@@ -66,14 +66,18 @@ const Command help_command = {
 };
 
 static const Command * commands[] = {
+    &compile_command,
     &diff_command,
     &diff_state_command,
     &diff_images_command,
     &dump_command,
     &dump_images_command,
+    &export_command,
     &leaks_command,
     &pickle_command,
     &sed_command,
+    &stats_command,
+    &synth_command,
     &repack_command,
     &retrace_command,
     &trace_command,
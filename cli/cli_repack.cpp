@@ -27,6 +27,9 @@
 #include <string.h>
 #include <getopt.h>
 
+#include <algorithm>
+#include <deque>
+#include <iomanip>
 #include <iostream>
 #include <memory>
 
@@ -35,8 +38,13 @@
 #include <brotli/enc/encode.h>
 #include <zlib.h>  // for crc32
 
+#include "os_thread.hpp"
+#include "os_time.hpp"
 #include "trace_file.hpp"
+#include "trace_index.hpp"
 #include "trace_ostream.hpp"
+#include "trace_parser.hpp"
+#include "trace_writer.hpp"
 
 
 static const char *synopsis = "Repack a trace file with different compression.";
@@ -51,19 +59,33 @@ usage(void)
         << "Snappy compression allows for faster replay and smaller memory footprint,\n"
         << "at the expense of a slightly smaller compression ratio than zlib\n"
         << "\n"
+        << "Snappy and Zstandard chunks are compressed in parallel.  Other formats\n"
+        << "decompress the input and compress the output on separate threads.\n"
+        << "\n"
         << "    -b,--brotli  Use Brotli compression\n"
         << "    -z,--zlib    Use ZLib compression\n"
+        << "    --zstd[=LEVEL]  Use Zstandard compression, at the given level\n"
+        << "    -i,--index   Write an index alongside the output, for fast random access\n"
+        << "                 (Snappy and Zstandard compression only)\n"
+        << "    -j,--threads=N  Compress on N threads [default: number of cores]\n"
+        << "    --dedup      Rewrite the calls, so that repeated blobs and strings are\n"
+        << "                 written once, and calls are prefixed with their length\n"
+        << "                 (Snappy and Zstandard compression only)\n"
         << "\n";
 }
 
 const static char *
-shortOptions = "hbz";
+shortOptions = "hbzij:";
 
 const static struct option
 longOptions[] = {
     {"help", no_argument, 0, 'h'},
     {"brotli", optional_argument, 0, 'b'},
     {"zlib", no_argument, 0, 'z'},
+    {"zstd", optional_argument, 0, 'Z'},
+    {"index", no_argument, 0, 'i'},
+    {"threads", required_argument, 0, 'j'},
+    {"dedup", no_argument, 0, 'D'},
     {0, 0, 0, 0}
 };
 
@@ -71,21 +93,123 @@ enum Format {
     FORMAT_SNAPPY = 0,
     FORMAT_ZLIB,
     FORMAT_BROTLI,
+    FORMAT_ZSTD,
+};
+
+
+// Number of input chunks read ahead of the compressor
+#define REPACK_READ_AHEAD 4
+
+
+/*
+ * Reads the input trace on a separate thread, so that decompressing the input
+ * overlaps with compressing the output.  Chunks are handed over without
+ * copying them.
+ */
+class ChunkReader
+{
+public:
+    struct Chunk {
+        const char *data = nullptr;
+        size_t length = 0;
+        bool sync = false;
+        std::shared_ptr<void> owner;
+    };
+
+private:
+    trace::File *file;
+    os::thread thread;
+    os::mutex mutex;
+    os::condition_variable cond;
+    std::deque<Chunk> queue;
+    bool end = false;
+    bool stopping = false;
+
+public:
+    // Total uncompressed bytes handed over so far
+    unsigned long long bytesRead = 0;
+
+    ChunkReader(trace::File *f) :
+        file(f)
+    {
+        thread = os::thread(readThread, this);
+    }
+
+    ~ChunkReader() {
+        mutex.lock();
+        stopping = true;
+        mutex.unlock();
+        cond.notify_all();
+        thread.join();
+    }
+
+    bool
+    read(Chunk &chunk)
+    {
+        os::unique_lock<os::mutex> lock(mutex);
+        while (queue.empty() && !end) {
+            cond.wait(lock);
+        }
+        if (queue.empty()) {
+            return false;
+        }
+        chunk = std::move(queue.front());
+        queue.pop_front();
+        cond.notify_all();
+        bytesRead += chunk.length;
+        return true;
+    }
+
+private:
+    static void
+    readThread(ChunkReader *_this)
+    {
+        _this->readLoop();
+    }
+
+    void
+    readLoop(void)
+    {
+        while (true) {
+            Chunk chunk;
+            chunk.data = static_cast<const char *>(
+                file->readChunk(chunk.length, chunk.sync, chunk.owner));
+
+            os::unique_lock<os::mutex> lock(mutex);
+            if (!chunk.data) {
+                end = true;
+                cond.notify_all();
+                return;
+            }
+            while (!stopping && queue.size() >= REPACK_READ_AHEAD) {
+                cond.wait(lock);
+            }
+            if (stopping) {
+                return;
+            }
+            queue.push_back(std::move(chunk));
+            cond.notify_all();
+        }
+    }
 };
 
 
 class BrotliTraceIn : public brotli::BrotliIn
 {
 private:
-    trace::File *stream;
-    char buf[1 << 16];
+    ChunkReader *reader;
+    ChunkReader::Chunk chunk;
+    // Keeps the data last returned valid, as Brotli checks for the end of
+    // the input (which may read the next chunk) before using it
+    ChunkReader::Chunk previousChunk;
+    size_t pos = 0;
     bool eof = false;
 
 public:
     uLong crc;
 
-    BrotliTraceIn(trace::File *s) :
-        stream(s)
+    BrotliTraceIn(ChunkReader *r) :
+        reader(r)
     {
         crc = crc32(0L, Z_NULL, 0);
     }
@@ -96,41 +220,81 @@ public:
     const void *
     Read(size_t n, size_t* bytes_read) override
     {
-        if (n > sizeof buf) {
-            n = sizeof buf;
-        } else if (n == 0) {
-            return eof ? nullptr : buf;
+        *bytes_read = 0;
+        if (!eof && pos == chunk.length) {
+            pos = 0;
+            previousChunk = std::move(chunk);
+            if (!reader->read(chunk)) {
+                chunk = ChunkReader::Chunk();
+                eof = true;
+            }
         }
-        *bytes_read = stream->read(buf, n);
-        if (*bytes_read == 0) {
-            eof = true;
+        if (eof) {
             return nullptr;
         }
-        crc32(crc, reinterpret_cast<const Bytef *>(buf), *bytes_read);
+        const char *buf = chunk.data + pos;
+        n = std::min(n, chunk.length - pos);
+        pos += n;
+        *bytes_read = n;
+        crc = crc32(crc, reinterpret_cast<const Bytef *>(buf), n);
         return buf;
     }
 };
 
 
 static int
-repack_generic(trace::File *inFile, trace::OutStream *outFile)
+repack_generic(ChunkReader &reader, trace::OutStream *outFile)
 {
-    const size_t size = 8192;
-    char *buf = new char[size];
-    size_t read;
+    ChunkReader::Chunk chunk;
+    while (reader.read(chunk)) {
+        // Preserve the synchronization points where possible
+        if (chunk.sync) {
+            outFile->beginSyncPoint(chunk.length);
+        }
+        outFile->write(chunk.data, chunk.length);
+    }
+
+    return EXIT_SUCCESS;
+}
+
 
-    while ((read = inFile->read(buf, size)) != 0) {
-        outFile->write(buf, read);
+/*
+ * Parse and write all calls again, rather than copying the events verbatim,
+ * so that blobs are deduplicated, and calls can be skipped at once.  Like
+ * trimming, calls are written in the order they completed.
+ */
+static int
+repack_dedup(const char *inFileName, trace::OutStream *outFile)
+{
+    trace::Writer writer;
+    writer.open(outFile);
+    writer.setCallLengths(true);
+    writer.setDedupBlobs(true);
+    writer.setStringRefs(true);
+
+    trace::Parser parser;
+    if (!parser.open(inFileName)) {
+        std::cerr << "error: failed to open " << inFileName << "\n";
+        return EXIT_FAILURE;
+    }
+    parser.setCallArenas(true);
+
+    unsigned long long numCalls = 0;
+    trace::Call *call;
+    while ((call = parser.parse_call())) {
+        writer.writeCall(call);
+        delete call;
+        ++numCalls;
     }
 
-    delete [] buf;
+    std::cerr << "info: rewrote " << numCalls << " calls\n";
 
     return EXIT_SUCCESS;
 }
 
 
 static int
-repack_brotli(trace::File *inFile, const char *outFileName, int quality)
+repack_brotli(ChunkReader &reader, const char *outFileName, int quality)
 {
     brotli::BrotliParams params;
 
@@ -151,7 +315,7 @@ repack_brotli(trace::File *inFile, const char *outFileName, int quality)
         params.quality = quality;
     }
 
-    BrotliTraceIn in(inFile);
+    BrotliTraceIn in(&reader);
     FILE *fout = fopen(outFileName, "wb");
     if (!fout) {
         return EXIT_FAILURE;
@@ -169,7 +333,8 @@ repack_brotli(trace::File *inFile, const char *outFileName, int quality)
         std::cerr << "error: failed to open " << outFileName << " for reading\n";
         return EXIT_FAILURE;
     }
-    BrotliTraceIn outIn(outFileIn.get());
+    ChunkReader outReader(outFileIn.get());
+    BrotliTraceIn outIn(&outReader);
     size_t bytes_read;
     do {
         outIn.Read(65536, &bytes_read);
@@ -184,7 +349,34 @@ repack_brotli(trace::File *inFile, const char *outFileName, int quality)
 }
 
 static int
-repack(const char *inFileName, const char *outFileName, Format format, int quality)
+writeIndex(const char *fileName)
+{
+    trace::Parser parser;
+    if (!parser.open(fileName)) {
+        std::cerr << "error: failed to open " << fileName << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // Scan the trace, and save the index alongside.
+    std::string indexFileName = trace::Index::getFilename(fileName);
+    remove(indexFileName.c_str());
+    if (!parser.getIndex(true)) {
+        std::cerr << "error: " << fileName << " does not support indexing\n";
+        return EXIT_FAILURE;
+    }
+
+    trace::Index index;
+    if (!index.load(indexFileName.c_str(), fileName)) {
+        std::cerr << "error: failed to write " << indexFileName << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int
+repack(const char *inFileName, const char *outFileName, Format format,
+       int quality, int zstdLevel, unsigned numThreads, bool dedup)
 {
     int ret = EXIT_FAILURE;
 
@@ -193,23 +385,52 @@ repack(const char *inFileName, const char *outFileName, Format format, int quali
         return 1;
     }
 
+    long long startTime = os::getTime();
+    unsigned long long bytesRead = 0;
+
     trace::OutStream *outFile = nullptr;
     if (format == FORMAT_SNAPPY) {
-        outFile = trace::createSnappyStream(outFileName);
+        outFile = trace::createSnappyStream(outFileName, numThreads);
     } else if (format == FORMAT_BROTLI) {
-        ret = repack_brotli(inFile, outFileName, quality);
-        delete inFile;
-        return ret;
+        // Brotli streams can't be compressed in parallel
+        ChunkReader reader(inFile);
+        ret = repack_brotli(reader, outFileName, quality);
+        bytesRead = reader.bytesRead;
     } else if (format == FORMAT_ZLIB) {
         outFile = trace::createZLibStream(outFileName);
+    } else if (format == FORMAT_ZSTD) {
+#ifdef HAVE_ZSTD
+        outFile = trace::createZstdStream(outFileName, zstdLevel, numThreads);
+#else
+        (void)zstdLevel;
+        std::cerr << "error: apitrace was built without Zstandard support\n";
+#endif
+    }
+    if (outFile && dedup) {
+        delete inFile;
+        // The writer takes ownership of the stream
+        return repack_dedup(inFileName, outFile);
     }
     if (outFile) {
-        ret = repack_generic(inFile, outFile);
+        {
+            ChunkReader reader(inFile);
+            ret = repack_generic(reader, outFile);
+            bytesRead = reader.bytesRead;
+        }
         delete outFile;
     }
 
     delete inFile;
 
+    if (ret == EXIT_SUCCESS) {
+        double seconds = double(os::getTime() - startTime) / os::timeFrequency;
+        double megabytes = bytesRead / (1024.0 * 1024.0);
+        std::cerr << std::fixed << std::setprecision(1)
+                  << "info: repacked " << megabytes << " MB in "
+                  << seconds << " s (" << megabytes / std::max(seconds, 1e-6)
+                  << " MB/s)\n";
+    }
+
     return ret;
 }
 
@@ -217,8 +438,12 @@ static int
 command(int argc, char *argv[])
 {
     Format format = FORMAT_SNAPPY;
+    bool writeIndexFile = false;
+    bool dedup = false;
     int opt;
     int quality = -1;
+    int zstdLevel = 0;
+    unsigned numThreads = os::thread::hardware_concurrency();
     while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
         switch (opt) {
         case 'h':
@@ -233,6 +458,21 @@ command(int argc, char *argv[])
         case 'z':
             format = FORMAT_ZLIB;
             break;
+        case 'Z':
+            format = FORMAT_ZSTD;
+            if (optarg) {
+                zstdLevel = atoi(optarg);
+            }
+            break;
+        case 'i':
+            writeIndexFile = true;
+            break;
+        case 'j':
+            numThreads = std::max(atoi(optarg), 1);
+            break;
+        case 'D':
+            dedup = true;
+            break;
         default:
             std::cerr << "error: unexpected option `" << (char)opt << "`\n";
             usage();
@@ -246,7 +486,23 @@ command(int argc, char *argv[])
         return 1;
     }
 
-    return repack(argv[optind], argv[optind + 1], format, quality);
+    if (writeIndexFile && format != FORMAT_SNAPPY && format != FORMAT_ZSTD) {
+        std::cerr << "error: indexing requires Snappy or Zstandard compression\n";
+        return 1;
+    }
+
+    // Blobs are only released on synchronization events, which other
+    // formats lack
+    if (dedup && format != FORMAT_SNAPPY && format != FORMAT_ZSTD) {
+        std::cerr << "error: deduplication requires Snappy or Zstandard compression\n";
+        return 1;
+    }
+
+    int ret = repack(argv[optind], argv[optind + 1], format, quality, zstdLevel, numThreads, dedup);
+    if (ret == EXIT_SUCCESS && writeIndexFile) {
+        ret = writeIndex(argv[optind + 1]);
+    }
+    return ret;
 }
 
 const Command repack_command = {
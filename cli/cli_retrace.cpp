@@ -44,6 +44,11 @@
 static trace::API
 guessApi(const char *filename)
 {
+    trace::API api;
+    if (trace::isCompiledTrace(filename, &api)) {
+        return api;
+    }
+
     trace::Parser p;
     if (!p.open(filename)) {
         exit(1);
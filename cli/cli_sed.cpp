@@ -111,10 +111,9 @@ public:
     void visit(String *node) override {
         if (!searchName.compare(node->value)) {
             size_t len = replaceName.length() + 1;
-            delete [] node->value;
             char *str = new char [len];
             memcpy(str, replaceName.c_str(), len);
-            node->value = str;
+            node->reset(str);
         }
     }
 
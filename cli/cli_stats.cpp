@@ -0,0 +1,576 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <assert.h>
+#include <limits.h> // for CHAR_MAX
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "os_thread.hpp"
+
+#include "cli.hpp"
+
+#include "trace_parser_parallel.hpp"
+
+
+static const char *synopsis = "Summarize which calls and data a trace is made of.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace stats [OPTIONS] TRACE_FILE\n"
+        << synopsis << "\n"
+        "\n"
+        "    -h, --help           show this help message and exit\n"
+        "    -o, --output=FILE    write statistics to FILE [default: stdout]\n"
+        "        --format=FORMAT  output format, either 'json' or 'csv' [default: json]\n"
+        "        --top=N          number of largest calls to report [default: 10]\n"
+        "    -j, --threads=N      parse the trace on N threads [default: number of cores]\n"
+        "\n"
+        "Reports call counts and argument bytes per function, a histogram of blob\n"
+        "sizes, call counts per frame and per thread, and the largest calls.\n"
+        "\n"
+        "Argument bytes are the size of the argument and return values' data:\n"
+        "blob sizes, string lengths, and the natural size of scalars.\n"
+        "\n"
+        "CSV output consists of one table per statistic, each starting with a\n"
+        "header row, separated by empty lines.\n"
+    ;
+}
+
+enum {
+    FORMAT_OPT = CHAR_MAX + 1,
+    TOP_OPT,
+};
+
+const static char *
+shortOptions = "ho:j:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"output", required_argument, 0, 'o'},
+    {"format", required_argument, 0, FORMAT_OPT},
+    {"top", required_argument, 0, TOP_OPT},
+    {"threads", required_argument, 0, 'j'},
+    {0, 0, 0, 0}
+};
+
+
+// Blobs of size in [2^(i-1), 2^i) go into bucket i, empty ones into bucket 0
+#define NUM_BLOB_BUCKETS 65
+
+
+struct FunctionStats
+{
+    const char *name = nullptr;
+    uint64_t calls = 0;
+    uint64_t bytes = 0;
+};
+
+
+struct LargeCall
+{
+    unsigned no;
+    unsigned functionId;
+    uint64_t bytes;
+
+    // Largest first, then by call number
+    bool operator < (const LargeCall &other) const {
+        return bytes > other.bytes ||
+               (bytes == other.bytes && no < other.no);
+    }
+};
+
+
+/*
+ * Statistics which don't depend on the order calls are visited in, so that
+ * they can be gathered on each range of the trace independently, and merged.
+ */
+struct Stats
+{
+    uint64_t calls = 0;
+
+    // Indexed by function signature ID
+    std::vector<FunctionStats> functions;
+
+    std::map<unsigned, uint64_t> threads;
+
+    uint64_t blobs = 0;
+    uint64_t blobBytes = 0;
+    uint64_t blobBuckets[NUM_BLOB_BUCKETS] = {};
+
+    std::vector<LargeCall> largest;
+
+    void
+    addBlob(size_t size) {
+        unsigned bucket = 0;
+        while (bucket < 64 && (uint64_t(1) << bucket) <= size) {
+            ++bucket;
+        }
+        ++blobs;
+        blobBytes += size;
+        ++blobBuckets[bucket];
+    }
+
+    FunctionStats &
+    function(unsigned id) {
+        if (id >= functions.size()) {
+            functions.resize(id + 1);
+        }
+        return functions[id];
+    }
+
+    void
+    addLarge(const LargeCall &call, size_t top) {
+        if (largest.size() == top && !(call < largest.back())) {
+            return;
+        }
+        largest.insert(std::upper_bound(largest.begin(), largest.end(), call), call);
+        if (largest.size() > top) {
+            largest.pop_back();
+        }
+    }
+
+    void
+    merge(const Stats &other, size_t top) {
+        calls += other.calls;
+
+        for (unsigned id = 0; id < other.functions.size(); ++id) {
+            const FunctionStats &theirs = other.functions[id];
+            if (theirs.calls) {
+                FunctionStats &ours = function(id);
+                ours.name = theirs.name;
+                ours.calls += theirs.calls;
+                ours.bytes += theirs.bytes;
+            }
+        }
+
+        for (auto & thread : other.threads) {
+            threads[thread.first] += thread.second;
+        }
+
+        blobs += other.blobs;
+        blobBytes += other.blobBytes;
+        for (unsigned i = 0; i < NUM_BLOB_BUCKETS; ++i) {
+            blobBuckets[i] += other.blobBuckets[i];
+        }
+
+        for (auto & call : other.largest) {
+            addLarge(call, top);
+        }
+    }
+};
+
+
+/*
+ * Add up the size of a value's data, recording blobs along the way.
+ */
+class ByteCounter : public trace::Visitor
+{
+    Stats &stats;
+
+public:
+    uint64_t bytes = 0;
+
+    ByteCounter(Stats &_stats) :
+        stats(_stats)
+    {}
+
+    void visit(trace::Null *) override {}
+    void visit(trace::Bool *) override { bytes += 1; }
+    void visit(trace::SInt *) override { bytes += 8; }
+    void visit(trace::UInt *) override { bytes += 8; }
+    void visit(trace::Float *) override { bytes += 4; }
+    void visit(trace::Double *) override { bytes += 8; }
+    void visit(trace::Enum *) override { bytes += 8; }
+    void visit(trace::Bitmask *) override { bytes += 8; }
+    void visit(trace::Pointer *) override { bytes += 8; }
+
+    void visit(trace::String *node) override {
+        bytes += strlen(node->value);
+    }
+
+    void visit(trace::WString *node) override {
+        bytes += wcslen(node->value) * sizeof(wchar_t);
+    }
+
+    void visit(trace::Struct *node) override {
+        for (auto member : node->members) {
+            _visit(member);
+        }
+    }
+
+    void visit(trace::Array *node) override {
+        for (auto value : node->values) {
+            _visit(value);
+        }
+    }
+
+    void visit(trace::Blob *node) override {
+        bytes += node->size;
+        stats.addBlob(node->size);
+    }
+
+    void visit(trace::Repr *node) override {
+        _visit(node->machineValue);
+    }
+};
+
+
+/*
+ * Gathers statistics on the parser's worker threads, and counts calls per
+ * frame in order.
+ */
+class StatsCollector : public trace::ParallelParser::Visitor
+{
+    struct StatsBatch : public trace::ParallelParser::Batch {
+        std::vector<bool> endFrame;
+    };
+
+    size_t top;
+
+    os::mutex mutex;
+
+public:
+    Stats stats;
+
+    std::vector<uint64_t> frames;
+    uint64_t frameCalls = 0;
+
+    StatsCollector(size_t _top) :
+        top(_top)
+    {}
+
+    trace::ParallelParser::Batch *createBatch(void) override {
+        return new StatsBatch;
+    }
+
+    void visitBatch(trace::ParallelParser::Batch &batch) override {
+        StatsBatch &statsBatch = static_cast<StatsBatch &>(batch);
+        statsBatch.endFrame.resize(batch.calls.size());
+
+        Stats batchStats;
+        for (size_t i = 0; i < batch.calls.size(); ++i) {
+            trace::Call *call = batch.calls[i];
+
+            ByteCounter counter(batchStats);
+            for (auto & arg : call->args) {
+                if (arg.value) {
+                    arg.value->visit(counter);
+                }
+            }
+            if (call->ret) {
+                call->ret->visit(counter);
+            }
+
+            ++batchStats.calls;
+            FunctionStats &function = batchStats.function(call->sig->id);
+            function.name = call->sig->name;
+            ++function.calls;
+            function.bytes += counter.bytes;
+            ++batchStats.threads[call->thread_id];
+
+            LargeCall large;
+            large.no = call->no;
+            large.functionId = call->sig->id;
+            large.bytes = counter.bytes;
+            batchStats.addLarge(large, top);
+
+            statsBatch.endFrame[i] = call->flags & trace::CALL_FLAG_END_FRAME;
+
+            delete call;
+            batch.calls[i] = nullptr;
+        }
+
+        os::unique_lock<os::mutex> lock(mutex);
+        stats.merge(batchStats, top);
+    }
+
+    void visitCall(trace::ParallelParser::Batch &batch, size_t index) override {
+        StatsBatch &statsBatch = static_cast<StatsBatch &>(batch);
+        ++frameCalls;
+        if (statsBatch.endFrame[index]) {
+            frames.push_back(frameCalls);
+            frameCalls = 0;
+        }
+    }
+
+    void finish(void) {
+        // Calls past the last frame boundary make up a frame of their own
+        if (frameCalls) {
+            frames.push_back(frameCalls);
+            frameCalls = 0;
+        }
+    }
+};
+
+
+static void
+writeJSONString(std::ostream &os, const char *str)
+{
+    os << '"';
+    for (const char *p = str; *p; ++p) {
+        unsigned char c = *p;
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            os << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+        } else {
+            os << c;
+        }
+    }
+    os << '"';
+}
+
+
+// Bounds of a blob size bucket
+static void
+blobBucketRange(unsigned bucket, uint64_t &min, uint64_t &max)
+{
+    if (bucket == 0) {
+        min = max = 0;
+    } else {
+        min = uint64_t(1) << (bucket - 1);
+        max = (min << 1) - 1;
+    }
+}
+
+
+// Functions, by decreasing number of calls
+static std::vector<const FunctionStats *>
+sortedFunctions(const Stats &stats)
+{
+    std::vector<const FunctionStats *> functions;
+    for (auto & function : stats.functions) {
+        if (function.calls) {
+            functions.push_back(&function);
+        }
+    }
+    std::stable_sort(functions.begin(), functions.end(),
+        [](const FunctionStats *a, const FunctionStats *b) {
+            return a->calls > b->calls;
+        });
+    return functions;
+}
+
+
+static void
+writeJSON(std::ostream &os, const StatsCollector &collector)
+{
+    const Stats &stats = collector.stats;
+
+    os << "{\n";
+    os << "  \"calls\": " << stats.calls << ",\n";
+    os << "  \"frames\": " << collector.frames.size() << ",\n";
+
+    os << "  \"functions\": [";
+    const char *sep = "\n";
+    for (auto function : sortedFunctions(stats)) {
+        os << sep << "    {\"name\": ";
+        writeJSONString(os, function->name);
+        os << ", \"calls\": " << function->calls
+           << ", \"bytes\": " << function->bytes << "}";
+        sep = ",\n";
+    }
+    os << "\n  ],\n";
+
+    os << "  \"blobs\": {\n";
+    os << "    \"count\": " << stats.blobs << ",\n";
+    os << "    \"bytes\": " << stats.blobBytes << ",\n";
+    os << "    \"histogram\": [";
+    sep = "\n";
+    for (unsigned i = 0; i < NUM_BLOB_BUCKETS; ++i) {
+        if (stats.blobBuckets[i]) {
+            uint64_t min, max;
+            blobBucketRange(i, min, max);
+            os << sep << "      {\"min\": " << min << ", \"max\": " << max
+               << ", \"count\": " << stats.blobBuckets[i] << "}";
+            sep = ",\n";
+        }
+    }
+    os << "\n    ]\n";
+    os << "  },\n";
+
+    os << "  \"threads\": [";
+    sep = "\n";
+    for (auto & thread : stats.threads) {
+        os << sep << "    {\"thread\": " << thread.first
+           << ", \"calls\": " << thread.second << "}";
+        sep = ",\n";
+    }
+    os << "\n  ],\n";
+
+    os << "  \"frame_calls\": [";
+    sep = "";
+    for (auto calls : collector.frames) {
+        os << sep << calls;
+        sep = ", ";
+    }
+    os << "],\n";
+
+    os << "  \"largest_calls\": [";
+    sep = "\n";
+    for (auto & call : stats.largest) {
+        os << sep << "    {\"no\": " << call.no << ", \"name\": ";
+        writeJSONString(os, stats.functions[call.functionId].name);
+        os << ", \"bytes\": " << call.bytes << "}";
+        sep = ",\n";
+    }
+    os << "\n  ]\n";
+    os << "}\n";
+}
+
+
+static void
+writeCSV(std::ostream &os, const StatsCollector &collector)
+{
+    const Stats &stats = collector.stats;
+
+    // Function names are C identifiers, so need no quoting
+    os << "function,calls,bytes\n";
+    for (auto function : sortedFunctions(stats)) {
+        os << function->name << "," << function->calls << "," << function->bytes << "\n";
+    }
+
+    os << "\nblob_size_min,blob_size_max,blobs\n";
+    for (unsigned i = 0; i < NUM_BLOB_BUCKETS; ++i) {
+        if (stats.blobBuckets[i]) {
+            uint64_t min, max;
+            blobBucketRange(i, min, max);
+            os << min << "," << max << "," << stats.blobBuckets[i] << "\n";
+        }
+    }
+
+    os << "\nthread,calls\n";
+    for (auto & thread : stats.threads) {
+        os << thread.first << "," << thread.second << "\n";
+    }
+
+    os << "\nframe,calls\n";
+    for (size_t i = 0; i < collector.frames.size(); ++i) {
+        os << i << "," << collector.frames[i] << "\n";
+    }
+
+    os << "\ncall,function,bytes\n";
+    for (auto & call : stats.largest) {
+        os << call.no << "," << stats.functions[call.functionId].name << "," << call.bytes << "\n";
+    }
+}
+
+
+static int
+command(int argc, char *argv[])
+{
+    const char *output = nullptr;
+    bool csv = false;
+    size_t top = 10;
+    unsigned numThreads = 0;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'o':
+            output = optarg;
+            break;
+        case FORMAT_OPT:
+            if (!strcmp(optarg, "json")) {
+                csv = false;
+            } else if (!strcmp(optarg, "csv")) {
+                csv = true;
+            } else {
+                std::cerr << "error: unknown format " << optarg << "\n";
+                return 1;
+            }
+            break;
+        case TOP_OPT:
+            top = atoi(optarg);
+            break;
+        case 'j':
+            numThreads = atoi(optarg);
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc != optind + 1) {
+        std::cerr << "error: a single trace file must be specified\n";
+        usage();
+        return 1;
+    }
+
+    trace::ParallelParser p;
+    p.setCallArenas(true);
+    if (!p.open(argv[optind])) {
+        return 1;
+    }
+
+    StatsCollector collector(top);
+    p.parse(collector, numThreads);
+    collector.finish();
+
+    std::ofstream file;
+    if (output) {
+        file.open(output);
+        if (!file) {
+            std::cerr << "error: failed to create " << output << "\n";
+            return 1;
+        }
+    }
+    std::ostream &os = output ? file : std::cout;
+
+    if (csv) {
+        writeCSV(os, collector);
+    } else {
+        writeJSON(os, collector);
+    }
+
+    return 0;
+}
+
+const Command stats_command = {
+    "stats",
+    synopsis,
+    usage,
+    command
+};
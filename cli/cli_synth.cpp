@@ -0,0 +1,280 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <assert.h>
+#include <limits.h> // for CHAR_MAX
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cli.hpp"
+
+#include "trace_synth.hpp"
+#include "trace_writer.hpp"
+
+
+static const char *synopsis = "Generate a synthetic trace, for load testing.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace synth [OPTIONS]\n"
+        << synopsis << "\n"
+        "\n"
+        "    -h, --help               Show detailed help for synth options and exit\n"
+        "    -o, --output=TRACE_FILE  Output trace file [default: synth.trace]\n"
+        "        --calls=N            Number of calls [default: 100000]\n"
+        "        --frames=N           Number of frames the calls are split into\n"
+        "                             [default: 100]\n"
+        "        --threads=N          Number of threads issuing calls [default: 1]\n"
+        "        --blob-sizes=MIN-MAX Range of blob sizes in bytes, smaller ones being\n"
+        "                             more common [default: 64-65536]\n"
+        "        --blob-repeat=PCT    Percentage of blobs repeating a recent one\n"
+        "                             [default: 30]\n"
+        "        --string-repeat=PCT  Percentage of strings repeating an earlier one\n"
+        "                             [default: 90]\n"
+        "        --mix=CAT=W[,...]    Relative weight of each category of calls, among\n"
+        "                             draw, state, uniform, upload, and shader\n"
+        "                             [default: draw=35,state=30,uniform=25,upload=7,shader=3]\n"
+        "        --dedup-blobs        Write repeated blobs as references\n"
+        "        --string-refs        Write repeated strings as references\n"
+        "        --seed=N             Random seed [default: 1]\n"
+        "\n"
+        "The same options and seed always produce the same trace.\n"
+    ;
+}
+
+enum {
+    CALLS_OPT = CHAR_MAX + 1,
+    FRAMES_OPT,
+    THREADS_OPT,
+    BLOB_SIZES_OPT,
+    BLOB_REPEAT_OPT,
+    STRING_REPEAT_OPT,
+    MIX_OPT,
+    DEDUP_BLOBS_OPT,
+    STRING_REFS_OPT,
+    SEED_OPT,
+};
+
+const static char *
+shortOptions = "ho:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"output", required_argument, 0, 'o'},
+    {"calls", required_argument, 0, CALLS_OPT},
+    {"frames", required_argument, 0, FRAMES_OPT},
+    {"threads", required_argument, 0, THREADS_OPT},
+    {"blob-sizes", required_argument, 0, BLOB_SIZES_OPT},
+    {"blob-repeat", required_argument, 0, BLOB_REPEAT_OPT},
+    {"string-repeat", required_argument, 0, STRING_REPEAT_OPT},
+    {"mix", required_argument, 0, MIX_OPT},
+    {"dedup-blobs", no_argument, 0, DEDUP_BLOBS_OPT},
+    {"string-refs", no_argument, 0, STRING_REFS_OPT},
+    {"seed", required_argument, 0, SEED_OPT},
+    {0, 0, 0, 0}
+};
+
+
+struct synth_options : public trace::SynthOptions {
+    std::string output;
+    bool dedupBlobs;
+    bool stringRefs;
+};
+
+
+static bool
+parseRange(const char *arg, size_t &min, size_t &max)
+{
+    char *end;
+    min = strtoull(arg, &end, 0);
+    if (*end != '-') {
+        return false;
+    }
+    max = strtoull(end + 1, &end, 0);
+    return *end == '\0' && min > 0 && min <= max;
+}
+
+
+static bool
+parseMix(const char *arg, unsigned weights[trace::SYNTH_NUM_CATEGORIES])
+{
+    for (unsigned i = 0; i < trace::SYNTH_NUM_CATEGORIES; ++i) {
+        weights[i] = 0;
+    }
+
+    std::string mix(arg);
+    size_t start = 0;
+    while (start < mix.size()) {
+        size_t end = mix.find(',', start);
+        if (end == std::string::npos) {
+            end = mix.size();
+        }
+        std::string item = mix.substr(start, end - start);
+        size_t equal = item.find('=');
+        if (equal == std::string::npos) {
+            return false;
+        }
+        std::string name = item.substr(0, equal);
+        unsigned i;
+        for (i = 0; i < trace::SYNTH_NUM_CATEGORIES; ++i) {
+            if (name == trace::synthCategoryNames[i]) {
+                break;
+            }
+        }
+        if (i == trace::SYNTH_NUM_CATEGORIES) {
+            std::cerr << "error: unknown call category `" << name << "`\n";
+            return false;
+        }
+        weights[i] = atoi(item.c_str() + equal + 1);
+        start = end + 1;
+    }
+
+    unsigned total = 0;
+    for (unsigned i = 0; i < trace::SYNTH_NUM_CATEGORIES; ++i) {
+        total += weights[i];
+    }
+    return total > 0;
+}
+
+
+static int
+synth_trace(const synth_options &options)
+{
+    trace::Writer writer;
+    if (!writer.open(options.output.c_str())) {
+        std::cerr << "error: failed to create " << options.output << "\n";
+        return 1;
+    }
+    writer.setDedupBlobs(options.dedupBlobs);
+    writer.setStringRefs(options.stringRefs);
+
+    std::unique_ptr<trace::Synthesizer> synthesizer(trace::createSynthesizer(options));
+    for (unsigned long long no = 0; no < options.calls; ++no) {
+        trace::Call *call = synthesizer->call(no);
+        writer.writeCall(call);
+        delete call;
+    }
+
+    std::cerr << "Synthetic trace is available as " << options.output << "\n";
+
+    return 0;
+}
+
+
+static int
+command(int argc, char *argv[])
+{
+    synth_options options;
+    options.output = "synth.trace";
+    options.dedupBlobs = false;
+    options.stringRefs = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'o':
+            options.output = optarg;
+            break;
+        case CALLS_OPT:
+            options.calls = strtoull(optarg, NULL, 0);
+            break;
+        case FRAMES_OPT:
+            options.frames = atoi(optarg);
+            break;
+        case THREADS_OPT:
+            options.threads = std::max(atoi(optarg), 1);
+            break;
+        case BLOB_SIZES_OPT:
+            if (!parseRange(optarg, options.minBlobSize, options.maxBlobSize)) {
+                std::cerr << "error: invalid blob size range `" << optarg << "`\n";
+                return 1;
+            }
+            break;
+        case BLOB_REPEAT_OPT:
+            options.blobRepeat = atoi(optarg);
+            break;
+        case STRING_REPEAT_OPT:
+            options.stringRepeat = atoi(optarg);
+            break;
+        case MIX_OPT:
+            if (!parseMix(optarg, options.weights)) {
+                std::cerr << "error: invalid call mix `" << optarg << "`\n";
+                return 1;
+            }
+            break;
+        case DEDUP_BLOBS_OPT:
+            options.dedupBlobs = true;
+            break;
+        case STRING_REFS_OPT:
+            options.stringRefs = true;
+            break;
+        case SEED_OPT:
+            options.seed = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (optind < argc) {
+        std::cerr << "error: extraneous arguments:";
+        for (int i = optind; i < argc; i++) {
+            std::cerr << " " << argv[i];
+        }
+        std::cerr << "\n";
+        usage();
+        return 1;
+    }
+
+    if (options.frames > options.calls) {
+        options.frames = options.calls;
+    }
+
+    return synth_trace(options);
+}
+
+const Command synth_command = {
+    "synth",
+    synopsis,
+    usage,
+    command
+};
@@ -34,6 +34,7 @@
 #include "os_string.hpp"
 
 #include "trace_callset.hpp"
+#include "trace_index.hpp"
 #include "trace_parser.hpp"
 #include "trace_writer.hpp"
 
@@ -120,6 +121,24 @@ trim_trace(const char *filename, struct trim_options *options)
 
 
     frame = 0;
+
+    /* Skip straight to the first call or frame requested if the trace was
+     * indexed. */
+    const trace::Index *index = p.getIndex(false);
+    if (index) {
+        if (!options->frames.empty()) {
+            unsigned first = options->frames.getFirst();
+            if (first > 0 && first < index->frames.size() &&
+                (options->calls.empty() ||
+                 options->calls.getFirst() >= index->frames[first].start.next_call_no) &&
+                p.jumpToFrame(first)) {
+                frame = first;
+            }
+        } else if (options->calls.getFirst() > 0) {
+            p.jumpToCall(options->calls.getFirst());
+        }
+    }
+
     trace::Call *call;
     while ((call = p.parse_call())) {
 
@@ -170,6 +170,9 @@ trim_trace(const char *filename, struct trim_auto_options *options)
     unsigned frame;
     int call_range_first, call_range_last;
 
+    p.setCallArenas(true);
+    p.setLazyArgs(true);
+
     if (!p.open(filename)) {
         std::cerr << "error: failed to open " << filename << "\n";
         return 1;
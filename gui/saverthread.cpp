@@ -326,8 +326,7 @@ overwriteValue(trace::Call *call, const QVariant &val, int index)
     origValue->visit(visitor);
 
     if (visitor.value() && origValue != visitor.value()) {
-        delete origValue;
-        call->args[index].value = visitor.value();
+        call->args[index].reset(visitor.value());
     }
 }
 
@@ -329,82 +329,6 @@ namespace os {
     };
 
 
-    /**
-     * Implement TLS through OS threading API.
-     *
-     * This will only work when T is a pointer, intptr_t, or uintptr_t.
-     */
-    template <typename T>
-    class thread_specific
-    {
-    private:
-        static_assert(sizeof(T) == sizeof(void *), "Size mismatch");
-
-#ifdef _WIN32
-        DWORD dwTlsIndex;
-#else
-        pthread_key_t key;
-#endif
-
-    public:
-        thread_specific(void) {
-#ifdef _WIN32
-            dwTlsIndex = TlsAlloc();
-#else
-            pthread_key_create(&key, NULL);
-#endif
-        }
-
-        ~thread_specific() {
-#ifdef _WIN32
-            TlsFree(dwTlsIndex);
-#else
-            pthread_key_delete(key);
-#endif
-        }
-
-        inline T
-        get(void) const {
-            void *ptr;
-#ifdef _WIN32
-            ptr = TlsGetValue(dwTlsIndex);
-#else
-            ptr = pthread_getspecific(key);
-#endif
-            return reinterpret_cast<T>(ptr);
-        }
-
-        inline
-        operator T (void) const
-        {
-            return get();
-        }
-
-        inline T
-        operator -> (void) const
-        {
-            return get();
-        }
-
-        inline T
-        operator = (T new_value)
-        {
-            set(new_value);
-            return new_value;
-        }
-
-        inline void
-        set(T new_value) {
-            void *new_ptr = reinterpret_cast<void *>(new_value);
-#ifdef _WIN32
-            TlsSetValue(dwTlsIndex, new_ptr);
-#else
-            pthread_setspecific(key, new_ptr);
-#endif
-        }
-    };
-
-
     /**
      * Same interface as std::thread
      */
@@ -512,6 +436,98 @@ namespace os {
 #endif  /* !HAVE_CXX11_THREADS */
 
 
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#endif
+
+
+namespace os {
+
+
+    /**
+     * Implement TLS through OS threading API.
+     *
+     * This will only work when T is a pointer, intptr_t, or uintptr_t.
+     *
+     * The optional destructor is called with the non-null value of each
+     * thread that exits.  It is not called on Windows.
+     */
+    template <typename T>
+    class thread_specific
+    {
+    private:
+        static_assert(sizeof(T) == sizeof(void *), "Size mismatch");
+
+#ifdef _WIN32
+        DWORD dwTlsIndex;
+#else
+        pthread_key_t key;
+#endif
+
+    public:
+        thread_specific(void (*destructor)(void *) = NULL) {
+#ifdef _WIN32
+            (void)destructor;
+            dwTlsIndex = TlsAlloc();
+#else
+            pthread_key_create(&key, destructor);
+#endif
+        }
+
+        ~thread_specific() {
+#ifdef _WIN32
+            TlsFree(dwTlsIndex);
+#else
+            pthread_key_delete(key);
+#endif
+        }
+
+        inline T
+        get(void) const {
+            void *ptr;
+#ifdef _WIN32
+            ptr = TlsGetValue(dwTlsIndex);
+#else
+            ptr = pthread_getspecific(key);
+#endif
+            return reinterpret_cast<T>(ptr);
+        }
+
+        inline
+        operator T (void) const
+        {
+            return get();
+        }
+
+        inline T
+        operator -> (void) const
+        {
+            return get();
+        }
+
+        inline T
+        operator = (T new_value)
+        {
+            set(new_value);
+            return new_value;
+        }
+
+        inline void
+        set(T new_value) {
+            void *new_ptr = reinterpret_cast<void *>(new_value);
+#ifdef _WIN32
+            TlsSetValue(dwTlsIndex, new_ptr);
+#else
+            pthread_setspecific(key, new_ptr);
+#endif
+        }
+    };
+
+} /* namespace os */
+
+
 /**
  * Compiler TLS.
  *
@@ -0,0 +1,410 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Microbenchmarks for the trace I/O, parsing, and writing hot paths.
+ *
+ * A synthetic trace is generated deterministically from a seed, by the same
+ * generator as `apitrace synth`, and each stage is then timed separately,
+ * reporting the best of several runs as JSON on stdout, so that results can
+ * be compared across builds and machines:
+ *
+ *   trace_bench [--calls=N] [--seed=N] [--repeat=N] [--dir=PATH]
+ */
+
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "os_string.hpp"
+#include "os_time.hpp"
+#include "trace_dump.hpp"
+#include "trace_file.hpp"
+#include "trace_ostream.hpp"
+#include "trace_parser.hpp"
+#include "trace_synth.hpp"
+#include "trace_writer.hpp"
+
+
+using namespace trace;
+
+
+/*
+ * Stream which only counts the bytes written, optionally keeping them.
+ */
+class MemoryStream : public OutStream
+{
+public:
+    std::string *data;
+    unsigned long long size;
+
+    MemoryStream(std::string *_data) : data(_data), size(0) {}
+
+    bool write(const void *buffer, size_t length) override {
+        if (data) {
+            data->append(static_cast<const char *>(buffer), length);
+        }
+        size += length;
+        return true;
+    }
+
+    void flush(void) override {}
+};
+
+
+/*
+ * Make the synthetic calls, as `apitrace synth` does with the default mix of
+ * calls: mostly draws, state changes and uniform updates, some buffer
+ * uploads, and occasional shader compilation.
+ */
+static std::vector<Call *>
+makeCalls(unsigned numCalls, uint64_t seed)
+{
+    SynthOptions options;
+    options.calls = numCalls;
+    options.frames = std::max(numCalls / 500, 1U);
+    options.seed = seed;
+
+    std::unique_ptr<Synthesizer> synthesizer(createSynthesizer(options));
+    std::vector<Call *> calls(numCalls);
+    for (unsigned i = 0; i < numCalls; ++i) {
+        calls[i] = synthesizer->call(i);
+    }
+    return calls;
+}
+
+
+static void
+writeCalls(Writer &writer, const std::vector<Call *> &calls)
+{
+    for (auto call : calls) {
+        writer.writeCall(call);
+    }
+}
+
+
+/*
+ * Parser exposing the scan and skip modes.
+ */
+class BenchParser : public Parser
+{
+public:
+    Call *parse(bool scan, bool skip) {
+        return parse_call(skip ? SKIP : scan ? SCAN : FULL);
+    }
+};
+
+
+/*
+ * Output stream buffer which only counts characters.
+ */
+class CountingBuf : public std::streambuf
+{
+public:
+    unsigned long long count = 0;
+
+protected:
+    int overflow(int c) override {
+        ++count;
+        return c;
+    }
+
+    std::streamsize xsputn(const char *, std::streamsize n) override {
+        count += n;
+        return n;
+    }
+};
+
+
+struct Result
+{
+    std::string name;
+    unsigned long long calls;
+    unsigned long long bytes;
+    double seconds;
+};
+
+
+static std::vector<Result> results;
+static unsigned repeat = 3;
+
+
+static double
+now(void)
+{
+    return double(os::getTime()) / os::timeFrequency;
+}
+
+
+/*
+ * Run the given function several times, recording the fastest run.
+ */
+template< class Function >
+static void
+measure(const char *name, unsigned long long calls, unsigned long long bytes, Function function)
+{
+    double best = 0;
+    for (unsigned i = 0; i < repeat; ++i) {
+        double start = now();
+        function();
+        double seconds = now() - start;
+        if (i == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    results.push_back({name, calls, bytes, best});
+    std::cerr << "info: " << name << ": " << best << " s\n";
+}
+
+
+static bool
+readFile(const char *filename, unsigned long long &bytes)
+{
+    std::unique_ptr<File> file(File::createForRead(filename));
+    if (!file) {
+        return false;
+    }
+    static char buffer[64 * 1024];
+    bytes = 0;
+    size_t length;
+    while ((length = file->read(buffer, sizeof buffer)) != 0) {
+        bytes += length;
+    }
+    return true;
+}
+
+
+static void
+parseFile(const char *filename, bool scan, bool skip)
+{
+    BenchParser parser;
+    if (!parser.open(filename)) {
+        std::cerr << "error: failed to open " << filename << "\n";
+        exit(1);
+    }
+    Call *call;
+    while ((call = parser.parse(scan, skip))) {
+        delete call;
+    }
+}
+
+
+static void
+writeStream(OutStream *stream, const std::string &data)
+{
+    // The data has no synchronization events, so don't start chunks with
+    // them, and write it in pieces like the writer does for large calls
+    const size_t pieceSize = 4096;
+    for (size_t offset = 0; offset < data.size(); offset += pieceSize) {
+        stream->write(data.data() + offset, std::min(pieceSize, data.size() - offset));
+    }
+    delete stream;
+}
+
+
+static void
+printResults(void)
+{
+    std::cout << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+        double seconds = std::max(result.seconds, 1e-9);
+        std::cout
+            << "    {\"name\": \"" << result.name << "\""
+            << ", \"calls\": " << result.calls
+            << ", \"bytes\": " << result.bytes
+            << ", \"seconds\": " << result.seconds
+            << ", \"calls_per_second\": " << result.calls / seconds
+            << ", \"mb_per_second\": " << result.bytes / seconds / (1024.0 * 1024.0)
+            << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}\n";
+}
+
+
+static void
+usage(void)
+{
+    std::cerr
+        << "usage: trace_bench [options]\n"
+        << "\n"
+        << "    --calls=N    Number of calls in the synthetic trace [default: 200000]\n"
+        << "    --seed=N     Seed of the synthetic trace [default: 1]\n"
+        << "    --repeat=N   Report the fastest of N runs [default: 3]\n"
+        << "    --dir=PATH   Directory for the temporary trace files [default: .]\n";
+}
+
+
+int
+main(int argc, char **argv)
+{
+    unsigned numCalls = 200000;
+    uint64_t seed = 1;
+    os::String dir(".");
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--calls=", 8) == 0) {
+            numCalls = atoi(arg + 8);
+        } else if (strncmp(arg, "--seed=", 7) == 0) {
+            seed = strtoull(arg + 7, NULL, 0);
+        } else if (strncmp(arg, "--repeat=", 9) == 0) {
+            repeat = std::max(atoi(arg + 9), 1);
+        } else if (strncmp(arg, "--dir=", 6) == 0) {
+            dir = os::String(arg + 6);
+        } else {
+            usage();
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    // Encoded events, as written to the streams, with call lengths and
+    // deduplicated blobs so that skipping and resolving them is measured too
+    std::vector<Call *> synthCalls = makeCalls(numCalls, seed);
+
+    std::string data;
+    {
+        Writer writer;
+        writer.open(new MemoryStream(&data));
+        writer.setCallLengths(true);
+        writer.setDedupBlobs(true);
+        writeCalls(writer, synthCalls);
+    }
+
+    measure("writer_encode", numCalls, data.size(), [&]() {
+        Writer writer;
+        writer.open(new MemoryStream(NULL));
+        writeCalls(writer, synthCalls);
+    });
+    measure("writer_encode_call_lengths", numCalls, data.size(), [&]() {
+        Writer writer;
+        writer.open(new MemoryStream(NULL));
+        writer.setCallLengths(true);
+        writeCalls(writer, synthCalls);
+    });
+    measure("writer_encode_dedup_blobs", numCalls, data.size(), [&]() {
+        Writer writer;
+        writer.open(new MemoryStream(NULL));
+        writer.setDedupBlobs(true);
+        writeCalls(writer, synthCalls);
+    });
+
+    for (auto call : synthCalls) {
+        delete call;
+    }
+
+    struct Format {
+        const char *name;
+        OutStream *(*create)(const char *filename);
+    };
+    static const Format formats[] = {
+        {"snappy", [](const char *filename) { return createSnappyStream(filename); }},
+        {"zlib", [](const char *filename) { return createZLibStream(filename); }},
+#ifdef HAVE_ZSTD
+        {"zstd", [](const char *filename) { return createZstdStream(filename); }},
+#endif
+    };
+
+    std::vector<std::string> filenames;
+    for (auto &format : formats) {
+        os::String path(dir);
+        path.join(os::String::format("trace_bench.%s.trace", format.name));
+        std::string filename(path.str());
+        filenames.push_back(filename);
+
+        std::string name = std::string("ostream_") + format.name;
+        measure(name.c_str(), numCalls, data.size(), [&]() {
+            OutStream *stream = format.create(filename.c_str());
+            if (!stream) {
+                std::cerr << "error: failed to create " << filename << "\n";
+                exit(1);
+            }
+            writeStream(stream, data);
+        });
+
+        name = std::string("file_") + format.name;
+        measure(name.c_str(), numCalls, data.size(), [&]() {
+            unsigned long long bytes;
+            if (!readFile(filename.c_str(), bytes) || bytes != data.size()) {
+                std::cerr << "error: failed to read back " << filename << "\n";
+                exit(1);
+            }
+        });
+    }
+
+    const char *filename = filenames[0].c_str();
+    measure("parse_full", numCalls, data.size(), [&]() {
+        parseFile(filename, false, false);
+    });
+    measure("parse_scan", numCalls, data.size(), [&]() {
+        parseFile(filename, true, false);
+    });
+    measure("parse_skip", numCalls, data.size(), [&]() {
+        parseFile(filename, false, true);
+    });
+
+    {
+        std::vector<Call *> calls;
+        Parser parser;
+        parser.open(filename);
+        Call *call;
+        while ((call = parser.parse_call())) {
+            calls.push_back(call);
+        }
+
+        CountingBuf buf;
+        std::ostream os(&buf);
+        for (auto call : calls) {
+            dump(*call, os, DUMP_FLAG_NO_COLOR);
+        }
+
+        measure("dump", calls.size(), buf.count, [&]() {
+            for (auto call : calls) {
+                dump(*call, os, DUMP_FLAG_NO_COLOR);
+            }
+        });
+
+        for (auto call : calls) {
+            delete call;
+        }
+    }
+
+    for (auto &name : filenames) {
+        remove(name.c_str());
+    }
+
+    printResults();
+
+    return 0;
+}
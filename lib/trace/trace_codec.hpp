@@ -0,0 +1,118 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Compression of the individual chunks of chunked trace files.
+ *
+ * Snappy and Zstandard compressed traces share the same container (see
+ * trace_file_snappy.cpp), and only differ in the magic bytes and in how each
+ * chunk is compressed.
+ */
+
+#pragma once
+
+
+#include <stddef.h>
+
+
+namespace trace {
+
+
+class File;
+class OutStream;
+
+
+class ChunkCodec {
+public:
+    // Magic bytes at the start of the file
+    const unsigned char byte1;
+    const unsigned char byte2;
+
+    // Size of the uncompressed chunks written
+    const size_t chunkSize;
+
+    ChunkCodec(unsigned char _byte1, unsigned char _byte2, size_t _chunkSize) :
+        byte1(_byte1),
+        byte2(_byte2),
+        chunkSize(_chunkSize)
+    {}
+
+    virtual ~ChunkCodec() {}
+
+    /**
+     * Create another codec with the same settings, for compressing on
+     * another thread.
+     */
+    virtual ChunkCodec *clone(void) const = 0;
+
+    virtual size_t maxCompressedLength(size_t length) const = 0;
+
+    /**
+     * Compress a chunk, returning the compressed length, or zero on failure.
+     *
+     * Only called from one thread at a time.
+     */
+    virtual size_t compress(const char *src, size_t length, char *dst) = 0;
+
+    /*
+     * The following must be safe to call concurrently, as chunks are
+     * uncompressed by the read-ahead threads.
+     */
+
+    virtual bool getUncompressedLength(const char *src, size_t length,
+                                       size_t &uncompressedLength) const = 0;
+
+    /**
+     * Uncompress a chunk, returning the uncompressed length.  Truncated
+     * chunks are uncompressed as much as possible.
+     */
+    virtual size_t uncompress(const char *src, size_t length, bool truncated,
+                              char *dst, size_t dstLength) const = 0;
+};
+
+
+ChunkCodec *
+createSnappyCodec(void);
+
+#ifdef HAVE_ZSTD
+ChunkCodec *
+createZstdCodec(int level = 0);
+#endif
+
+
+/*
+ * Chunked files and streams, taking ownership of the codec.  See
+ * createSnappyStream for numThreads.
+ */
+
+File *
+createChunkedFile(ChunkCodec *codec);
+
+OutStream *
+createChunkedStream(const char *filename, ChunkCodec *codec,
+                    unsigned numThreads = 0);
+
+
+} /* namespace trace */
@@ -0,0 +1,83 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <snappy.h>
+#include <snappy-sinksource.h>
+
+#include "trace_codec.hpp"
+#include "trace_snappy.hpp"
+
+
+#define SNAPPY_CHUNK_SIZE (1 * 1024 * 1024)
+
+
+using namespace trace;
+
+
+class SnappyCodec : public ChunkCodec {
+public:
+    SnappyCodec() :
+        ChunkCodec(SNAPPY_BYTE1, SNAPPY_BYTE2, SNAPPY_CHUNK_SIZE)
+    {}
+
+    ChunkCodec *clone(void) const override {
+        return new SnappyCodec;
+    }
+
+    size_t maxCompressedLength(size_t length) const override {
+        return snappy::MaxCompressedLength(length);
+    }
+
+    size_t compress(const char *src, size_t length, char *dst) override {
+        size_t compressedLength;
+        snappy::RawCompress(src, length, dst, &compressedLength);
+        return compressedLength;
+    }
+
+    bool getUncompressedLength(const char *src, size_t length,
+                               size_t &uncompressedLength) const override {
+        return snappy::GetUncompressedLength(src, length, &uncompressedLength);
+    }
+
+    size_t uncompress(const char *src, size_t length, bool truncated,
+                      char *dst, size_t dstLength) const override {
+        if (truncated) {
+            snappy::ByteArraySource source(src, length);
+            snappy::UncheckedByteArraySink sink(dst);
+            return snappy::UncompressAsMuchAsPossible(&source, &sink);
+        }
+
+        snappy::RawUncompress(src, length, dst);
+        return dstLength;
+    }
+};
+
+
+ChunkCodec *
+trace::createSnappyCodec(void)
+{
+    return new SnappyCodec;
+}
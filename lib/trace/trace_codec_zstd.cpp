@@ -0,0 +1,146 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <zstd.h>
+
+#include "trace_codec.hpp"
+#include "trace_file.hpp"
+#include "trace_ostream.hpp"
+#include "trace_snappy.hpp"
+
+
+// Zstandard benefits from more context than Snappy, so use larger chunks
+#define ZSTD_CHUNK_SIZE (4 * 1024 * 1024)
+
+
+using namespace trace;
+
+
+class ZstdCodec : public ChunkCodec {
+private:
+    int m_level;
+    ZSTD_CCtx *m_cctx;
+
+public:
+    ZstdCodec(int level) :
+        ChunkCodec(ZSTD_BYTE1, ZSTD_BYTE2, ZSTD_CHUNK_SIZE),
+        m_level(level),
+        m_cctx(nullptr)
+    {}
+
+    ~ZstdCodec() {
+        ZSTD_freeCCtx(m_cctx);
+    }
+
+    ChunkCodec *clone(void) const override {
+        return new ZstdCodec(m_level);
+    }
+
+    size_t maxCompressedLength(size_t length) const override {
+        return ZSTD_compressBound(length);
+    }
+
+    size_t compress(const char *src, size_t length, char *dst) override {
+        // The context is created lazily, as it is not needed for reading
+        if (!m_cctx) {
+            m_cctx = ZSTD_createCCtx();
+            if (!m_cctx) {
+                return 0;
+            }
+            ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_compressionLevel, m_level);
+        }
+
+        size_t ret = ZSTD_compress2(m_cctx, dst, ZSTD_compressBound(length),
+                                    src, length);
+        if (ZSTD_isError(ret)) {
+            return 0;
+        }
+        return ret;
+    }
+
+    bool getUncompressedLength(const char *src, size_t length,
+                               size_t &uncompressedLength) const override {
+        unsigned long long contentSize = ZSTD_getFrameContentSize(src, length);
+        if (contentSize == ZSTD_CONTENTSIZE_UNKNOWN ||
+            contentSize == ZSTD_CONTENTSIZE_ERROR) {
+            return false;
+        }
+        uncompressedLength = contentSize;
+        return true;
+    }
+
+    size_t uncompress(const char *src, size_t length, bool truncated,
+                      char *dst, size_t dstLength) const override {
+        if (!truncated) {
+            size_t ret = ZSTD_decompress(dst, dstLength, src, length);
+            if (ZSTD_isError(ret)) {
+                return 0;
+            }
+            return ret;
+        }
+
+        // Stream through the frame, until the data runs out
+        ZSTD_DCtx *dctx = ZSTD_createDCtx();
+        if (!dctx) {
+            return 0;
+        }
+        ZSTD_inBuffer input = {src, length, 0};
+        ZSTD_outBuffer output = {dst, dstLength, 0};
+        while (input.pos < input.size && output.pos < output.size) {
+            size_t inputPos = input.pos;
+            size_t outputPos = output.pos;
+            size_t ret = ZSTD_decompressStream(dctx, &output, &input);
+            if (ZSTD_isError(ret) ||
+                ret == 0 ||
+                (input.pos == inputPos && output.pos == outputPos)) {
+                break;
+            }
+        }
+        ZSTD_freeDCtx(dctx);
+        return output.pos;
+    }
+};
+
+
+ChunkCodec *
+trace::createZstdCodec(int level)
+{
+    return new ZstdCodec(level);
+}
+
+
+File *
+File::createZstd(void)
+{
+    return createChunkedFile(createZstdCodec());
+}
+
+
+OutStream *
+trace::createZstdStream(const char *filename, int level, unsigned numThreads)
+{
+    return createChunkedStream(filename, createZstdCodec(level), numThreads);
+}
@@ -0,0 +1,893 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "trace_compiled.hpp"
+#include "trace_parser.hpp"
+
+
+// Size of the header and the trailer
+#define COMPILED_TRACE_HEADER_SIZE 32
+#define COMPILED_TRACE_TRAILER_SIZE 16
+
+// Offset of the API in the header
+#define COMPILED_TRACE_API_OFFSET 20
+
+
+namespace trace {
+
+
+template< class T >
+static inline void
+put(std::string &buf, T value) {
+    buf.append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+static inline void
+pad(std::string &buf) {
+    buf.resize((buf.size() + 7) & ~size_t(7), '\0');
+}
+
+static inline void
+putBytes(std::string &buf, const void *data, size_t size) {
+    buf.append(static_cast<const char *>(data), size);
+    pad(buf);
+}
+
+static inline void
+putHeader(std::string &buf, uint32_t kind, uint32_t aux) {
+    put<uint32_t>(buf, kind);
+    put<uint32_t>(buf, aux);
+}
+
+static inline void
+putString(std::string &buf, const char *s) {
+    if (!s) {
+        s = "";
+    }
+    size_t len = strlen(s);
+    assert(len <= UINT32_MAX);
+    putHeader(buf, len, 0);
+    putBytes(buf, s, len + 1);
+}
+
+
+template< class Sig >
+static inline void
+addSig(std::vector<const Sig *> &sigs, const Sig *sig) {
+    if (sig->id >= sigs.size()) {
+        sigs.resize(sig->id + 1);
+    }
+    sigs[sig->id] = sig;
+}
+
+
+class CompiledWriter::Encoder : public Visitor
+{
+    CompiledWriter &writer;
+    std::string &buf;
+
+public:
+    Encoder(CompiledWriter &_writer) :
+        writer(_writer),
+        buf(_writer.buffer)
+    {}
+
+    void encode(Value *value) {
+        if (value) {
+            value->visit(*this);
+        } else {
+            putHeader(buf, COMPILED_NONE, 0);
+        }
+    }
+
+    void visit(Null *) override {
+        putHeader(buf, COMPILED_NULL, 0);
+    }
+
+    void visit(Bool *node) override {
+        putHeader(buf, node->value ? COMPILED_TRUE : COMPILED_FALSE, 0);
+    }
+
+    void visit(SInt *node) override {
+        putHeader(buf, COMPILED_SINT, 0);
+        put<int64_t>(buf, node->value);
+    }
+
+    void visit(UInt *node) override {
+        putHeader(buf, COMPILED_UINT, 0);
+        put<uint64_t>(buf, node->value);
+    }
+
+    void visit(Float *node) override {
+        uint32_t bits;
+        static_assert(sizeof bits == sizeof node->value, "unexpected float size");
+        memcpy(&bits, &node->value, sizeof bits);
+        putHeader(buf, COMPILED_FLOAT, bits);
+    }
+
+    void visit(Double *node) override {
+        putHeader(buf, COMPILED_DOUBLE, 0);
+        put<double>(buf, node->value);
+    }
+
+    void visit(String *node) override {
+        const char *s = node->value ? node->value : "";
+        size_t len = strlen(s);
+        assert(len <= UINT32_MAX);
+        putHeader(buf, COMPILED_STRING, len);
+        putBytes(buf, s, len + 1);
+    }
+
+    void visit(WString *node) override {
+        const wchar_t *s = node->value ? node->value : L"";
+        size_t len = wcslen(s);
+        assert(len <= UINT32_MAX);
+        putHeader(buf, COMPILED_WSTRING, len);
+        putBytes(buf, s, (len + 1) * sizeof *s);
+    }
+
+    void visit(Enum *node) override {
+        addSig(writer.enumSigs, node->sig);
+        putHeader(buf, COMPILED_ENUM, node->sig->id);
+        put<int64_t>(buf, node->value);
+    }
+
+    void visit(Bitmask *node) override {
+        addSig(writer.bitmaskSigs, node->sig);
+        putHeader(buf, COMPILED_BITMASK, node->sig->id);
+        put<uint64_t>(buf, node->value);
+    }
+
+    void visit(Struct *node) override {
+        addSig(writer.structSigs, node->sig);
+        putHeader(buf, COMPILED_STRUCT, node->sig->id);
+        for (auto & member : node->members) {
+            encode(member);
+        }
+    }
+
+    void visit(Array *node) override {
+        assert(node->size() <= UINT32_MAX);
+        putHeader(buf, COMPILED_ARRAY, node->size());
+        for (auto & value : node->values) {
+            encode(value);
+        }
+    }
+
+    void visit(Blob *node) override {
+        putHeader(buf, COMPILED_BLOB, 0);
+        put<uint64_t>(buf, node->size);
+        putBytes(buf, node->buf, node->size);
+    }
+
+    void visit(Pointer *node) override {
+        putHeader(buf, COMPILED_POINTER, 0);
+        put<uint64_t>(buf, node->value);
+    }
+
+    void visit(Repr *node) override {
+        putHeader(buf, COMPILED_REPR, 0);
+        encode(node->humanValue);
+        encode(node->machineValue);
+    }
+};
+
+
+CompiledWriter::CompiledWriter()
+{
+}
+
+
+CompiledWriter::~CompiledWriter()
+{
+    if (stream.is_open()) {
+        close(API_UNKNOWN);
+    }
+}
+
+
+bool CompiledWriter::open(const char *filename, unsigned long long traceVersion) {
+    stream.open(filename, std::ofstream::binary);
+    if (!stream) {
+        return false;
+    }
+
+    buffer.clear();
+    buffer.append(COMPILED_TRACE_MAGIC, 8);
+    put<uint32_t>(buffer, COMPILED_TRACE_VERSION);
+    put<uint32_t>(buffer, COMPILED_TRACE_BYTE_ORDER);
+    put<uint32_t>(buffer, sizeof(wchar_t));
+    put<uint32_t>(buffer, API_UNKNOWN);
+    put<uint64_t>(buffer, traceVersion);
+    assert(buffer.size() == COMPILED_TRACE_HEADER_SIZE);
+    stream.write(buffer.data(), buffer.size());
+    return true;
+}
+
+
+void CompiledWriter::writeCall(const Call *call) {
+    addSig(functionSigs, call->sig);
+
+    buffer.clear();
+    put<uint32_t>(buffer, call->sig->id);
+    put<uint32_t>(buffer, call->thread_id);
+    put<uint32_t>(buffer, call->no);
+    put<uint32_t>(buffer, call->flags);
+    put<uint32_t>(buffer, call->args.size());
+    put<uint32_t>(buffer, call->ret != nullptr);
+
+    Encoder encoder(*this);
+    for (auto & arg : call->args) {
+        encoder.encode(arg.value);
+    }
+    if (call->ret) {
+        encoder.encode(call->ret);
+    }
+
+    stream.write(buffer.data(), buffer.size());
+}
+
+
+void CompiledWriter::writeSignatures(void) {
+    uint64_t count =
+        functionSigs.size() - std::count(functionSigs.begin(), functionSigs.end(), nullptr) +
+        structSigs.size() - std::count(structSigs.begin(), structSigs.end(), nullptr) +
+        enumSigs.size() - std::count(enumSigs.begin(), enumSigs.end(), nullptr) +
+        bitmaskSigs.size() - std::count(bitmaskSigs.begin(), bitmaskSigs.end(), nullptr);
+
+    buffer.clear();
+    put<uint64_t>(buffer, count);
+
+    for (auto sig : functionSigs) {
+        if (sig) {
+            putHeader(buffer, COMPILED_SIG_FUNCTION, sig->id);
+            putHeader(buffer, sig->num_args, 0);
+            putString(buffer, sig->name);
+            for (unsigned i = 0; i < sig->num_args; ++i) {
+                putString(buffer, sig->arg_names[i]);
+            }
+        }
+    }
+
+    for (auto sig : structSigs) {
+        if (sig) {
+            putHeader(buffer, COMPILED_SIG_STRUCT, sig->id);
+            putHeader(buffer, sig->num_members, 0);
+            putString(buffer, sig->name);
+            for (unsigned i = 0; i < sig->num_members; ++i) {
+                putString(buffer, sig->member_names[i]);
+            }
+        }
+    }
+
+    for (auto sig : enumSigs) {
+        if (sig) {
+            putHeader(buffer, COMPILED_SIG_ENUM, sig->id);
+            putHeader(buffer, sig->num_values, 0);
+            for (unsigned i = 0; i < sig->num_values; ++i) {
+                putString(buffer, sig->values[i].name);
+                put<int64_t>(buffer, sig->values[i].value);
+            }
+        }
+    }
+
+    for (auto sig : bitmaskSigs) {
+        if (sig) {
+            putHeader(buffer, COMPILED_SIG_BITMASK, sig->id);
+            putHeader(buffer, sig->num_flags, 0);
+            for (unsigned i = 0; i < sig->num_flags; ++i) {
+                putString(buffer, sig->flags[i].name);
+                put<uint64_t>(buffer, sig->flags[i].value);
+            }
+        }
+    }
+
+    stream.write(buffer.data(), buffer.size());
+}
+
+
+bool CompiledWriter::close(API api) {
+    uint64_t offset = stream.tellp();
+    writeSignatures();
+
+    buffer.clear();
+    put<uint64_t>(buffer, offset);
+    buffer.append(COMPILED_TRACE_MAGIC, 8);
+    assert(buffer.size() == COMPILED_TRACE_TRAILER_SIZE);
+    stream.write(buffer.data(), buffer.size());
+
+    // The API is only known once calls were parsed
+    uint32_t value = api;
+    stream.seekp(COMPILED_TRACE_API_OFFSET);
+    stream.write(reinterpret_cast<const char *>(&value), sizeof value);
+
+    stream.close();
+    return !stream.fail();
+}
+
+
+/*
+ * Bounds checked reads from memory.
+ */
+class CompiledReader
+{
+public:
+    const char *ptr;
+    const char *end;
+    bool ok;
+
+    CompiledReader(const char *_ptr, const char *_end) :
+        ptr(_ptr),
+        end(_end),
+        ok(true)
+    {}
+
+    template< class T >
+    inline T
+    read(void) {
+        T value = T();
+        if (size_t(end - ptr) < sizeof value) {
+            fail();
+            return value;
+        }
+        memcpy(&value, ptr, sizeof value);
+        ptr += sizeof value;
+        return value;
+    }
+
+    // Skip over the given number of bytes and their padding
+    inline const char *
+    skip(uint64_t size) {
+        uint64_t padded = (size + 7) & ~uint64_t(7);
+        if (padded < size || uint64_t(end - ptr) < padded) {
+            fail();
+            return nullptr;
+        }
+        const char *data = ptr;
+        ptr += padded;
+        return data;
+    }
+
+    inline const char *
+    readString(void) {
+        uint32_t len = read<uint32_t>();
+        read<uint32_t>();
+        const char *s = skip(uint64_t(len) + 1);
+        if (s && s[len] != '\0') {
+            fail();
+            return nullptr;
+        }
+        return s;
+    }
+
+    inline void
+    fail(void) {
+        ok = false;
+        ptr = end;
+    }
+};
+
+
+/*
+ * Replays compiled traces from memory.
+ *
+ * Strings and blobs refer to the file's contents, which are mapped rather
+ * than read when possible, and kept alive for as long as any value refers to
+ * them.
+ */
+class CompiledParser : public AbstractParser
+{
+public:
+    CompiledParser() :
+        begin(nullptr),
+        callsBegin(nullptr),
+        callsEnd(nullptr),
+        ptr(nullptr),
+        version(0),
+        nextCallNo(0)
+    {}
+
+    ~CompiledParser() {
+        close();
+    }
+
+    bool open(const char *filename) override;
+    void close(void) override;
+
+    Call *parse_call(void) override;
+
+    void getBookmark(ParseBookmark &bookmark) override;
+    void setBookmark(const ParseBookmark &bookmark) override;
+
+    unsigned long long getVersion(void) const override {
+        return version;
+    }
+
+private:
+    std::shared_ptr<void> data;
+    const char *begin;
+    const char *callsBegin;
+    const char *callsEnd;
+    const char *ptr;
+
+    unsigned long long version;
+    CallNo nextCallNo;
+
+    std::vector<std::unique_ptr<FunctionSig>> functionSigs;
+    std::vector<std::unique_ptr<StructSig>> structSigs;
+    std::vector<std::unique_ptr<EnumSig>> enumSigs;
+    std::vector<std::unique_ptr<BitmaskSig>> bitmaskSigs;
+
+    // Arrays the signatures above point to
+    std::vector<std::unique_ptr<const char *[]>> nameArrays;
+    std::vector<std::unique_ptr<EnumValue[]>> enumValueArrays;
+    std::vector<std::unique_ptr<BitmaskFlag[]>> bitmaskFlagArrays;
+
+    bool load(const char *filename, size_t &size);
+    bool readSignatures(CompiledReader &reader);
+
+    const char **readNames(CompiledReader &reader, unsigned count);
+
+    template< class Sig >
+    static inline Sig *
+    lookup(const std::vector<std::unique_ptr<Sig>> &sigs, uint32_t id) {
+        return id < sigs.size() ? sigs[id].get() : nullptr;
+    }
+
+    template< class Sig >
+    static inline Sig *
+    insert(std::vector<std::unique_ptr<Sig>> &sigs, uint32_t id) {
+        if (id >= sigs.size()) {
+            sigs.resize(id + 1);
+        }
+        sigs[id].reset(new Sig());
+        sigs[id]->id = id;
+        return sigs[id].get();
+    }
+
+    template< class T, class... Args >
+    static inline T *
+    newScalar(Arena &arena, Arg *arg, Args&&... args) {
+        if (arg) {
+            return arg->emplace<T>(std::forward<Args>(args)...);
+        }
+        return arena.create<T>(std::forward<Args>(args)...);
+    }
+
+    Value *decodeValue(CompiledReader &reader, Arena &arena, Arg *arg = nullptr);
+};
+
+
+/*
+ * Map the whole file, or read it when it can't be mapped.
+ */
+bool CompiledParser::load(const char *filename, size_t &size) {
+#ifndef _WIN32
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 &&
+        S_ISREG(st.st_mode) &&
+        st.st_size > 0 &&
+        uint64_t(st.st_size) == size_t(st.st_size)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+
+    if (map != MAP_FAILED) {
+        size = st.st_size;
+        data.reset(map, [size](void *p) { munmap(p, size); });
+        return true;
+    }
+#endif
+
+    std::ifstream stream(filename, std::ifstream::binary);
+    if (!stream) {
+        return false;
+    }
+    stream.seekg(0, std::ios::end);
+    std::streamoff length = stream.tellg();
+    stream.seekg(0, std::ios::beg);
+    if (length <= 0 || uint64_t(length) != size_t(length)) {
+        return false;
+    }
+
+    size = length;
+    char *buf = new char[size];
+    data.reset(buf, [](void *p) { delete [] static_cast<char *>(p); });
+    stream.read(buf, size);
+    return bool(stream);
+}
+
+
+bool CompiledParser::open(const char *filename) {
+    close();
+
+    size_t size = 0;
+    if (!load(filename, size)) {
+        std::cerr << "error: failed to open " << filename << "\n";
+        return false;
+    }
+    begin = static_cast<const char *>(data.get());
+
+    if (size < COMPILED_TRACE_HEADER_SIZE + COMPILED_TRACE_TRAILER_SIZE ||
+        memcmp(begin, COMPILED_TRACE_MAGIC, 8) != 0 ||
+        memcmp(begin + size - 8, COMPILED_TRACE_MAGIC, 8) != 0) {
+        std::cerr << "error: " << filename << " is not a compiled trace, or is truncated\n";
+        close();
+        return false;
+    }
+
+    CompiledReader header(begin + 8, begin + COMPILED_TRACE_HEADER_SIZE);
+    uint32_t compiledVersion = header.read<uint32_t>();
+    uint32_t byteOrder = header.read<uint32_t>();
+    uint32_t wcharSize = header.read<uint32_t>();
+    header.read<uint32_t>(); // API, see isCompiledTrace()
+    version = header.read<uint64_t>();
+    if (compiledVersion != COMPILED_TRACE_VERSION) {
+        std::cerr << "error: unsupported compiled trace version " << compiledVersion << "\n";
+        close();
+        return false;
+    }
+    if (byteOrder != COMPILED_TRACE_BYTE_ORDER || wcharSize != sizeof(wchar_t)) {
+        std::cerr << "error: " << filename << " was compiled on a different kind of machine\n";
+        close();
+        return false;
+    }
+
+    const char *trailer = begin + size - COMPILED_TRACE_TRAILER_SIZE;
+    uint64_t signaturesOffset;
+    memcpy(&signaturesOffset, trailer, sizeof signaturesOffset);
+    if (signaturesOffset < COMPILED_TRACE_HEADER_SIZE ||
+        signaturesOffset > uint64_t(trailer - begin)) {
+        std::cerr << "error: " << filename << " is corrupt\n";
+        close();
+        return false;
+    }
+
+    CompiledReader reader(begin + signaturesOffset, trailer);
+    if (!readSignatures(reader)) {
+        std::cerr << "error: " << filename << " is corrupt\n";
+        close();
+        return false;
+    }
+
+    callsBegin = begin + COMPILED_TRACE_HEADER_SIZE;
+    callsEnd = begin + signaturesOffset;
+    ptr = callsBegin;
+    nextCallNo = 0;
+    return true;
+}
+
+
+void CompiledParser::close(void) {
+    functionSigs.clear();
+    structSigs.clear();
+    enumSigs.clear();
+    bitmaskSigs.clear();
+    nameArrays.clear();
+    enumValueArrays.clear();
+    bitmaskFlagArrays.clear();
+
+    // Calls still alive keep the data alive
+    data.reset();
+    begin = callsBegin = callsEnd = ptr = nullptr;
+    version = 0;
+}
+
+
+const char **CompiledParser::readNames(CompiledReader &reader, unsigned count) {
+    const char **names = new const char *[count];
+    nameArrays.emplace_back(names);
+    for (unsigned i = 0; i < count; ++i) {
+        names[i] = reader.readString();
+    }
+    return names;
+}
+
+
+bool CompiledParser::readSignatures(CompiledReader &reader) {
+    uint64_t count = reader.read<uint64_t>();
+    for (uint64_t i = 0; i < count && reader.ok; ++i) {
+        uint32_t kind = reader.read<uint32_t>();
+        uint32_t id = reader.read<uint32_t>();
+        uint32_t num = reader.read<uint32_t>();
+        reader.read<uint32_t>();
+        if (!reader.ok ||
+            num > uint64_t(reader.end - reader.ptr) / 8) {
+            return false;
+        }
+
+        switch (kind) {
+        case COMPILED_SIG_FUNCTION:
+            {
+                FunctionSig *sig = insert(functionSigs, id);
+                sig->name = reader.readString();
+                sig->num_args = num;
+                sig->arg_names = readNames(reader, num);
+            }
+            break;
+        case COMPILED_SIG_STRUCT:
+            {
+                StructSig *sig = insert(structSigs, id);
+                sig->name = reader.readString();
+                sig->num_members = num;
+                sig->member_names = readNames(reader, num);
+            }
+            break;
+        case COMPILED_SIG_ENUM:
+            {
+                EnumSig *sig = insert(enumSigs, id);
+                EnumValue *values = new EnumValue[num];
+                enumValueArrays.emplace_back(values);
+                for (unsigned j = 0; j < num; ++j) {
+                    values[j].name = reader.readString();
+                    values[j].value = reader.read<int64_t>();
+                }
+                sig->num_values = num;
+                sig->values = values;
+            }
+            break;
+        case COMPILED_SIG_BITMASK:
+            {
+                BitmaskSig *sig = insert(bitmaskSigs, id);
+                BitmaskFlag *flags = new BitmaskFlag[num];
+                bitmaskFlagArrays.emplace_back(flags);
+                for (unsigned j = 0; j < num; ++j) {
+                    flags[j].name = reader.readString();
+                    flags[j].value = reader.read<uint64_t>();
+                }
+                sig->num_flags = num;
+                sig->flags = flags;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return reader.ok;
+}
+
+
+Value *CompiledParser::decodeValue(CompiledReader &reader, Arena &arena, Arg *arg) {
+    uint32_t kind = reader.read<uint32_t>();
+    uint32_t aux = reader.read<uint32_t>();
+    if (!reader.ok) {
+        return nullptr;
+    }
+
+    switch (kind) {
+    case COMPILED_NONE:
+        return nullptr;
+    case COMPILED_NULL:
+        return newScalar<Null>(arena, arg);
+    case COMPILED_FALSE:
+        return newScalar<Bool>(arena, arg, false);
+    case COMPILED_TRUE:
+        return newScalar<Bool>(arena, arg, true);
+    case COMPILED_SINT:
+        return newScalar<SInt>(arena, arg, reader.read<int64_t>());
+    case COMPILED_UINT:
+        return newScalar<UInt>(arena, arg, reader.read<uint64_t>());
+    case COMPILED_FLOAT:
+        {
+            float value;
+            memcpy(&value, &aux, sizeof value);
+            return newScalar<Float>(arena, arg, value);
+        }
+    case COMPILED_DOUBLE:
+        return newScalar<Double>(arena, arg, reader.read<double>());
+    case COMPILED_STRING:
+        {
+            const char *value = reader.skip(uint64_t(aux) + 1);
+            if (!value || value[aux] != '\0') {
+                reader.fail();
+                return nullptr;
+            }
+            return arena.create<String>(value, data);
+        }
+    case COMPILED_WSTRING:
+        {
+            size_t size = (size_t(aux) + 1) * sizeof(wchar_t);
+            const char *value = reader.skip(size);
+            if (!value) {
+                return nullptr;
+            }
+            // Wide strings are only ever owned, by the arena here
+            wchar_t *copy = static_cast<wchar_t *>(arena.allocate(size));
+            memcpy(copy, value, size);
+            copy[aux] = L'\0';
+            return arena.create<WString>(copy);
+        }
+    case COMPILED_ENUM:
+        {
+            const EnumSig *sig = lookup(enumSigs, aux);
+            signed long long value = reader.read<int64_t>();
+            if (!sig) {
+                reader.fail();
+                return nullptr;
+            }
+            return newScalar<Enum>(arena, arg, sig, value);
+        }
+    case COMPILED_BITMASK:
+        {
+            const BitmaskSig *sig = lookup(bitmaskSigs, aux);
+            unsigned long long value = reader.read<uint64_t>();
+            if (!sig) {
+                reader.fail();
+                return nullptr;
+            }
+            return newScalar<Bitmask>(arena, arg, sig, value);
+        }
+    case COMPILED_POINTER:
+        return newScalar<Pointer>(arena, arg, reader.read<uint64_t>());
+    case COMPILED_BLOB:
+        {
+            uint64_t size = reader.read<uint64_t>();
+            const char *buf = reader.skip(size);
+            if (!buf) {
+                return nullptr;
+            }
+            return arena.create<Blob>(size, buf, data);
+        }
+    case COMPILED_STRUCT:
+        {
+            StructSig *sig = lookup(structSigs, aux);
+            if (!sig) {
+                reader.fail();
+                return nullptr;
+            }
+            Struct *value = arena.create<Struct>(sig);
+            for (auto & member : value->members) {
+                member = decodeValue(reader, arena);
+            }
+            return value;
+        }
+    case COMPILED_ARRAY:
+        {
+            // Every element takes at least 8 bytes
+            if (aux > uint64_t(reader.end - reader.ptr) / 8) {
+                reader.fail();
+                return nullptr;
+            }
+            Array *value = arena.create<Array>(aux);
+            for (auto & element : value->values) {
+                element = decodeValue(reader, arena);
+            }
+            return value;
+        }
+    case COMPILED_REPR:
+        {
+            Value *humanValue = decodeValue(reader, arena);
+            Value *machineValue = decodeValue(reader, arena);
+            return arena.create<Repr>(humanValue, machineValue);
+        }
+    default:
+        reader.fail();
+        return nullptr;
+    }
+}
+
+
+Call *CompiledParser::parse_call(void) {
+    if (ptr >= callsEnd) {
+        return nullptr;
+    }
+
+    CompiledReader reader(ptr, callsEnd);
+    uint32_t id = reader.read<uint32_t>();
+    uint32_t thread_id = reader.read<uint32_t>();
+    uint32_t no = reader.read<uint32_t>();
+    uint32_t flags = reader.read<uint32_t>();
+    uint32_t num_args = reader.read<uint32_t>();
+    uint32_t has_ret = reader.read<uint32_t>();
+    const FunctionSig *sig = lookup(functionSigs, id);
+    if (!reader.ok || !sig || num_args != sig->num_args) {
+        std::cerr << "error: compiled trace is corrupt\n";
+        ptr = callsEnd;
+        return nullptr;
+    }
+
+    Call *call = new Call(sig, flags, thread_id);
+    call->no = no;
+    for (auto & arg : call->args) {
+        arg.value = decodeValue(reader, call->arena, &arg);
+    }
+    if (has_ret) {
+        call->ret = decodeValue(reader, call->arena);
+    }
+
+    if (!reader.ok) {
+        std::cerr << "error: compiled trace is corrupt\n";
+        delete call;
+        ptr = callsEnd;
+        return nullptr;
+    }
+
+    ptr = reader.ptr;
+    nextCallNo = no + 1;
+    return call;
+}
+
+
+void CompiledParser::getBookmark(ParseBookmark &bookmark) {
+    bookmark.offset = File::Offset(ptr - begin);
+    bookmark.next_call_no = nextCallNo;
+}
+
+
+void CompiledParser::setBookmark(const ParseBookmark &bookmark) {
+    assert(bookmark.offset.chunk >= uint64_t(callsBegin - begin));
+    assert(bookmark.offset.chunk <= uint64_t(callsEnd - begin));
+    ptr = begin + bookmark.offset.chunk;
+    nextCallNo = bookmark.next_call_no;
+}
+
+
+bool
+isCompiledTrace(const char *filename, API *api) {
+    std::ifstream stream(filename, std::ifstream::binary);
+    char header[COMPILED_TRACE_HEADER_SIZE];
+    if (!stream.read(header, sizeof header) ||
+        memcmp(header, COMPILED_TRACE_MAGIC, 8) != 0) {
+        return false;
+    }
+    if (api) {
+        uint32_t value;
+        memcpy(&value, header + COMPILED_TRACE_API_OFFSET, sizeof value);
+        *api = static_cast<API>(value);
+    }
+    return true;
+}
+
+
+AbstractParser *
+compiledParser(void) {
+    return new CompiledParser;
+}
+
+
+} /* namespace trace */
@@ -0,0 +1,135 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Compiled traces: calls lowered into a flat stream which can be replayed
+ * straight from memory, without decompressing or parsing.
+ *
+ * Values are stored in their native form, and are still decoded into the
+ * trace::Value model when replayed, as that is what the retracers take, so
+ * only decompressing and parsing the original format is saved.  Strings and
+ * blobs are stored in place, so that replaying refers to them rather than
+ * copy them.
+ * All fields are in the host's byte order and padded to 8 bytes, and
+ * compiled traces are only meant to be replayed on the kind of machine they
+ * were compiled on.
+ *
+ *   file:     header call... signatures trailer
+ *   header:   "APITRCMP" u32 version, u32 0x01020304, u32 sizeof(wchar_t),
+ *             u32 API, u64 version of the original trace
+ *   call:     u32 function, u32 thread, u32 no, u32 flags, u32 num_args,
+ *             u32 has_ret, value... (arguments, then return value)
+ *   value:    u32 kind, u32 aux, payload (see CompiledKind)
+ *   signatures: u64 count, then for each u32 kind, u32 id, u32 count, u32 0,
+ *             and the name, members, enum values or bitmask flags
+ *   string:   u32 length, u32 0, characters and terminating zero
+ *   trailer:  u64 offset of the signatures, "APITRCMP"
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "trace_api.hpp"
+#include "trace_model.hpp"
+
+
+#define COMPILED_TRACE_MAGIC "APITRCMP"
+#define COMPILED_TRACE_VERSION 2
+#define COMPILED_TRACE_BYTE_ORDER 0x01020304
+
+
+namespace trace {
+
+
+enum CompiledKind {
+    COMPILED_NONE = 0,      // missing argument
+    COMPILED_NULL,
+    COMPILED_FALSE,
+    COMPILED_TRUE,
+    COMPILED_SINT,          // i64
+    COMPILED_UINT,          // u64
+    COMPILED_FLOAT,         // aux: bits
+    COMPILED_DOUBLE,        // f64
+    COMPILED_STRING,        // aux: length; characters
+    COMPILED_WSTRING,       // aux: length; wide characters
+    COMPILED_ENUM,          // aux: signature; i64
+    COMPILED_BITMASK,       // aux: signature; u64
+    COMPILED_POINTER,       // u64
+    COMPILED_BLOB,          // u64 size; data
+    COMPILED_STRUCT,        // aux: signature; member values
+    COMPILED_ARRAY,         // aux: length; element values
+    COMPILED_REPR,          // human value, machine value
+};
+
+
+enum CompiledSigKind {
+    COMPILED_SIG_FUNCTION = 1,
+    COMPILED_SIG_STRUCT,
+    COMPILED_SIG_ENUM,
+    COMPILED_SIG_BITMASK,
+};
+
+
+/**
+ * Writes calls as a compiled trace.
+ *
+ * The signatures are only written when closing, so the calls written must
+ * not outlive the parser they came from until then.
+ */
+class CompiledWriter
+{
+public:
+    CompiledWriter();
+    ~CompiledWriter();
+
+    bool open(const char *filename, unsigned long long traceVersion);
+
+    void writeCall(const Call *call);
+
+    // Returns whether everything was written successfully
+    bool close(API api);
+
+private:
+    class Encoder;
+
+    std::ofstream stream;
+    std::string buffer;
+
+    std::vector<const FunctionSig *> functionSigs;
+    std::vector<const StructSig *> structSigs;
+    std::vector<const EnumSig *> enumSigs;
+    std::vector<const BitmaskSig *> bitmaskSigs;
+
+    void writeSignatures(void);
+};
+
+
+} /* namespace trace */
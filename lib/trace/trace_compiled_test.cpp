@@ -0,0 +1,285 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Traces are written, compiled, and then parsed back by both parsers, which
+ * must yield the same calls.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "trace_compiled.hpp"
+#include "trace_dump.hpp"
+#include "trace_parser.hpp"
+#include "trace_synth.hpp"
+#include "trace_writer.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace trace;
+
+
+static const char *filename = "trace_compiled_test.trace";
+static const char *compiledFilename = "trace_compiled_test.ctrace";
+
+
+static const char *pointArgs[] = {"x", "y"};
+static const StructSig pointSig = {0, "Point", 2, pointArgs};
+
+static const char *fooArgs[] = {"s", "w", "point", "array", "repr", "null", "b", "d", "missing"};
+static const FunctionSig fooSig = {100, "glFoo", 9, fooArgs};
+
+
+static char *
+copyString(const char *s)
+{
+    char *copy = new char[strlen(s) + 1];
+    strcpy(copy, s);
+    return copy;
+}
+
+
+/*
+ * A call with the kinds of values synthesized calls lack.
+ */
+static Call *
+newFooCall(void)
+{
+    Call *call = new Call(&fooSig, 0, 1);
+    call->args[0].value = new String(copyString("text"));
+
+    wchar_t *w = new wchar_t[5];
+    wcscpy(w, L"wide");
+    call->args[1].value = new WString(w);
+
+    Struct *point = new Struct(const_cast<StructSig *>(&pointSig));
+    point->members[0] = new SInt(-1);
+    point->members[1] = new Float(0.5f);
+    call->args[2].value = point;
+
+    // Mixed, and nested, elements
+    Array *array = new Array(3);
+    array->values[0] = new UInt(1);
+    array->values[1] = new Double(-2.25);
+    Array *inner = new Array(2);
+    inner->values[0] = new SInt(3);
+    inner->values[1] = new SInt(-4);
+    array->values[2] = inner;
+    call->args[3].value = array;
+
+    call->args[4].value = new Repr(new String(copyString("GL_FOO")), new UInt(0x1234));
+    call->args[5].value = new Null;
+    call->args[6].value = new Bool(true);
+    call->args[7].value = new Double(1e100);
+    call->ret = new Pointer(0xdeadbeef);
+    return call;
+}
+
+
+/*
+ * Describe the call in a single line, followed by a hash of the contents
+ * of its blobs, which dumping omits.
+ */
+static std::string
+describe(Call *call)
+{
+    std::ostringstream os;
+    dump(*call, os, DUMP_FLAG_NO_COLOR | DUMP_FLAG_NO_MULTILINE);
+    for (auto &arg : call->args) {
+        const Blob *blob = arg.value ? arg.value->toBlob() : NULL;
+        if (blob) {
+            os << " // " << std::hash<std::string>()(std::string(blob->buf, blob->size));
+        }
+    }
+    return os.str();
+}
+
+
+/*
+ * Write the calls as a trace, then compile it, returning the description of
+ * each call as parsed from the trace.
+ */
+static std::vector<std::string>
+writeAndCompile(const std::vector<Call *> &calls)
+{
+    {
+        Writer writer;
+        EXPECT_TRUE(writer.open(filename));
+        for (auto call : calls) {
+            writer.writeCall(call);
+        }
+    }
+
+    std::vector<std::string> descriptions;
+
+    // Signatures belong to the parser, and are only written when closing
+    Parser parser;
+    EXPECT_TRUE(parser.open(filename));
+    CompiledWriter compiledWriter;
+    EXPECT_TRUE(compiledWriter.open(compiledFilename, parser.getVersion()));
+    std::vector<std::unique_ptr<Call>> parsed;
+    Call *call;
+    while ((call = parser.parse_call())) {
+        compiledWriter.writeCall(call);
+        descriptions.push_back(describe(call));
+        parsed.emplace_back(call);
+    }
+    EXPECT_TRUE(compiledWriter.close(API_GL));
+
+    return descriptions;
+}
+
+
+static std::vector<std::string>
+parseCompiled(const char *path)
+{
+    std::vector<std::string> descriptions;
+    std::unique_ptr<AbstractParser> parser(compiledParser());
+    if (!parser->open(path)) {
+        return descriptions;
+    }
+    Call *call;
+    while ((call = parser->parse_call())) {
+        descriptions.push_back(describe(call));
+        delete call;
+    }
+    return descriptions;
+}
+
+
+static std::string
+readFile(const char *path)
+{
+    std::ifstream stream(path, std::ifstream::binary);
+    std::ostringstream os;
+    os << stream.rdbuf();
+    return os.str();
+}
+
+
+static void
+writeFile(const char *path, const std::string &data)
+{
+    std::ofstream stream(path, std::ofstream::binary);
+    stream.write(data.data(), data.size());
+}
+
+
+TEST(trace_compiled, parity)
+{
+    SynthOptions options;
+    options.calls = 5000;
+    options.frames = 10;
+    options.threads = 2;
+    std::unique_ptr<Synthesizer> synthesizer(createSynthesizer(options));
+    std::vector<Call *> calls;
+    for (unsigned long long no = 0; no < options.calls; ++no) {
+        calls.push_back(synthesizer->call(no));
+    }
+    calls.push_back(newFooCall());
+    calls.back()->no = options.calls;
+
+    std::vector<std::string> expected = writeAndCompile(calls);
+    ASSERT_EQ(calls.size(), expected.size());
+
+    API api = API_UNKNOWN;
+    EXPECT_TRUE(isCompiledTrace(compiledFilename, &api));
+    EXPECT_EQ(API_GL, api);
+    EXPECT_FALSE(isCompiledTrace(filename));
+
+    std::vector<std::string> actual = parseCompiled(compiledFilename);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(expected[i], actual[i]) << "call " << i;
+    }
+
+    // The normal parser refuses compiled traces
+    Parser parser;
+    EXPECT_FALSE(parser.open(compiledFilename));
+
+    for (auto call : calls) {
+        delete call;
+    }
+    remove(filename);
+    remove(compiledFilename);
+}
+
+
+TEST(trace_compiled, truncated)
+{
+    std::vector<Call *> calls;
+    for (unsigned no = 0; no < 10; ++no) {
+        calls.push_back(newFooCall());
+        calls.back()->no = no;
+    }
+    writeAndCompile(calls);
+    for (auto call : calls) {
+        delete call;
+    }
+
+    std::string data = readFile(compiledFilename);
+    ASSERT_FALSE(data.empty());
+
+    // Cut anywhere, the trailer is missing, so the file is refused
+    // altogether rather than parsed partially
+    const char *truncatedFilename = "trace_compiled_test_truncated.ctrace";
+    for (size_t size : {size_t(0), size_t(8), size_t(32), data.size() / 2, data.size() - 16, data.size() - 1}) {
+        SCOPED_TRACE(size);
+        writeFile(truncatedFilename, data.substr(0, size));
+        std::unique_ptr<AbstractParser> parser(compiledParser());
+        EXPECT_FALSE(parser->open(truncatedFilename));
+    }
+
+    // Calls cut short by a corrupt length stop parsing, without reading
+    // past the calls
+    std::string corrupt = data;
+    size_t lengthOffset = 32 + 24 + 4;  // first call's first string length
+    uint32_t length = 0xffffff00;
+    memcpy(&corrupt[lengthOffset], &length, sizeof length);
+    writeFile(truncatedFilename, corrupt);
+    EXPECT_TRUE(parseCompiled(truncatedFilename).empty());
+
+    remove(truncatedFilename);
+    remove(filename);
+    remove(compiledFilename);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
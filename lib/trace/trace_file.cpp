@@ -29,6 +29,9 @@
 #include <assert.h>
 
 
+#define FILE_BLOCK_SIZE (1 * 1024 * 1024)
+
+
 using namespace trace;
 
 
@@ -58,3 +61,29 @@ void File::setCurrentOffset(const File::Offset &offset)
     assert(0);
 }
 
+bool File::findSyncPoint(File::Offset &offset)
+{
+    return false;
+}
+
+void File::setReadAhead(unsigned chunks)
+{
+}
+
+
+const void *File::rawReadInPlace(size_t length, std::shared_ptr<void> &owner)
+{
+    return NULL;
+}
+
+const void *File::rawReadChunk(size_t &length, bool &sync, std::shared_ptr<void> &owner)
+{
+    std::shared_ptr<char> block(new char[FILE_BLOCK_SIZE], std::default_delete<char[]>());
+    length = rawRead(block.get(), FILE_BLOCK_SIZE);
+    sync = false;
+    if (!length) {
+        return NULL;
+    }
+    owner = block;
+    return block.get();
+}
@@ -27,6 +27,7 @@
 #pragma once
 
 #include <fstream>
+#include <memory>
 #include <stdint.h>
 
 
@@ -47,6 +48,9 @@ public:
     static File *createZLib(void);
     static File *createBrotli(void);
     static File *createSnappy(void);
+#ifdef HAVE_ZSTD
+    static File *createZstd(void);
+#endif
     static File *createForRead(const char *filename);
 public:
     File(void);
@@ -56,6 +60,8 @@ public:
 
     bool open(const char *filename);
     size_t read(void *buffer, size_t length);
+    const void *readInPlace(size_t length, std::shared_ptr<void> &owner);
+    const void *readChunk(size_t &length, bool &sync, std::shared_ptr<void> &owner);
     void close(void);
     int getc(void);
     bool skip(size_t length);
@@ -64,9 +70,24 @@ public:
     virtual bool supportsOffsets(void) const;
     virtual File::Offset currentOffset(void) const;
     virtual void setCurrentOffset(const File::Offset &offset);
+
+    /**
+     * Find the first synchronization point at or after the given offset,
+     * from which the trace can be parsed without looking at anything
+     * preceding it.  Does not change the current offset.
+     */
+    virtual bool findSyncPoint(File::Offset &offset);
+
+    /**
+     * Set how many chunks to read ahead on background threads, where
+     * supported.  Zero disables reading ahead.
+     */
+    virtual void setReadAhead(unsigned chunks);
 protected:
     virtual bool rawOpen(const char *filename) = 0;
     virtual size_t rawRead(void *buffer, size_t length) = 0;
+    virtual const void *rawReadInPlace(size_t length, std::shared_ptr<void> &owner);
+    virtual const void *rawReadChunk(size_t &length, bool &sync, std::shared_ptr<void> &owner);
     virtual int rawGetc(void) = 0;
     virtual void rawClose(void) = 0;
     virtual bool rawSkip(size_t length) = 0;
@@ -99,6 +120,39 @@ inline size_t File::read(void *buffer, size_t length)
     return rawRead(buffer, length);
 }
 
+/**
+ * Read length bytes without copying them, by returning a pointer to where they
+ * already are in memory.  The pointer remains valid for as long as a
+ * reference to owner is held.
+ *
+ * Returns NULL, without consuming anything, when that is not possible, in
+ * which case the caller should fallback to read().
+ */
+inline const void *File::readInPlace(size_t length, std::shared_ptr<void> &owner)
+{
+    if (!m_isOpened) {
+        return NULL;
+    }
+    return rawReadInPlace(length, owner);
+}
+
+/**
+ * Read what is left of the current chunk, or the whole next one when the
+ * current one was entirely read, without copying it where possible.  sync
+ * tells whether the data starts with a synchronization event at the start
+ * of a chunk.  Files which are not made of chunks return blocks of
+ * arbitrary size.
+ *
+ * Returns NULL at end of file.
+ */
+inline const void *File::readChunk(size_t &length, bool &sync, std::shared_ptr<void> &owner)
+{
+    if (!m_isOpened) {
+        return NULL;
+    }
+    return rawReadChunk(length, sync, owner);
+}
+
 inline int File::percentRead(void)
 {
     if (!m_isOpened) {
@@ -123,6 +177,10 @@ inline int File::getc(void)
     return rawGetc();
 }
 
+/**
+ * Skip length bytes, which all files must support, even without random
+ * access, as the parser skips repeated signature definitions since version 6.
+ */
 inline bool File::skip(size_t length)
 {
     if (!m_isOpened) {
@@ -30,6 +30,7 @@
 #include <assert.h>
 #include <string.h>
 
+#include <algorithm>
 #include <iostream>
 
 #include <brotli/dec/decode.h>
@@ -134,9 +135,17 @@ void BrotliFile::rawClose()
     m_stream.close();
 }
 
-bool BrotliFile::rawSkip(size_t)
+bool BrotliFile::rawSkip(size_t length)
 {
-    return false;
+    char buffer[4096];
+    while (length) {
+        size_t chunk = std::min(length, sizeof buffer);
+        if (rawRead(buffer, chunk) != chunk) {
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
 }
 
 int BrotliFile::rawPercentRead(void)
@@ -50,6 +50,13 @@ File::createForRead(const char *filename)
     File *file;
     if (byte1 == SNAPPY_BYTE1 && byte2 == SNAPPY_BYTE2) {
         file = File::createSnappy();
+    } else if (byte1 == ZSTD_BYTE1 && byte2 == ZSTD_BYTE2) {
+#ifdef HAVE_ZSTD
+        file = File::createZstd();
+#else
+        os::log("error: %s is Zstandard compressed, but apitrace was built without Zstandard support\n", filename);
+        return NULL;
+#endif
     } else if (byte1 == 0x1f && byte2 == 0x8b) {
         file = File::createZLib();
     } else  {
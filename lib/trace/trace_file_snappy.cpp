@@ -41,6 +41,10 @@
  * The default size of an uncompressed chunk is specified in
  * SNAPPY_CHUNK_SIZE.
  *
+ * The most significant bit of the length (SNAPPY_SYNC_FLAG) is set for
+ * chunks whose uncompressed data starts with a synchronization event, from
+ * which parsing can start (see FORMAT.markdown).
+ *
  * Note:
  * Currently the default size for a a to-be-compressed data is
  * 1mb, meaning that the compressed data will be <= 1mb.
@@ -48,46 +52,177 @@
  * to offer a pretty good compression/disk io speed ratio
  * but that might change.
  *
+ * Read-ahead:
+ * When there are spare cores, a small pool of worker threads reads and
+ * uncompresses the chunks following the current one, so that parsing does
+ * not stall on every chunk boundary.  Chunks are read from disk strictly in
+ * order, but uncompressed concurrently.  The number of chunks kept in
+ * flight can be overriden with the APITRACE_READ_AHEAD environment
+ * variable, where zero disables read-ahead altogether.
+ *
+ * Zstandard:
+ * Zstandard compressed traces use the very same container, only with
+ * different magic bytes (ZSTD_BYTE1/2), larger chunks, and each chunk being
+ * a Zstandard frame.  The compression of the chunks is abstracted by
+ * ChunkCodec.
+ *
+ * Memory mapping:
+ * Where possible the whole file is memory mapped, and chunks are
+ * uncompressed straight from the mapping.  Uncompressed chunks are
+ * reference counted, so that large blobs can refer to them in place (see
+ * File::readInPlace) instead of being copied.
+ *
  */
 
 
-#include <snappy.h>
-#include <snappy-sinksource.h>
-
 #include <iostream>
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "os_thread.hpp"
+#include "trace_codec.hpp"
 #include "trace_file.hpp"
 #include "trace_snappy.hpp"
 
 
 #define SNAPPY_CHUNK_SIZE (1 * 1024 * 1024)
 
+// Default number of chunks read ahead of the current one
+#define SNAPPY_READ_AHEAD 4
 
 
 using namespace trace;
 
 
+/*
+ * Reference counted buffer holding uncompressed chunk data.
+ *
+ * Blobs parsed in place keep a reference to the buffer, in which case it
+ * won't be reused for subsequent chunks.
+ */
+class ChunkBuffer {
+public:
+    char *data(void) const {
+        return m_data.get();
+    }
+
+    size_t capacity(void) const {
+        return m_capacity;
+    }
+
+    const std::shared_ptr<char> &owner(void) const {
+        return m_data;
+    }
+
+    // Ensure the buffer can hold size bytes and is not referred by anybody else
+    char *reserve(size_t size) {
+        if (size > m_capacity || m_data.use_count() > 1) {
+            m_capacity = std::max(size, size_t(SNAPPY_CHUNK_SIZE));
+            m_data.reset(new char[m_capacity], std::default_delete<char[]>());
+        } else {
+            // Synchronize with the release of references on other threads
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return m_data.get();
+    }
+
+    void swap(ChunkBuffer &other) {
+        m_data.swap(other.m_data);
+        std::swap(m_capacity, other.m_capacity);
+    }
+
+private:
+    std::shared_ptr<char> m_data;
+    size_t m_capacity = 0;
+};
+
+
+/*
+ * Uncompress a chunk, growing the destination buffer as necessary.
+ *
+ * Returns the number of bytes uncompressed.
+ */
+static size_t
+uncompressChunk(const ChunkCodec *codec,
+                const char *compressed, size_t compressedLength,
+                bool truncated,
+                ChunkBuffer &buffer)
+{
+    size_t length;
+    if (!codec->getUncompressedLength(compressed, compressedLength,
+                                      length)) {
+        return 0;
+    }
+
+    char *dst = buffer.reserve(length);
+
+    return codec->uncompress(compressed, compressedLength, truncated,
+                             dst, length);
+}
+
+
 class SnappyFile : public File {
 public:
-    SnappyFile(void);
+    SnappyFile(ChunkCodec *codec);
     virtual ~SnappyFile();
 
     virtual bool supportsOffsets(void) const override;
     virtual File::Offset currentOffset(void) const override;
     virtual void setCurrentOffset(const File::Offset &offset) override;
+    virtual bool findSyncPoint(File::Offset &offset) override;
+    virtual void setReadAhead(unsigned chunks) override;
 protected:
     virtual bool rawOpen(const char *filename) override;
     virtual size_t rawRead(void *buffer, size_t length) override;
+    virtual const void *rawReadInPlace(size_t length, std::shared_ptr<void> &owner) override;
+    virtual const void *rawReadChunk(size_t &length, bool &sync, std::shared_ptr<void> &owner) override;
     virtual int rawGetc(void) override;
     virtual void rawClose(void) override;
     virtual bool rawSkip(size_t length) override;
     virtual int rawPercentRead(void) override;
 
 private:
+    /**
+     * A chunk read ahead by the worker threads.
+     */
+    struct Chunk {
+        // File offsets of this and of the following chunk
+        uint64_t offset = 0;
+        uint64_t nextOffset = 0;
+
+        std::vector<char> compressed;
+
+        ChunkBuffer buffer;
+        size_t size = 0;
+
+        // Whether it starts with a synchronization event
+        bool sync = false;
+
+        // Whether this is the last chunk, either due to end of file or
+        // truncation
+        bool last = false;
+
+        // Whether uncompression finished
+        bool ready = false;
+
+        // Whether the consumer is no longer interested in this chunk
+        bool cancelled = false;
+    };
+
     inline size_t usedCacheSize(void) const
     {
         assert(m_cachePtr >= m_cache);
@@ -104,53 +239,122 @@ private:
     }
     inline bool endOfData(void) const
     {
-        return m_stream.eof() && freeCacheSize() == 0;
+        return m_endOfFile && freeCacheSize() == 0;
     }
-    void flushWriteCache(void);
     void flushReadCache(size_t skipLength = 0);
     void createCache(size_t size);
-    size_t readCompressedLength();
+
+    bool mapFile(const char *filename);
+    void unmapFile(void);
+    uint64_t tell(void);
+    void seek(uint64_t offset);
+    const char *readCompressedChunk(std::vector<char> &buffer,
+                                    size_t &compressedLength,
+                                    bool &truncated,
+                                    bool &sync);
+    size_t readCompressedLength(bool *sync = nullptr);
+
+    void startReadAhead(void);
+    void stopReadAhead(void);
+    void cancelReadAhead(const Chunk *keep);
+    void recycleChunk(Chunk *chunk);
+    void flushReadAheadCache(void);
+    static void readAheadThread(SnappyFile *_this);
+    void readAhead(void);
 private:
+    std::unique_ptr<ChunkCodec> m_codec;
+
     std::ifstream m_stream;
-    size_t m_cacheMaxSize;
+
+    // Memory mapped file contents, if any, in which case m_stream is unused
+    const char *m_map;
+    uint64_t m_mapSize;
+    uint64_t m_mapPos;
+
+    ChunkBuffer m_buffer;
     size_t m_cacheSize;
     char *m_cache;
     char *m_cachePtr;
 
-    char *m_compressedCache;
+    // Whether the current chunk starts with a synchronization event
+    bool m_cacheSync;
+
+    std::vector<char> m_compressedCache;
 
     uint64_t m_currentChunkOffset;
-    std::streampos m_endPos;
+    uint64_t m_nextChunkOffset;
+    uint64_t m_endPos;
+    bool m_endOfFile;
+
+    /*
+     * Read-ahead state.  Everything below, including the file position
+     * while read-ahead is active, is protected by m_mutex.
+     */
+    unsigned m_readAhead;
+    std::vector<os::thread> m_workers;
+    os::mutex m_mutex;
+    os::condition_variable m_workerCond;
+    os::condition_variable m_readyCond;
+    std::deque<Chunk *> m_pending;
+    std::vector<Chunk *> m_freeChunks;
+    uint64_t m_readAheadOffset;
+    bool m_readAheadEnd;
+    bool m_stopping;
 };
 
-SnappyFile::SnappyFile(void)
+SnappyFile::SnappyFile(ChunkCodec *codec)
     : File(),
-      m_cacheMaxSize(SNAPPY_CHUNK_SIZE),
-      m_cacheSize(m_cacheMaxSize),
-      m_cache(new char [m_cacheMaxSize]),
-      m_cachePtr(m_cache)
+      m_codec(codec),
+      m_map(nullptr),
+      m_mapSize(0),
+      m_mapPos(0),
+      m_cacheSize(0),
+      m_cache(nullptr),
+      m_cachePtr(nullptr),
+      m_cacheSync(false),
+      m_currentChunkOffset(0),
+      m_nextChunkOffset(0),
+      m_endPos(0),
+      m_endOfFile(false),
+      m_readAheadOffset(0),
+      m_readAheadEnd(false),
+      m_stopping(false)
 {
-    size_t maxCompressedLength =
-        snappy::MaxCompressedLength(SNAPPY_CHUNK_SIZE);
-    m_compressedCache = new char[maxCompressedLength];
+    m_readAhead = SNAPPY_READ_AHEAD;
+    if (os::thread::hardware_concurrency() < 2) {
+        m_readAhead = 0;
+    }
+    const char *readAhead = getenv("APITRACE_READ_AHEAD");
+    if (readAhead) {
+        m_readAhead = atoi(readAhead);
+    }
 }
 
 SnappyFile::~SnappyFile()
 {
     close();
-    delete [] m_compressedCache;
-    delete [] m_cache;
 }
 
 bool SnappyFile::rawOpen(const char *filename)
 {
-    std::ios_base::openmode fmode = std::fstream::binary
-                                  | std::fstream::in;
+    if (mapFile(filename)) {
+        m_endPos = m_mapSize;
+        m_mapPos = 0;
 
-    m_stream.open(filename, fmode);
+        // read the snappy file identifier
+        assert(m_mapSize >= 2 &&
+               (unsigned char)m_map[0] == m_codec->byte1 &&
+               (unsigned char)m_map[1] == m_codec->byte2);
+        m_mapPos = 2;
+    } else {
+        std::ios_base::openmode fmode = std::fstream::binary
+                                      | std::fstream::in;
+
+        m_stream.open(filename, fmode);
+        if (!m_stream.is_open()) {
+            return false;
+        }
 
-    //read in the initial buffer if we're reading
-    if (m_stream.is_open()) {
         m_stream.seekg(0, std::ios::end);
         m_endPos = m_stream.tellg();
         m_stream.seekg(0, std::ios::beg);
@@ -159,11 +363,22 @@ bool SnappyFile::rawOpen(const char *filename)
         unsigned char byte1, byte2;
         m_stream >> byte1;
         m_stream >> byte2;
-        assert(byte1 == SNAPPY_BYTE1 && byte2 == SNAPPY_BYTE2);
+        assert(byte1 == m_codec->byte1 && byte2 == m_codec->byte2);
 
-        flushReadCache();
+        m_compressedCache.resize(m_codec->maxCompressedLength(m_codec->chunkSize));
+    }
+
+    //read in the initial buffer
+    m_endOfFile = false;
+
+    if (m_readAhead) {
+        m_readAheadOffset = tell();
+        startReadAhead();
     }
-    return m_stream.is_open();
+
+    flushReadCache();
+
+    return true;
 }
 
 size_t SnappyFile::rawRead(void *buffer, size_t length)
@@ -196,6 +411,36 @@ size_t SnappyFile::rawRead(void *buffer, size_t length)
     return length;
 }
 
+const void *SnappyFile::rawReadInPlace(size_t length, std::shared_ptr<void> &owner)
+{
+    if (freeCacheSize() < length) {
+        // Straddles chunks
+        return nullptr;
+    }
+
+    const char *data = m_cachePtr;
+    m_cachePtr += length;
+    owner = m_buffer.owner();
+    return data;
+}
+
+const void *SnappyFile::rawReadChunk(size_t &length, bool &sync, std::shared_ptr<void> &owner)
+{
+    while (freeCacheSize() == 0) {
+        if (m_endOfFile) {
+            return nullptr;
+        }
+        flushReadCache();
+    }
+
+    const char *data = m_cachePtr;
+    sync = m_cacheSync && m_cachePtr == m_cache;
+    length = freeCacheSize();
+    m_cachePtr += length;
+    owner = m_buffer.owner();
+    return data;
+}
+
 int SnappyFile::rawGetc(void)
 {
     unsigned char c = 0;
@@ -206,87 +451,201 @@ int SnappyFile::rawGetc(void)
 
 void SnappyFile::rawClose(void)
 {
-    m_stream.close();
-    delete [] m_cache;
+    stopReadAhead();
+    if (m_map) {
+        unmapFile();
+    } else {
+        m_stream.close();
+    }
+    m_buffer = ChunkBuffer();
     m_cache = NULL;
     m_cachePtr = NULL;
+    m_cacheSize = 0;
 }
 
 void SnappyFile::flushReadCache(size_t skipLength)
 {
+    if (!m_workers.empty()) {
+        flushReadAheadCache();
+        return;
+    }
+
     //assert(m_cachePtr == m_cache + m_cacheSize);
-    m_currentChunkOffset = m_stream.tellg();
+    m_currentChunkOffset = tell();
+    bool truncated = false;
     size_t compressedLength;
-    compressedLength = readCompressedLength();
+    const char *compressed = readCompressedChunk(m_compressedCache,
+                                                 compressedLength, truncated,
+                                                 m_cacheSync);
+    m_nextChunkOffset = tell();
     if (!compressedLength) {
         // Reached end of file
+        m_endOfFile = true;
         createCache(0);
         return;
     }
 
-    m_stream.read((char*)m_compressedCache, compressedLength);
-    if (m_stream.fail()) {
-        std::cerr << "warning: unexpected end of file while reading trace\n";
+    if (truncated) {
+        m_endOfFile = true;
+        m_nextChunkOffset = m_endPos;
+    }
 
-        compressedLength = m_stream.gcount();
-        if (!snappy::GetUncompressedLength(m_compressedCache, compressedLength,
-                                           &m_cacheSize)) {
-            createCache(0);
-            return;
-        }
+    size_t length;
+    if (!m_codec->getUncompressedLength(compressed, compressedLength, length)) {
+        createCache(0);
+        return;
+    }
 
-        createCache(m_cacheSize);
-        snappy::ByteArraySource source(m_compressedCache, compressedLength);
+    // Don't bother uncompressing chunks which are going to be skipped over
+    // entirely
+    if (!truncated && skipLength > length) {
+        createCache(length);
+        return;
+    }
+
+    m_cacheSize = uncompressChunk(m_codec.get(), compressed, compressedLength,
+                                  truncated, m_buffer);
+    m_cache = m_buffer.data();
+    m_cachePtr = m_cache;
+}
 
-        snappy::UncheckedByteArraySink sink(m_cache);
-        m_cacheSize = snappy::UncompressAsMuchAsPossible(&source, &sink);
+void SnappyFile::createCache(size_t size)
+{
+    m_cache = m_buffer.reserve(size);
+    m_cachePtr = m_cache;
+    m_cacheSize = size;
+}
 
-        return;
+bool SnappyFile::mapFile(const char *filename)
+{
+#ifndef _WIN32
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
     }
 
-    if (!snappy::GetUncompressedLength(m_compressedCache, compressedLength,
-                                       &m_cacheSize)) {
-        createCache(0);
-        return;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 &&
+        S_ISREG(st.st_mode) &&
+        st.st_size >= 2 &&
+        uint64_t(st.st_size) == size_t(st.st_size)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
     }
+    ::close(fd);
 
-    createCache(m_cacheSize);
-    if (skipLength < m_cacheSize) {
-        snappy::RawUncompress(m_compressedCache, compressedLength,
-                              m_cache);
+    if (map == MAP_FAILED) {
+        // Fallback to regular reads (e.g., address space exhausted)
+        return false;
     }
+
+    m_map = static_cast<const char *>(map);
+    m_mapSize = st.st_size;
+    return true;
+#else
+    return false;
+#endif
 }
 
-void SnappyFile::createCache(size_t size)
+void SnappyFile::unmapFile(void)
 {
-    if (size > m_cacheMaxSize) {
-        do {
-            m_cacheMaxSize <<= 1;
-        } while (size > m_cacheMaxSize);
+#ifndef _WIN32
+    munmap(const_cast<char *>(m_map), m_mapSize);
+#endif
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_mapPos = 0;
+}
 
-        delete [] m_cache;
-        m_cache = new char[size];
-        m_cacheMaxSize = size;
+uint64_t SnappyFile::tell(void)
+{
+    if (m_map) {
+        return m_mapPos;
     }
+    return m_stream.tellg();
+}
 
-    m_cachePtr = m_cache;
-    m_cacheSize = size;
+void SnappyFile::seek(uint64_t offset)
+{
+    if (m_map) {
+        m_mapPos = std::min(offset, m_mapSize);
+    } else {
+        // to remove eof bit
+        m_stream.clear();
+        m_stream.seekg(offset, std::ios::beg);
+    }
 }
 
-size_t SnappyFile::readCompressedLength()
+/*
+ * Read the compressed data of the chunk at the current file position,
+ * either returning a pointer into the file mapping, or reading it into the
+ * given buffer.
+ *
+ * compressedLength is set to zero at end of file.
+ */
+const char *SnappyFile::readCompressedChunk(std::vector<char> &buffer,
+                                            size_t &compressedLength,
+                                            bool &truncated,
+                                            bool &sync)
+{
+    sync = false;
+    compressedLength = readCompressedLength(&sync);
+    if (!compressedLength) {
+        return nullptr;
+    }
+
+    if (m_map) {
+        const char *data = m_map + m_mapPos;
+        if (compressedLength > m_mapSize - m_mapPos) {
+            std::cerr << "warning: unexpected end of file while reading trace\n";
+
+            compressedLength = m_mapSize - m_mapPos;
+            truncated = true;
+        }
+        m_mapPos += compressedLength;
+        return data;
+    }
+
+    if (compressedLength > buffer.size()) {
+        buffer.resize(compressedLength);
+    }
+
+    m_stream.read(buffer.data(), compressedLength);
+    if (m_stream.fail()) {
+        std::cerr << "warning: unexpected end of file while reading trace\n";
+
+        compressedLength = m_stream.gcount();
+        truncated = true;
+    }
+
+    return buffer.data();
+}
+
+size_t SnappyFile::readCompressedLength(bool *sync)
 {
     unsigned char buf[4];
     size_t length;
-    m_stream.read((char *)buf, sizeof buf);
-    if (m_stream.fail()) {
-        length = 0;
+    if (m_map) {
+        if (m_mapSize - m_mapPos < sizeof buf) {
+            m_mapPos = m_mapSize;
+            return 0;
+        }
+        memcpy(buf, m_map + m_mapPos, sizeof buf);
+        m_mapPos += sizeof buf;
     } else {
-        length  =  (size_t)buf[0];
-        length |= ((size_t)buf[1] <<  8);
-        length |= ((size_t)buf[2] << 16);
-        length |= ((size_t)buf[3] << 24);
+        m_stream.read((char *)buf, sizeof buf);
+        if (m_stream.fail()) {
+            return 0;
+        }
     }
-    return length;
+    length  =  (size_t)buf[0];
+    length |= ((size_t)buf[1] <<  8);
+    length |= ((size_t)buf[2] << 16);
+    length |= ((size_t)buf[3] << 24);
+    if (sync) {
+        *sync = (length & SNAPPY_SYNC_FLAG) != 0;
+    }
+    return length & ~size_t(SNAPPY_SYNC_FLAG);
 }
 
 bool SnappyFile::supportsOffsets(void) const
@@ -304,10 +663,40 @@ File::Offset SnappyFile::currentOffset(void) const
 
 void SnappyFile::setCurrentOffset(const File::Offset &offset)
 {
-    // to remove eof bit
-    m_stream.clear();
-    // seek to the start of a chunk
-    m_stream.seekg(offset.chunk, std::ios::beg);
+    // Seeking within the chunk we already have requires no I/O
+    if (offset.chunk == m_currentChunkOffset &&
+        m_cacheSize &&
+        offset.offsetInChunk <= m_cacheSize) {
+        m_cachePtr = m_cache + offset.offsetInChunk;
+        return;
+    }
+
+    if (!m_workers.empty()) {
+        os::unique_lock<os::mutex> lock(m_mutex);
+
+        // Keep the chunks read ahead if the target is amongst them,
+        // otherwise restart reading ahead from the new location
+        const Chunk *target = nullptr;
+        for (auto chunk : m_pending) {
+            if (chunk->offset == offset.chunk) {
+                target = chunk;
+                break;
+            }
+        }
+        cancelReadAhead(target);
+        if (!target) {
+            seek(offset.chunk);
+            m_readAheadOffset = offset.chunk;
+            m_readAheadEnd = false;
+            m_workerCond.notify_all();
+        }
+    } else {
+        // seek to the start of a chunk
+        seek(offset.chunk);
+    }
+
+    m_endOfFile = false;
+
     // load the chunk
     flushReadCache();
     assert(m_cacheSize >= offset.offsetInChunk);
@@ -316,6 +705,70 @@ void SnappyFile::setCurrentOffset(const File::Offset &offset)
 
 }
 
+/*
+ * Walk the chunk headers, starting at the given chunk or at the one following
+ * it, until one starting with a synchronization event is found.
+ */
+bool SnappyFile::findSyncPoint(File::Offset &offset)
+{
+    // The file position is shared with the read-ahead workers
+    os::unique_lock<os::mutex> lock(m_mutex);
+
+    if (!m_map) {
+        m_stream.clear();
+    }
+    uint64_t savedPos = tell();
+
+    uint64_t chunkOffset = offset.chunk;
+    bool skip = offset.offsetInChunk > 0;
+    bool found = false;
+    while (chunkOffset < m_endPos) {
+        seek(chunkOffset);
+        bool sync = false;
+        size_t compressedLength = readCompressedLength(&sync);
+        if (!compressedLength) {
+            break;
+        }
+        if (sync && !skip) {
+            found = true;
+            break;
+        }
+        skip = false;
+        chunkOffset += 4 + compressedLength;
+    }
+
+    seek(savedPos);
+
+    if (found) {
+        offset.chunk = chunkOffset;
+        offset.offsetInChunk = 0;
+    }
+    return found;
+}
+
+void SnappyFile::setReadAhead(unsigned chunks)
+{
+    if (chunks == m_readAhead) {
+        return;
+    }
+
+    File::Offset offset = currentOffset();
+
+    stopReadAhead();
+    m_readAhead = chunks;
+
+    // Reload the current chunk, with or without read-ahead
+    seek(offset.chunk);
+    if (m_readAhead) {
+        m_readAheadOffset = offset.chunk;
+        startReadAhead();
+    }
+    m_endOfFile = false;
+    flushReadCache();
+    assert(m_cacheSize >= offset.offsetInChunk);
+    m_cachePtr = m_cache + offset.offsetInChunk;
+}
+
 bool SnappyFile::rawSkip(size_t length)
 {
     if (endOfData()) {
@@ -344,10 +797,191 @@ bool SnappyFile::rawSkip(size_t length)
 
 int SnappyFile::rawPercentRead(void)
 {
-    return int(100 * (double(m_stream.tellg()) / double(m_endPos)));
+    return int(100 * (double(m_nextChunkOffset) / double(m_endPos)));
+}
+
+
+void SnappyFile::startReadAhead(void)
+{
+    assert(m_workers.empty());
+    assert(m_pending.empty());
+
+    m_readAheadEnd = false;
+    m_stopping = false;
+
+    // Reading is serialized, so there is little point in having more
+    // workers than spare cores
+    unsigned numWorkers = os::thread::hardware_concurrency();
+    numWorkers = numWorkers > 1 ? numWorkers - 1 : 1;
+    numWorkers = std::min(numWorkers, m_readAhead);
+
+    for (unsigned i = 0; i < numWorkers; ++i) {
+        m_workers.emplace_back(readAheadThread, this);
+    }
+}
+
+void SnappyFile::stopReadAhead(void)
+{
+    if (m_workers.empty()) {
+        return;
+    }
+
+    m_mutex.lock();
+    m_stopping = true;
+    m_mutex.unlock();
+    m_workerCond.notify_all();
+
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+
+    cancelReadAhead(nullptr);
+    assert(m_pending.empty());
+
+    for (auto chunk : m_freeChunks) {
+        delete chunk;
+    }
+    m_freeChunks.clear();
+}
+
+/*
+ * Drop the chunks read ahead which precede the given one, or all of them if
+ * none is given.  Must be called with the mutex held.
+ */
+void SnappyFile::cancelReadAhead(const Chunk *keep)
+{
+    while (!m_pending.empty() && m_pending.front() != keep) {
+        Chunk *chunk = m_pending.front();
+        m_pending.pop_front();
+        if (chunk->ready) {
+            recycleChunk(chunk);
+        } else {
+            // The worker uncompressing it will recycle it once done
+            chunk->cancelled = true;
+        }
+    }
+    m_workerCond.notify_all();
+}
+
+void SnappyFile::recycleChunk(Chunk *chunk)
+{
+    chunk->ready = false;
+    chunk->cancelled = false;
+    chunk->last = false;
+    chunk->sync = false;
+    chunk->size = 0;
+    m_freeChunks.push_back(chunk);
+}
+
+/*
+ * Take the next chunk from the read-ahead queue, waiting for it to be
+ * uncompressed if necessary.
+ */
+void SnappyFile::flushReadAheadCache(void)
+{
+    os::unique_lock<os::mutex> lock(m_mutex);
+
+    while (m_pending.empty() || !m_pending.front()->ready) {
+        if (m_pending.empty() && m_readAheadEnd) {
+            // Reached end of file
+            m_endOfFile = true;
+            createCache(0);
+            return;
+        }
+        m_readyCond.wait(lock);
+    }
+
+    Chunk *chunk = m_pending.front();
+    m_pending.pop_front();
+    m_workerCond.notify_one();
+
+    m_currentChunkOffset = chunk->offset;
+    m_nextChunkOffset = chunk->nextOffset;
+    m_cacheSync = chunk->sync;
+    if (chunk->last) {
+        m_endOfFile = true;
+    }
+
+    // Swap buffers, so that the current cache can be reused by the workers
+    m_buffer.swap(chunk->buffer);
+    m_cache = m_buffer.data();
+    m_cacheSize = chunk->size;
+    m_cachePtr = m_cache;
+
+    recycleChunk(chunk);
+}
+
+void SnappyFile::readAheadThread(SnappyFile *_this)
+{
+    _this->readAhead();
+}
+
+/*
+ * Worker thread main loop.
+ */
+void SnappyFile::readAhead(void)
+{
+    os::unique_lock<os::mutex> lock(m_mutex);
+
+    while (true) {
+        while (!m_stopping &&
+               (m_readAheadEnd || m_pending.size() >= m_readAhead)) {
+            m_workerCond.wait(lock);
+        }
+        if (m_stopping) {
+            break;
+        }
+
+        Chunk *chunk;
+        if (m_freeChunks.empty()) {
+            chunk = new Chunk;
+        } else {
+            chunk = m_freeChunks.back();
+            m_freeChunks.pop_back();
+        }
+
+        // Chunks must be read in order, so do it with the mutex held
+        bool truncated = false;
+        size_t compressedLength;
+        chunk->offset = m_readAheadOffset;
+        const char *compressed = readCompressedChunk(chunk->compressed,
+                                                     compressedLength, truncated,
+                                                     chunk->sync);
+        if (!compressedLength || truncated) {
+            chunk->last = true;
+            m_readAheadEnd = true;
+            m_readAheadOffset = m_endPos;
+        } else {
+            m_readAheadOffset += 4 + compressedLength;
+        }
+        chunk->nextOffset = m_readAheadOffset;
+        m_pending.push_back(chunk);
+
+        if (compressedLength) {
+            lock.unlock();
+            chunk->size = uncompressChunk(m_codec.get(),
+                                          compressed, compressedLength,
+                                          truncated, chunk->buffer);
+            lock.lock();
+        }
+
+        if (chunk->cancelled) {
+            recycleChunk(chunk);
+        } else {
+            chunk->ready = true;
+            m_readyCond.notify_one();
+        }
+    }
 }
 
 
 File* File::createSnappy(void) {
-    return new SnappyFile;
+    return new SnappyFile(createSnappyCodec());
+}
+
+
+File *
+trace::createChunkedFile(ChunkCodec *codec) {
+    return new SnappyFile(codec);
 }
@@ -128,9 +128,9 @@ void ZLibFile::rawClose()
     }
 }
 
-bool ZLibFile::rawSkip(size_t)
+bool ZLibFile::rawSkip(size_t length)
 {
-    return false;
+    return gzseek(m_gzFile, z_off_t(length), SEEK_CUR) >= 0;
 }
 
 int ZLibFile::rawPercentRead(void)
@@ -34,12 +34,13 @@
 namespace trace {
 
 
-#define TRACE_VERSION 5
+#define TRACE_VERSION 9
 
 
 enum Event {
     EVENT_ENTER = 0,
     EVENT_LEAVE,
+    EVENT_SYNC,
 };
 
 enum CallDetail {
@@ -48,6 +49,7 @@ enum CallDetail {
     CALL_RET,
     CALL_THREAD,
     CALL_BACKTRACE,
+    CALL_LENGTH,
 };
 
 enum Type {
@@ -67,6 +69,8 @@ enum Type {
     TYPE_OPAQUE,
     TYPE_REPR,
     TYPE_WSTRING,
+    TYPE_BLOB_REF,
+    TYPE_STRING_REF,
 };
 
 enum BacktraceDetail {
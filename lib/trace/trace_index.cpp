@@ -0,0 +1,333 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Index file format.
+ * ------------------
+ *
+ * All integers are little endian.
+ *
+ *   index = magic version trace_size trace_mtime call_interval
+ *           count frame*
+ *           count call*
+ *           count signature*
+ *           count ref*
+ *
+ *   magic = 'a' 't' 'i' 'x'
+ *   version = uint32
+ *   trace_size = uint64
+ *   trace_mtime = uint64
+ *   call_interval = uint32
+ *   count = uint32
+ *
+ *   frame = bookmark num_calls:uint32 last_call:uint32
+ *   call = bookmark
+ *   signature = kind:uint8 id:uint32 offset
+ *   ref = kind:uint8 id:uint64 offset
+ *
+ *   bookmark = offset next_call_no:uint32
+ *   offset = chunk:uint64 offset_in_chunk:uint32
+ */
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "trace_index.hpp"
+
+
+#define INDEX_VERSION 2
+
+
+namespace trace {
+
+
+static const char indexMagic[4] = {'a', 't', 'i', 'x'};
+
+
+static bool
+getTraceStamp(const char *traceFilename, uint64_t &size, uint64_t &mtime)
+{
+    struct stat st;
+    if (stat(traceFilename, &st) != 0) {
+        return false;
+    }
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+
+class IndexWriter
+{
+private:
+    std::ofstream &stream;
+
+public:
+    IndexWriter(std::ofstream &_stream) :
+        stream(_stream)
+    {}
+
+    void
+    writeUInt(uint64_t value, unsigned size) {
+        char buf[8];
+        assert(size <= sizeof buf);
+        for (unsigned i = 0; i < size; ++i) {
+            buf[i] = value & 0xff;
+            value >>= 8;
+        }
+        stream.write(buf, size);
+    }
+
+    void
+    writeBookmark(const ParseBookmark &bookmark) {
+        writeUInt(bookmark.offset.chunk, 8);
+        writeUInt(bookmark.offset.offsetInChunk, 4);
+        writeUInt(bookmark.next_call_no, 4);
+    }
+};
+
+
+class IndexReader
+{
+private:
+    std::ifstream &stream;
+
+public:
+    IndexReader(std::ifstream &_stream) :
+        stream(_stream)
+    {}
+
+    uint64_t
+    readUInt(unsigned size) {
+        unsigned char buf[8];
+        assert(size <= sizeof buf);
+        if (!stream.read((char *)buf, size)) {
+            return 0;
+        }
+        uint64_t value = 0;
+        for (unsigned i = size; i > 0; --i) {
+            value = (value << 8) | buf[i - 1];
+        }
+        return value;
+    }
+
+    void
+    readBookmark(ParseBookmark &bookmark) {
+        bookmark.offset.chunk = readUInt(8);
+        bookmark.offset.offsetInChunk = readUInt(4);
+        bookmark.next_call_no = readUInt(4);
+    }
+
+    bool
+    ok(void) const {
+        return stream.good();
+    }
+};
+
+
+std::string
+Index::getFilename(const char *traceFilename)
+{
+    return std::string(traceFilename) + ".index";
+}
+
+
+bool
+Index::load(const char *filename, const char *traceFilename)
+{
+    uint64_t traceSize, traceMTime;
+    if (!getTraceStamp(traceFilename, traceSize, traceMTime)) {
+        return false;
+    }
+
+    std::ifstream stream(filename, std::ios::binary);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    char magic[sizeof indexMagic];
+    if (!stream.read(magic, sizeof magic) ||
+        memcmp(magic, indexMagic, sizeof magic) != 0) {
+        return false;
+    }
+
+    IndexReader reader(stream);
+    if (reader.readUInt(4) != INDEX_VERSION ||
+        reader.readUInt(8) != traceSize ||
+        reader.readUInt(8) != traceMTime) {
+        return false;
+    }
+
+    callInterval = reader.readUInt(4);
+    if (!callInterval) {
+        return false;
+    }
+
+    frames.resize(reader.readUInt(4));
+    for (auto & frame : frames) {
+        reader.readBookmark(frame.start);
+        frame.numCalls = reader.readUInt(4);
+        frame.lastCall = reader.readUInt(4);
+        if (!reader.ok()) {
+            return false;
+        }
+    }
+
+    calls.resize(reader.readUInt(4));
+    for (auto & call : calls) {
+        reader.readBookmark(call);
+        if (!reader.ok()) {
+            return false;
+        }
+    }
+
+    signatures.resize(reader.readUInt(4));
+    for (auto & signature : signatures) {
+        signature.kind = static_cast<IndexSignature::Kind>(reader.readUInt(1));
+        signature.id = reader.readUInt(4);
+        signature.offset.chunk = reader.readUInt(8);
+        signature.offset.offsetInChunk = reader.readUInt(4);
+        if (!reader.ok() ||
+            signature.kind > IndexSignature::FRAME) {
+            return false;
+        }
+    }
+
+    refs.resize(reader.readUInt(4));
+    for (auto & ref : refs) {
+        ref.kind = static_cast<IndexSignature::Kind>(reader.readUInt(1));
+        ref.id = reader.readUInt(8);
+        ref.offset.chunk = reader.readUInt(8);
+        ref.offset.offsetInChunk = reader.readUInt(4);
+        if (!reader.ok() ||
+            (ref.kind != IndexSignature::BLOB &&
+             ref.kind != IndexSignature::STRING)) {
+            return false;
+        }
+    }
+
+    return reader.ok();
+}
+
+
+bool
+Index::save(const char *filename, const char *traceFilename) const
+{
+    uint64_t traceSize, traceMTime;
+    if (!getTraceStamp(traceFilename, traceSize, traceMTime)) {
+        return false;
+    }
+
+    std::ofstream stream(filename, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    stream.write(indexMagic, sizeof indexMagic);
+
+    IndexWriter writer(stream);
+    writer.writeUInt(INDEX_VERSION, 4);
+    writer.writeUInt(traceSize, 8);
+    writer.writeUInt(traceMTime, 8);
+    writer.writeUInt(callInterval, 4);
+
+    writer.writeUInt(frames.size(), 4);
+    for (auto & frame : frames) {
+        writer.writeBookmark(frame.start);
+        writer.writeUInt(frame.numCalls, 4);
+        writer.writeUInt(frame.lastCall, 4);
+    }
+
+    writer.writeUInt(calls.size(), 4);
+    for (auto & call : calls) {
+        writer.writeBookmark(call);
+    }
+
+    writer.writeUInt(signatures.size(), 4);
+    for (auto & signature : signatures) {
+        writer.writeUInt(signature.kind, 1);
+        writer.writeUInt(signature.id, 4);
+        writer.writeUInt(signature.offset.chunk, 8);
+        writer.writeUInt(signature.offset.offsetInChunk, 4);
+    }
+
+    writer.writeUInt(refs.size(), 4);
+    for (auto & ref : refs) {
+        writer.writeUInt(ref.kind, 1);
+        writer.writeUInt(ref.id, 8);
+        writer.writeUInt(ref.offset.chunk, 8);
+        writer.writeUInt(ref.offset.offsetInChunk, 4);
+    }
+
+    stream.close();
+    if (stream.fail()) {
+        std::cerr << "warning: failed to write " << filename << "\n";
+        remove(filename);
+        return false;
+    }
+
+    return true;
+}
+
+
+const ParseBookmark *
+Index::findCall(unsigned call_no) const
+{
+    size_t i = call_no / callInterval;
+    if (i >= calls.size()) {
+        if (calls.empty()) {
+            return NULL;
+        }
+        i = calls.size() - 1;
+    }
+    assert(calls[i].next_call_no <= call_no);
+    return &calls[i];
+}
+
+
+const IndexRef *
+Index::findDefinition(IndexSignature::Kind kind, unsigned long long id) const
+{
+    auto it = std::lower_bound(refs.begin(), refs.end(), std::make_pair(kind, id),
+                               [](const IndexRef &ref, const std::pair<IndexSignature::Kind, unsigned long long> &key) {
+                                   return ref.kind < key.first ||
+                                          (ref.kind == key.first && ref.id < key.second);
+                               });
+    if (it == refs.end() || it->kind != kind || it->id != id) {
+        return NULL;
+    }
+    return &*it;
+}
+
+
+} /* namespace trace */
@@ -0,0 +1,150 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Trace index sidecar files.
+ *
+ * An index records where each frame, and every Nth call, starts in a trace
+ * file, together with where each signature was first defined, and where the
+ * blobs and strings those points may refer to were defined, so that a
+ * Parser can resume from any of those points without parsing everything
+ * that precedes it.  See Parser::jumpToCall and Parser::jumpToFrame.
+ *
+ * Indices are only available for trace files that support offsets (i.e.,
+ * snappy compressed ones), and are saved alongside the trace with a
+ * ".index" suffix.
+ */
+
+#pragma once
+
+
+#include <string>
+#include <vector>
+
+#include "trace_parser.hpp"
+
+
+namespace trace {
+
+
+// Default interval between indexed calls
+#define TRACE_INDEX_CALL_INTERVAL 1000
+
+
+struct IndexFrame
+{
+    // Bookmark at the start of the frame
+    ParseBookmark start;
+
+    // Number of calls completed within the frame
+    unsigned numCalls;
+
+    // Number of the call that ends the frame
+    unsigned lastCall;
+};
+
+
+struct IndexSignature
+{
+    enum Kind {
+        FUNCTION = 0,
+        STRUCT,
+        ENUM,
+        BITMASK,
+        FRAME,
+        // Deduplicated blob and string contents, see IndexRef
+        BLOB,
+        STRING
+    };
+
+    Kind kind;
+    unsigned id;
+
+    // Offset where the signature definition starts (i.e., of its ID)
+    File::Offset offset;
+};
+
+
+struct IndexRef
+{
+    // IndexSignature::BLOB or IndexSignature::STRING
+    IndexSignature::Kind kind;
+    unsigned long long id;
+
+    // Offset where the definition starts (i.e., of its ID)
+    File::Offset offset;
+};
+
+
+class Index
+{
+public:
+    unsigned callInterval;
+
+    std::vector<IndexFrame> frames;
+
+    // Bookmarks right before the enter event of every callInterval-th call
+    std::vector<ParseBookmark> calls;
+
+    // Signature definitions, sorted by offset
+    std::vector<IndexSignature> signatures;
+
+    // Blob and string definitions preceding any of the bookmarks above since
+    // the last synchronization event, which are the only ones that can be
+    // referred from there on, sorted by kind and ID
+    std::vector<IndexRef> refs;
+
+    Index(unsigned _callInterval = TRACE_INDEX_CALL_INTERVAL) :
+        callInterval(_callInterval)
+    {}
+
+    static std::string
+    getFilename(const char *traceFilename);
+
+    /**
+     * Load the index, failing if it's missing, corrupt, or stale with regards
+     * to the trace file.
+     */
+    bool
+    load(const char *filename, const char *traceFilename);
+
+    bool
+    save(const char *filename, const char *traceFilename) const;
+
+    /**
+     * Find the last indexed bookmark before the given call.
+     */
+    const ParseBookmark *
+    findCall(unsigned call_no) const;
+
+    /**
+     * Find where the given deduplicated blob or string is defined.
+     */
+    const IndexRef *
+    findDefinition(IndexSignature::Kind kind, unsigned long long id) const;
+};
+
+
+} /* namespace trace */
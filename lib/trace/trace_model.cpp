@@ -25,6 +25,7 @@
 
 
 #include <string.h>
+#include <algorithm>
 #include <deque>
 
 #include "trace_model.hpp"
@@ -36,9 +37,133 @@ namespace trace {
 static Null null;
 
 
+void *
+Arena::allocateBlock(size_t size) {
+    size_t nextBlockSize = blockSize ? std::min<size_t>(blockSize * 2, MAX_BLOCK_SIZE) : MIN_BLOCK_SIZE;
+
+    // Give large allocations a block of their own, rather than wasting the
+    // remainder of the current one.
+    bool dedicated = size > nextBlockSize / 4;
+
+    size_t allocation = sizeof(Block) + (dedicated ? size : nextBlockSize);
+    Block *block = static_cast<Block *>(malloc(allocation));
+    if (!block) {
+        abort();
+    }
+    allocated += allocation;
+    block->next = head;
+    head = block;
+
+    char *data = reinterpret_cast<char *>(block + 1);
+    if (!dedicated) {
+        blockSize = nextBlockSize;
+        next = data + size;
+        end = data + blockSize;
+    }
+    return data;
+}
+
+
+void
+Arena::clear(void) {
+    while (head) {
+        Block *block = head;
+        head = block->next;
+        free(block);
+    }
+    next = nullptr;
+    end = nullptr;
+    blockSize = 0;
+    allocated = 0;
+}
+
+
+/*
+ * Call the destructors of values allocated from an arena, without releasing
+ * their memory, nor the strings' characters, which came from the arena too.
+ */
+class ArenaDestroyer : public Visitor
+{
+public:
+    void destroy(Value *value) {
+        if (!value) {
+            return;
+        }
+
+        // Don't decode lazy values just to destroy them
+        Lazy *lazy = value->toLazy();
+        if (lazy) {
+            destroy(lazy->decoded);
+            lazy->decoded = nullptr;
+            lazy->~Lazy();
+            return;
+        }
+
+        value->visit(*this);
+    }
+
+    void visit(Null *node) override { node->~Null(); }
+    void visit(Bool *node) override { node->~Bool(); }
+    void visit(SInt *node) override { node->~SInt(); }
+    void visit(UInt *node) override { node->~UInt(); }
+    void visit(Float *node) override { node->~Float(); }
+    void visit(Double *node) override { node->~Double(); }
+    void visit(Enum *node) override { node->~Enum(); }
+    void visit(Bitmask *node) override { node->~Bitmask(); }
+    void visit(Blob *node) override { node->~Blob(); }
+    void visit(Pointer *node) override { node->~Pointer(); }
+
+    void visit(String *node) override {
+        node->value = nullptr;
+        node->~String();
+    }
+
+    void visit(WString *node) override {
+        node->value = nullptr;
+        node->~WString();
+    }
+
+    void visit(Struct *node) override {
+        for (auto & member : node->members) {
+            destroy(member);
+        }
+        node->members.clear();
+        node->~Struct();
+    }
+
+    void visit(Array *node) override {
+        for (auto & value : node->values) {
+            destroy(value);
+        }
+        node->values.clear();
+        node->~Array();
+    }
+
+    void visit(Repr *node) override {
+        destroy(node->humanValue);
+        destroy(node->machineValue);
+        node->~Repr();
+    }
+};
+
+
 Call::~Call() {
+    // Values of shallow copies belong to the original call
+    if (original) {
+        return;
+    }
+
+    if (!arena.empty()) {
+        ArenaDestroyer destroyer;
+        for (auto & arg : args) {
+            destroyer.destroy(arg.value);
+        }
+        destroyer.destroy(ret);
+        return;
+    }
+
     for (auto & arg : args) {
-        delete arg.value;
+        arg.reset();
     }
 
     if (ret) {
@@ -46,6 +171,16 @@ Call::~Call() {
     }
 }
 
+void
+Arg::reset(Value *newValue) {
+    if (isInline()) {
+        value->~Value();
+    } else {
+        delete value;
+    }
+    value = newValue;
+}
+
 Value &
 Call::argByName(const char *argName) {
     for (unsigned i = 0; i < sig->num_args; ++i) {
@@ -56,9 +191,49 @@ Call::argByName(const char *argName) {
     return null;
 }
 
+static size_t
+getBlobSize(Value *value) {
+    if (!value) {
+        return 0;
+    }
+    if (Blob *blob = value->toBlob()) {
+        return blob->size;
+    }
+    size_t size = 0;
+    if (Array *array = value->toArray()) {
+        for (auto element : array->values) {
+            size += getBlobSize(element);
+        }
+    } else if (Struct *structure = value->toStruct()) {
+        for (auto member : structure->members) {
+            size += getBlobSize(member);
+        }
+    }
+    return size;
+}
+
+size_t
+Call::blobSize(void) const {
+    size_t size = getBlobSize(ret);
+    for (auto & arg : args) {
+        size += getBlobSize(arg.value);
+    }
+    return size;
+}
+
 
 String::~String() {
-    delete [] value;
+    if (!owner) {
+        delete [] value;
+    }
+}
+
+void String::reset(const char *_value) {
+    if (!owner) {
+        delete [] value;
+    }
+    owner.reset();
+    value = _value;
 }
 
 
@@ -139,7 +314,9 @@ Blob::~Blob() {
     // bound blobs and keep the total size bounded.
 
     if (!bound) {
-        delete [] buf;
+        if (!owner) {
+            delete [] buf;
+        }
         return;
     }
 
@@ -151,6 +328,27 @@ Blob::~Blob() {
     boundBlobQueue.push_back(BoundBlob(size, buf));
 }
 
+void *
+Blob::toPointer(bool bind) {
+    if (bind) {
+        if (owner) {
+            // Bound blobs outlive the call, so take a private copy instead
+            // of pinning the owner's (potentially much larger) buffer.
+            char *copy = new char[size];
+            memcpy(copy, buf, size);
+            buf = copy;
+            owner.reset();
+        }
+        bound = true;
+    }
+    return buf;
+}
+
+Lazy::~Lazy() {
+    delete decoded;
+}
+
+
 StackFrame::~StackFrame() {
     if (module != NULL) {
         delete [] module;
@@ -178,6 +376,7 @@ bool Array  ::toBool(void) const { return true; }
 bool Blob   ::toBool(void) const { return true; }
 bool Pointer::toBool(void) const { return value != 0; }
 bool Repr   ::toBool(void) const { return static_cast<bool>(machineValue); }
+bool Lazy   ::toBool(void) const { return get()->toBool(); }
 
 
 // signed integer cast
@@ -189,6 +388,7 @@ signed long long UInt   ::toSInt(void) const { assert(static_cast<signed long lo
 signed long long Float  ::toSInt(void) const { return static_cast<signed long long>(value); }
 signed long long Double ::toSInt(void) const { return static_cast<signed long long>(value); }
 signed long long Repr   ::toSInt(void) const { return machineValue->toSInt(); }
+signed long long Lazy   ::toSInt(void) const { return get()->toSInt(); }
 
 
 // unsigned integer cast
@@ -200,6 +400,7 @@ unsigned long long UInt   ::toUInt(void) const { return value; }
 unsigned long long Float  ::toUInt(void) const { return static_cast<unsigned long long>(value); }
 unsigned long long Double ::toUInt(void) const { return static_cast<unsigned long long>(value); }
 unsigned long long Repr   ::toUInt(void) const { return machineValue->toUInt(); }
+unsigned long long Lazy   ::toUInt(void) const { return get()->toUInt(); }
 
 
 // floating point cast
@@ -211,6 +412,7 @@ float UInt   ::toFloat(void) const { return static_cast<float>(value); }
 float Float  ::toFloat(void) const { return value; }
 float Double ::toFloat(void) const { return value; }
 float Repr   ::toFloat(void) const { return machineValue->toFloat(); }
+float Lazy   ::toFloat(void) const { return get()->toFloat(); }
 
 
 // floating point cast
@@ -222,6 +424,7 @@ double UInt   ::toDouble(void) const { return static_cast<double>(value); }
 double Float  ::toDouble(void) const { return value; }
 double Double ::toDouble(void) const { return value; }
 double Repr   ::toDouble(void) const { return machineValue->toDouble(); }
+double Lazy   ::toDouble(void) const { return get()->toDouble(); }
 
 
 // pointer cast
@@ -230,12 +433,13 @@ void * Null   ::toPointer(void) const { return NULL; }
 void * Blob   ::toPointer(void) const { return buf; }
 void * Pointer::toPointer(void) const { return (void *)value; }
 void * Repr   ::toPointer(void) const { return machineValue->toPointer(); }
+void * Lazy   ::toPointer(void) const { return get()->toPointer(); }
 
 void * Value  ::toPointer(bool bind) { assert(0); return NULL; }
 void * Null   ::toPointer(bool bind) { return NULL; }
-void * Blob   ::toPointer(bool bind) { if (bind) bound = true; return buf; }
 void * Pointer::toPointer(bool bind) { return (void *)value; }
 void * Repr   ::toPointer(bool bind) { return machineValue->toPointer(bind); }
+void * Lazy   ::toPointer(bool bind) { return get()->toPointer(bind); }
 
 
 // unsigned int pointer cast
@@ -243,6 +447,7 @@ unsigned long long Value  ::toUIntPtr(void) const { assert(0); return 0; }
 unsigned long long Null   ::toUIntPtr(void) const { return 0; }
 unsigned long long Pointer::toUIntPtr(void) const { return value; }
 unsigned long long Repr   ::toUIntPtr(void) const { return machineValue->toUIntPtr(); }
+unsigned long long Lazy   ::toUIntPtr(void) const { return get()->toUIntPtr(); }
 
 
 // string cast
@@ -250,6 +455,7 @@ const char * Value ::toString(void) const { assert(0); return NULL; }
 const char * Null  ::toString(void) const { return NULL; }
 const char * String::toString(void) const { return value; }
 const char * Repr  ::toString(void) const { return machineValue->toString(); }
+const char * Lazy  ::toString(void) const { return get()->toString(); }
 
 
 // virtual Value::visit()
@@ -268,6 +474,7 @@ void Array  ::visit(Visitor &visitor) { visitor.visit(this); }
 void Blob   ::visit(Visitor &visitor) { visitor.visit(this); }
 void Pointer::visit(Visitor &visitor) { visitor.visit(this); }
 void Repr   ::visit(Visitor &visitor) { visitor.visit(this); }
+void Lazy   ::visit(Visitor &visitor) { get()->visit(visitor); }
 
 
 void Visitor::visit(Null *) { assert(0); }
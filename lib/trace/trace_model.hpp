@@ -32,8 +32,12 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <map>
+#include <memory>
+#include <new>
+#include <utility>
 #include <vector>
 #include <ostream>
 
@@ -95,6 +99,7 @@ class Null;
 class Struct;
 class Array;
 class Blob;
+class Lazy;
 
 
 class Value
@@ -126,6 +131,8 @@ public:
     virtual const Blob *toBlob(void) const { return NULL; }
     virtual Blob *toBlob(void) { return NULL; }
 
+    virtual Lazy *toLazy(void) { return NULL; }
+
     Value & operator[](size_t index) const;
 };
 
@@ -233,13 +240,28 @@ class String : public Value
 {
 public:
     String(const char * _value) : value(_value) {}
+
+    // Refer to an immutable string owned by somebody else, e.g., the
+    // parser's table of interned strings, which will be kept alive for the
+    // lifetime of this value.
+    String(const char * _value, const std::shared_ptr<void> &_owner) :
+        value(_value),
+        owner(_owner)
+    {}
+
     ~String();
 
     bool toBool(void) const override;
     const char *toString(void) const override;
     void visit(Visitor &visitor) override;
 
+    // Replace the value, taking ownership of the new one
+    void reset(const char *_value);
+
     const char * value;
+
+private:
+    std::shared_ptr<void> owner;
 };
 
 
@@ -336,6 +358,16 @@ public:
         bound = false;
     }
 
+    // Refer to data owned by somebody else, e.g., the file reader's buffers,
+    // which will be kept alive for the lifetime of the blob.
+    Blob(size_t _size, const void *_buf, const std::shared_ptr<void> &_owner) :
+        owner(_owner)
+    {
+        size = _size;
+        buf = static_cast<char *>(const_cast<void *>(_buf));
+        bound = false;
+    }
+
     ~Blob();
 
     bool toBool(void) const override;
@@ -350,6 +382,9 @@ public:
     size_t size;
     char *buf;
     bool bound;
+
+private:
+    std::shared_ptr<void> owner;
 };
 
 
@@ -394,6 +429,59 @@ public:
     void visit(Visitor &visitor) override;
 };
 
+
+/**
+ * Value only decoded from the trace when first accessed, and otherwise
+ * indistinguishable from the decoded value, which everything is forwarded
+ * to.
+ */
+class Lazy : public Value
+{
+public:
+    Lazy() : decoded(nullptr) {}
+    ~Lazy();
+
+    inline Value *
+    get(void) const {
+        if (!decoded) {
+            decoded = decode();
+        }
+        return decoded;
+    }
+
+    bool toBool(void) const override;
+    signed long long toSInt(void) const override;
+    unsigned long long toUInt(void) const override;
+    float toFloat(void) const override;
+    double toDouble(void) const override;
+    void *toPointer(void) const override;
+    void *toPointer(bool bind) override;
+    unsigned long long toUIntPtr(void) const override;
+    const char *toString(void) const override;
+    void visit(Visitor &visitor) override;
+
+    const Null *toNull(void) const override { return get()->toNull(); }
+    Null *toNull(void) override { return get()->toNull(); }
+
+    const Array *toArray(void) const override { return get()->toArray(); }
+    Array *toArray(void) override { return get()->toArray(); }
+
+    const Struct *toStruct(void) const override { return get()->toStruct(); }
+    Struct *toStruct(void) override { return get()->toStruct(); }
+
+    const Blob *toBlob(void) const override { return get()->toBlob(); }
+    Blob *toBlob(void) override { return get()->toBlob(); }
+
+    Lazy *toLazy(void) override { return this; }
+
+    /** Decoded value, if already accessed */
+    mutable Value *decoded;
+
+protected:
+    virtual Value *decode(void) const = 0;
+};
+
+
 struct RawStackFrame {
     Id id;
     const char * module;
@@ -544,9 +632,142 @@ enum {
 };
 
 
+/**
+ * Call argument.
+ *
+ * Scalar values (nulls, booleans, numbers, enums, bitmasks and opaque
+ * pointers) may be stored inline, so that the arguments of most calls need
+ * no allocations and sit contiguously in memory.  Either way, `value` points
+ * to the argument's value, if any.
+ */
 struct Arg
 {
     Value *value;
+
+    Arg() : value(nullptr) {}
+
+    Arg(const Arg &other) {
+        copy(other);
+    }
+
+    Arg & operator = (const Arg &other) {
+        copy(other);
+        return *this;
+    }
+
+    inline bool
+    isInline(void) const {
+        return value == reinterpret_cast<const Value *>(storage);
+    }
+
+    /**
+     * Construct a scalar value inline.
+     */
+    template< class T, class... Args >
+    inline T *
+    emplace(Args&&... args) {
+        static_assert(sizeof(T) <= sizeof storage, "value too large to be stored inline");
+        T *scalar = new (storage) T(std::forward<Args>(args)...);
+        value = scalar;
+        return scalar;
+    }
+
+    /**
+     * Destroy the current value, and replace it with the given one.
+     */
+    void reset(Value *newValue = nullptr);
+
+private:
+    alignas(Enum) unsigned char storage[sizeof(Enum)];
+
+    // Inline values don't point to themselves, so they can be relocated by
+    // copying their bytes.
+    inline void
+    copy(const Arg &other) {
+        if (other.isInline()) {
+            memcpy(storage, other.storage, sizeof storage);
+            value = reinterpret_cast<Value *>(storage);
+        } else {
+            value = other.value;
+        }
+    }
+};
+
+
+/**
+ * Bump allocator, so that the many small values of a call can be allocated
+ * and released in bulk rather than one at a time from the heap.
+ *
+ * Objects created from an arena must not be deleted; their destructors are
+ * called explicitly instead, and their memory is released when the arena is
+ * cleared.
+ */
+class Arena
+{
+public:
+    Arena() :
+        head(nullptr),
+        next(nullptr),
+        end(nullptr),
+        blockSize(0),
+        allocated(0)
+    {}
+
+    ~Arena() {
+        clear();
+    }
+
+    Arena(const Arena &) = delete;
+    Arena & operator = (const Arena &) = delete;
+
+    inline void *
+    allocate(size_t size) {
+        size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        if (size > size_t(end - next)) {
+            return allocateBlock(size);
+        }
+        void *ptr = next;
+        next += size;
+        return ptr;
+    }
+
+    template< class T, class... Args >
+    inline T *
+    create(Args&&... args) {
+        return new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+    }
+
+    inline bool
+    empty(void) const {
+        return head == nullptr;
+    }
+
+    // Memory taken by the arena's blocks
+    inline size_t
+    size(void) const {
+        return allocated;
+    }
+
+    void clear(void);
+
+private:
+    enum {
+        ALIGNMENT = 8,
+        MIN_BLOCK_SIZE = 512,
+        MAX_BLOCK_SIZE = 8192,
+    };
+
+    struct alignas(ALIGNMENT) Block {
+        Block *next;
+    };
+
+    Block *head;
+    char *next;
+    char *end;
+    size_t blockSize;
+    size_t allocated;
+
+    void *allocateBlock(size_t size);
 };
 
 
@@ -562,6 +783,12 @@ public:
     CallFlags flags;
     Backtrace* backtrace;
 
+    // Where the values are allocated from, if the parser was asked to
+    Arena arena;
+
+    // Call this one is a shallow copy of, if any
+    std::shared_ptr<const Call> original;
+
     Call(const FunctionSig *_sig, const CallFlags &_flags, unsigned _thread_id) :
         thread_id(_thread_id), 
         sig(_sig), 
@@ -571,6 +798,22 @@ public:
         backtrace(0) {
     }
 
+    /**
+     * Make a shallow copy of a call, which refers to the same values, and
+     * keeps the call alive for as long as it exists.  The values must not be
+     * modified.
+     */
+    explicit Call(const std::shared_ptr<const Call> &_original) :
+        thread_id(_original->thread_id),
+        no(_original->no),
+        sig(_original->sig),
+        args(_original->args),
+        ret(_original->ret),
+        flags(_original->flags),
+        backtrace(_original->backtrace),
+        original(_original) {
+    }
+
     ~Call();
 
     inline const char *
@@ -586,6 +829,13 @@ public:
 
     Value &
     argByName(const char *argName);
+
+    /**
+     * Total size of the blobs passed to or returned by the call, including
+     * those within arrays and structures.
+     */
+    size_t
+    blobSize(void) const;
 };
 
 
@@ -39,14 +39,46 @@ public:
 
     virtual bool write(const void *buffer, size_t length) = 0;
     virtual void flush(void) = 0;
+
+    /**
+     * Called by the writer before every event.  Streams made of chunks
+     * which can be seeked to return true when they started a new one, in
+     * which case the writer must emit a synchronization event.
+     */
+    virtual bool beginEvent(void) {
+        return false;
+    }
+
+    /**
+     * Called when copying already written events (e.g., when repacking),
+     * before data which starts with a synchronization event, and spans the
+     * given length up to the next one.  Streams made of chunks start a new
+     * one there unless the data still fits in the current one.
+     */
+    virtual void beginSyncPoint(size_t length) {
+    }
 };
 
 
+/**
+ * Chunks are compressed on numThreads background threads, writing them in
+ * order.  Zero means the default, which is a single background thread
+ * on multi-core machines (see APITRACE_BACKGROUND_COMPRESSION).
+ */
 OutStream *
-createSnappyStream(const char *filename);
+createSnappyStream(const char *filename, unsigned numThreads = 0);
 
 OutStream *
 createZLibStream(const char *filename);
 
+#ifdef HAVE_ZSTD
+/**
+ * Level zero means Zstandard's default.  See createSnappyStream for
+ * numThreads.
+ */
+OutStream *
+createZstdStream(const char *filename, int level = 0, unsigned numThreads = 0);
+#endif
+
 
 } /* namespace trace */
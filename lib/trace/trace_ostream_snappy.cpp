@@ -28,30 +28,66 @@
 #include "trace_ostream.hpp"
 
 #include <fstream>
+#include <deque>
+#include <memory>
+#include <vector>
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include <snappy.h>
-
 #include "os.hpp"
+#include "os_thread.hpp"
+#include "trace_codec.hpp"
 #include "trace_snappy.hpp"
 
+// Number of chunk buffers when compressing in the background: one being
+// filled by the application, plus the ones queued for compression.  One more
+// is added for every additional compression thread.
+#define SNAPPY_NUM_BUFFERS 3
+
+// A new chunk is started before the next event once this much was written to
+// the current one, so that most chunks start with a synchronization event.
+// Events which don't fit still straddle chunks.
+#define SNAPPY_SYNC_THRESHOLD(chunkSize) ((chunkSize) - (chunkSize) / 16)
 
-#define SNAPPY_CHUNK_SIZE (1 * 1024 * 1024)
+// Minimum amount of uncompressed data between synchronization events.  Blobs
+// are only deduplicated between them, so this trades random access
+// granularity for smaller traces.
+#define SNAPPY_SYNC_INTERVAL (16 * 1024 * 1024)
 
 
 using namespace trace;
 
 
+/*
+ * Set on the background compression threads, to prevent them from waiting on
+ * themselves should they crash and trigger a flush.
+ */
+static OS_THREAD_SPECIFIC(uintptr_t)
+isCompressionThread;
+
+
+/*
+ * Chunks are compressed and written on a background thread, so that the
+ * traced application threads (which hold the LocalWriter mutex while
+ * writing) don't stall whenever a chunk fills up.  Set the
+ * APITRACE_BACKGROUND_COMPRESSION environment variable to zero to compress
+ * inline instead.
+ *
+ * When more compression threads are requested (e.g., by apitrace repack),
+ * chunks are compressed concurrently, each thread with its own codec, and
+ * written strictly in the order they were queued.
+ */
 class SnappyOutStream : public OutStream {
 public:
-    SnappyOutStream(const char *filename);
+    SnappyOutStream(const char *filename, ChunkCodec *codec, unsigned numThreads);
     ~SnappyOutStream();
 
-    SnappyOutStream(void);
     bool write(const void *buffer, size_t length) override;
     void flush(void) override;
+    bool beginEvent(void) override;
+    void beginSyncPoint(size_t length) override;
     bool isOpen(void) {
         return m_stream.is_open();
     }
@@ -74,49 +110,133 @@ private:
             return 0;
         }
     }
-    inline bool endOfData(void) const
-    {
-        return m_stream.eof() && freeCacheSize() == 0;
-    }
     void flushWriteCache(void);
-    void createCache(size_t size);
-    void writeCompressedLength(size_t length);
+    void countChunk(size_t length);
+    void writeChunk(const char *compressed, size_t compressedLength, bool sync);
+    void writeCompressedLength(size_t length, bool sync);
+
+    struct Buffer {
+        char *data;
+        size_t length;
+        bool sync;
+        // Order in which the compressed chunk must be written
+        uint64_t sequence;
+    };
+
+    /*
+     * Per-thread compression state.  The first one is used by whichever
+     * thread compresses inline or drains the queue.
+     */
+    struct Compressor {
+        ChunkCodec *codec;
+        char *compressed;
+    };
+
+    void queueBuffer(os::unique_lock<os::mutex> &lock);
+    void acquireBuffer(os::unique_lock<os::mutex> &lock);
+    void processBuffer(os::unique_lock<os::mutex> &lock, Compressor &compressor);
+    void drain(os::unique_lock<os::mutex> &lock);
+    static void compressionThread(SnappyOutStream *_this, unsigned index);
+    void compressionLoop(unsigned index);
 private:
+    std::unique_ptr<ChunkCodec> m_codec;
     std::ofstream m_stream;
-    size_t m_cacheMaxSize;
     size_t m_cacheSize;
     char *m_cache;
     char *m_cachePtr;
 
-    char *m_compressedCache;
+    // Whether the current chunk starts with a synchronization event
+    bool m_cacheSync;
+
+    // Uncompressed bytes in the chunks since the last synchronization event
+    uint64_t m_syncDistance;
+
+    std::vector<Compressor> m_compressors;
+
+    /*
+     * Background compression state.  The queue, buffers, and counters are
+     * protected by m_mutex; m_stream is only touched by the thread whose
+     * buffer sequence matches m_nextWrite, and each compressor by the thread
+     * using it.
+     */
+    bool m_threaded;
+    std::vector<os::thread> m_threads;
+    os::mutex m_mutex;
+    os::condition_variable m_cond;
+    std::deque<Buffer> m_queue;
+    std::vector<char *> m_freeBuffers;
+    uint64_t m_nextSequence;
+    uint64_t m_nextWrite;
+    unsigned m_busy;
+    bool m_stopping;
 };
 
-SnappyOutStream::SnappyOutStream(const char *filename)
-    : m_cacheMaxSize(SNAPPY_CHUNK_SIZE),
-      m_cacheSize(m_cacheMaxSize),
-      m_cache(new char [m_cacheMaxSize]),
-      m_cachePtr(m_cache)
+SnappyOutStream::SnappyOutStream(const char *filename, ChunkCodec *codec,
+                                 unsigned numThreads)
+    : m_codec(codec),
+      m_cacheSize(codec->chunkSize),
+      m_cache(new char [m_cacheSize]),
+      m_cachePtr(m_cache),
+      m_cacheSync(false),
+      m_syncDistance(0),
+      m_threaded(false),
+      m_nextSequence(0),
+      m_nextWrite(0),
+      m_busy(0),
+      m_stopping(false)
 {
-    size_t maxCompressedLength =
-        snappy::MaxCompressedLength(SNAPPY_CHUNK_SIZE);
-    m_compressedCache = new char[maxCompressedLength];
-    
     std::ios_base::openmode fmode = std::fstream::binary
                                   | std::fstream::out
                                   | std::fstream::trunc;
     m_stream.open(filename, fmode);
     if (m_stream.is_open()) {
-        m_stream << SNAPPY_BYTE1;
-        m_stream << SNAPPY_BYTE2;
+        m_stream << m_codec->byte1;
+        m_stream << m_codec->byte2;
         m_stream.flush();
+
+        if (numThreads == 0) {
+#ifdef _WIN32
+            // Joining threads from DllMain at unload time can deadlock
+            m_threaded = false;
+#else
+            m_threaded = os::thread::hardware_concurrency() > 1;
+#endif
+            const char *background = getenv("APITRACE_BACKGROUND_COMPRESSION");
+            if (background) {
+                m_threaded = atoi(background) != 0;
+            }
+            numThreads = m_threaded ? 1 : 0;
+        } else {
+            m_threaded = true;
+        }
+    }
+
+    size_t maxCompressedLength = m_codec->maxCompressedLength(m_cacheSize);
+    m_compressors.resize(1 + numThreads);
+    for (unsigned i = 0; i < m_compressors.size(); ++i) {
+        m_compressors[i].codec = i ? m_codec->clone() : m_codec.get();
+        m_compressors[i].compressed = new char[maxCompressedLength];
+    }
+
+    if (m_threaded) {
+        for (unsigned i = 1; i < SNAPPY_NUM_BUFFERS + numThreads - 1; ++i) {
+            m_freeBuffers.push_back(new char[m_cacheSize]);
+        }
+        for (unsigned i = 1; i <= numThreads; ++i) {
+            m_threads.emplace_back(compressionThread, this, i);
+        }
     }
 }
 
 SnappyOutStream::~SnappyOutStream()
 {
     close();
-    delete [] m_compressedCache;
-    delete [] m_cache;
+    for (unsigned i = 0; i < m_compressors.size(); ++i) {
+        if (i) {
+            delete m_compressors[i].codec;
+        }
+        delete [] m_compressors[i].compressed;
+    }
 }
 
 bool SnappyOutStream::write(const void *buffer, size_t length)
@@ -151,6 +271,29 @@ bool SnappyOutStream::write(const void *buffer, size_t length)
 
 void SnappyOutStream::close(void)
 {
+    if (m_threaded) {
+        if (!m_threads.empty()) {
+            m_mutex.lock();
+            m_stopping = true;
+            m_mutex.unlock();
+            m_cond.notify_all();
+            for (auto &thread : m_threads) {
+                thread.join();
+            }
+            m_threads.clear();
+        }
+
+        // Compress whatever is left on this thread
+        os::unique_lock<os::mutex> lock(m_mutex);
+        drain(lock);
+        m_threaded = false;
+
+        for (auto buffer : m_freeBuffers) {
+            delete [] buffer;
+        }
+        m_freeBuffers.clear();
+    }
+
     flushWriteCache();
     m_stream.close();
     delete [] m_cache;
@@ -160,6 +303,19 @@ void SnappyOutStream::close(void)
 
 void SnappyOutStream::flush(void)
 {
+    if (m_threaded) {
+        // Synchronously compress and write everything queued so far
+        os::unique_lock<os::mutex> lock(m_mutex);
+        if (usedCacheSize()) {
+            queueBuffer(lock);
+        }
+        drain(lock);
+        if (!m_busy) {
+            m_stream.flush();
+        }
+        return;
+    }
+
     flushWriteCache();
     m_stream.flush();
 }
@@ -169,20 +325,77 @@ void SnappyOutStream::flushWriteCache(void)
     size_t inputLength = usedCacheSize();
 
     if (inputLength) {
-        size_t compressedLength;
+        if (m_threaded) {
+            // Hand over the buffer to the compression threads
+            os::unique_lock<os::mutex> lock(m_mutex);
+            queueBuffer(lock);
+            m_cond.notify_all();
+        } else {
+            Compressor &compressor = m_compressors[0];
+            size_t compressedLength =
+                compressor.codec->compress(m_cache, inputLength,
+                                           compressor.compressed);
+            writeChunk(compressor.compressed, compressedLength, m_cacheSync);
+            countChunk(inputLength);
+            m_cachePtr = m_cache;
+        }
+        m_cacheSync = false;
+    }
+    assert(m_cachePtr == m_cache);
+}
 
-        ::snappy::RawCompress(m_cache, inputLength,
-                              m_compressedCache, &compressedLength);
+void SnappyOutStream::countChunk(size_t length)
+{
+    if (m_cacheSync) {
+        m_syncDistance = length;
+    } else {
+        m_syncDistance += length;
+    }
+}
 
-        writeCompressedLength(compressedLength);
-        m_stream.write(m_compressedCache, compressedLength);
-        m_cachePtr = m_cache;
+bool SnappyOutStream::beginEvent(void)
+{
+    size_t used = usedCacheSize();
+    if (used < SNAPPY_SYNC_THRESHOLD(m_cacheSize) ||
+        m_syncDistance + used < SNAPPY_SYNC_INTERVAL) {
+        return false;
     }
-    assert(m_cachePtr == m_cache);
+
+    flushWriteCache();
+    m_cacheSync = true;
+    return true;
+}
+
+void SnappyOutStream::beginSyncPoint(size_t length)
+{
+    size_t used = usedCacheSize();
+    if (used >= SNAPPY_SYNC_THRESHOLD(m_cacheSize) ||
+        (used > 0 && used + length > m_cacheSize)) {
+        flushWriteCache();
+    }
+    if (usedCacheSize() == 0) {
+        m_cacheSync = true;
+    }
+}
+
+void SnappyOutStream::writeChunk(const char *compressed, size_t compressedLength, bool sync)
+{
+    if (!compressedLength) {
+        os::log("apitrace: error: failed to compress trace chunk\n");
+        return;
+    }
+
+    writeCompressedLength(compressedLength, sync);
+    m_stream.write(compressed, compressedLength);
 }
 
-void SnappyOutStream::writeCompressedLength(size_t length)
+void SnappyOutStream::writeCompressedLength(size_t length, bool sync)
 {
+    assert(length < SNAPPY_SYNC_FLAG);
+    if (sync) {
+        length |= SNAPPY_SYNC_FLAG;
+    }
+
     unsigned char buf[4];
     buf[0] = length & 0xff; length >>= 8;
     buf[1] = length & 0xff; length >>= 8;
@@ -192,11 +405,113 @@ void SnappyOutStream::writeCompressedLength(size_t length)
     m_stream.write((const char *)buf, sizeof buf);
 }
 
+/*
+ * Queue the current buffer for compression, and make a free one current.
+ * Must be called with the mutex held.
+ */
+void SnappyOutStream::queueBuffer(os::unique_lock<os::mutex> &lock)
+{
+    m_queue.push_back({m_cache, usedCacheSize(), m_cacheSync, m_nextSequence++});
+    countChunk(usedCacheSize());
+    m_cacheSync = false;
+    acquireBuffer(lock);
+}
+
+/*
+ * Make a free buffer current, waiting for the compression threads to release
+ * one if necessary.
+ */
+void SnappyOutStream::acquireBuffer(os::unique_lock<os::mutex> &lock)
+{
+    while (m_freeBuffers.empty()) {
+        m_cond.wait(lock);
+    }
+    m_cache = m_freeBuffers.back();
+    m_freeBuffers.pop_back();
+    m_cachePtr = m_cache;
+}
+
+/*
+ * Compress the oldest queued buffer, and write it once all the buffers queued
+ * before it were written.  Must be called with the mutex held.
+ */
+void SnappyOutStream::processBuffer(os::unique_lock<os::mutex> &lock,
+                                    Compressor &compressor)
+{
+    assert(!m_queue.empty());
+
+    Buffer buffer = m_queue.front();
+    m_queue.pop_front();
+    ++m_busy;
+
+    lock.unlock();
+    size_t compressedLength =
+        compressor.codec->compress(buffer.data, buffer.length,
+                                   compressor.compressed);
+    lock.lock();
+
+    while (m_nextWrite != buffer.sequence) {
+        m_cond.wait(lock);
+    }
+
+    lock.unlock();
+    writeChunk(compressor.compressed, compressedLength, buffer.sync);
+    lock.lock();
+
+    ++m_nextWrite;
+    --m_busy;
+    m_freeBuffers.push_back(buffer.data);
+    m_cond.notify_all();
+}
+
+/*
+ * Process all queued buffers on the calling thread, and wait for any buffer
+ * being processed by the compression threads, so that everything queued was
+ * written once this returns.
+ */
+void SnappyOutStream::drain(os::unique_lock<os::mutex> &lock)
+{
+    while (!m_queue.empty() || m_busy) {
+        if (m_busy && isCompressionThread) {
+            // We crashed while compressing, so there is nothing we can
+            // safely do.
+            return;
+        }
+        if (m_queue.empty()) {
+            m_cond.wait(lock);
+        } else {
+            processBuffer(lock, m_compressors[0]);
+        }
+    }
+}
+
+void SnappyOutStream::compressionThread(SnappyOutStream *_this, unsigned index)
+{
+    isCompressionThread = 1;
+    _this->compressionLoop(index);
+}
+
+void SnappyOutStream::compressionLoop(unsigned index)
+{
+    os::unique_lock<os::mutex> lock(m_mutex);
+
+    while (true) {
+        while (!m_stopping && m_queue.empty()) {
+            m_cond.wait(lock);
+        }
+        if (m_stopping) {
+            break;
+        }
+        processBuffer(lock, m_compressors[index]);
+    }
+}
+
 
 OutStream *
-trace::createSnappyStream(const char *filename)
+trace::createChunkedStream(const char *filename, ChunkCodec *codec,
+                           unsigned numThreads)
 {
-    SnappyOutStream *outStream = new SnappyOutStream(filename);
+    SnappyOutStream *outStream = new SnappyOutStream(filename, codec, numThreads);
     if (!outStream->isOpen()) {
         os::log("error: could not open %s for writing\n", filename);
         delete outStream;
@@ -205,3 +520,10 @@ trace::createSnappyStream(const char *filename)
 
     return outStream;
 }
+
+
+OutStream *
+trace::createSnappyStream(const char *filename, unsigned numThreads)
+{
+    return createChunkedStream(filename, createSnappyCodec(), numThreads);
+}
@@ -29,21 +29,45 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "trace_file.hpp"
 #include "trace_dump.hpp"
+#include "trace_index.hpp"
 #include "trace_parser.hpp"
 
 
 #define TRACE_VERBOSE 0
 
+// Strings are interned up to this length, and until the table holds this
+// much
+#define STRING_INTERN_MAX_LENGTH (1024 * 1024)
+#define STRING_INTERN_MAX_SIZE (16 * 1024 * 1024)
+
+// Blobs at least this large are referred in place when the file allows it,
+// instead of being copied.  Smaller ones aren't worth pinning the file
+// reader's buffers for.
+#define BLOB_IN_PLACE_MIN_SIZE (4 * 1024)
+
 
 namespace trace {
 
 
-Parser::Parser() {
+Parser::Parser() :
+    blobs("blob", IndexSignature::BLOB, false),
+    strings("string", IndexSignature::STRING, true)
+{
     file = NULL;
     next_call_no = 0;
     version = 0;
+    index = NULL;
+    indexRefs = NULL;
+    useCallArenas = false;
+    useLazyArgs = false;
+    useInternedStrings = true;
+    internedSize = 0;
+    detailsSize = 0;
+    arena = NULL;
     api = API_UNKNOWN;
 
     glGetErrorSig = NULL;
@@ -57,6 +81,11 @@ Parser::~Parser() {
 
 bool Parser::open(const char *filename) {
     assert(!file);
+    if (isCompiledTrace(filename)) {
+        std::cerr << "error: " << filename << " is a compiled trace, which can only be dumped or replayed\n";
+        return false;
+    }
+
     file = File::createForRead(filename);
     if (!file) {
         return false;
@@ -71,27 +100,92 @@ bool Parser::open(const char *filename) {
     }
     api = API_UNKNOWN;
 
+    this->filename = filename;
+    getBookmark(startBookmark);
+    add_ref_scan_point(startBookmark.offset);
+
     return true;
 }
 
-template <typename Iter>
-inline void
-deleteAll(Iter begin, Iter end)
-{
-    while (begin != end) {
-        delete *begin;
-        ++begin;
+
+void Parser::PendingCalls::push_back(Call *call, size_t size) {
+    while (!list.empty() &&
+           (list.size() >= PARSER_MAX_PENDING_CALLS ||
+            totalSize + size > PARSER_MAX_PENDING_SIZE)) {
+        Call *oldest = pop_front();
+        if (!dropped) {
+            std::cerr << "warning: too many calls pending; dropping call " << oldest->no << " and others never left\n";
+            dropped = true;
+        }
+        delete oldest;
     }
+
+    Entry entry;
+    entry.call = call;
+    entry.size = size;
+    list.push_back(entry);
+    List::iterator it = list.end();
+    --it;
+    if (!byNo.insert(std::make_pair(call->no, it)).second) {
+        // Only malformed traces reuse call numbers; the older call can't be
+        // told apart anymore
+        delete remove(byNo[call->no]);
+        byNo[call->no] = it;
+    }
+    totalSize += size;
 }
 
-template <typename Container>
-inline void
-deleteAll(Container &c)
-{
-    deleteAll(c.begin(), c.end());
-    c.clear();
+
+Call *Parser::PendingCalls::take(unsigned no) {
+    // Calls are usually left right after being entered
+    if (!list.empty() && list.back().call->no == no) {
+        return pop_back();
+    }
+
+    auto found = byNo.find(no);
+    if (found == byNo.end()) {
+        return NULL;
+    }
+    return remove(found->second);
+}
+
+
+Call *Parser::PendingCalls::pop_front(void) {
+    assert(!list.empty());
+    return remove(list.begin());
+}
+
+
+Call *Parser::PendingCalls::pop_back(void) {
+    assert(!list.empty());
+    List::iterator it = list.end();
+    --it;
+    return remove(it);
+}
+
+
+Call *Parser::PendingCalls::remove(List::iterator it) {
+    Call *call = it->call;
+    auto found = byNo.find(call->no);
+    if (found != byNo.end() && found->second == it) {
+        byNo.erase(found);
+    }
+    totalSize -= it->size;
+    list.erase(it);
+    return call;
 }
 
+
+void Parser::PendingCalls::clear(void) {
+    for (auto & entry : list) {
+        delete entry.call;
+    }
+    list.clear();
+    byNo.clear();
+    totalSize = 0;
+}
+
+
 void Parser::close(void) {
     if (file) {
         file->close();
@@ -99,7 +193,16 @@ void Parser::close(void) {
         file = NULL;
     }
 
-    deleteAll(calls);
+    delete index;
+    index = NULL;
+
+    calls.clear();
+
+    blobs.clear();
+    strings.clear();
+    refScanPoints.clear();
+    internedStrings.clear();
+    internedSize = 0;
 
     // Delete all signature data.  Signatures are mere structures which don't
     // own their own memory, so we need to destroy all data we created here.
@@ -165,7 +268,311 @@ void Parser::setBookmark(const ParseBookmark &bookmark) {
     next_call_no = bookmark.next_call_no;
     
     // Simply ignore all pending calls
-    deleteAll(calls);
+    calls.clear();
+}
+
+
+const Index *Parser::getIndex(bool build) {
+    if (index) {
+        return index;
+    }
+
+    if (!file || !file->supportsOffsets()) {
+        return NULL;
+    }
+
+    index = new Index;
+    std::string indexFilename = Index::getFilename(filename.c_str());
+    if (index->load(indexFilename.c_str(), filename.c_str())) {
+        return index;
+    }
+
+    if (!build) {
+        delete index;
+        index = NULL;
+        return NULL;
+    }
+
+    ParseBookmark bookmark;
+    getBookmark(bookmark);
+    buildIndex(*index);
+    setBookmark(bookmark);
+
+    // Failing to save the index (e.g., read-only directory) is not fatal
+    index->save(indexFilename.c_str(), filename.c_str());
+
+    return index;
+}
+
+
+bool Parser::jumpToCall(unsigned call_no) {
+    if (!getIndex()) {
+        return false;
+    }
+
+    const ParseBookmark *bookmark = index->findCall(call_no);
+    if (!bookmark) {
+        return false;
+    }
+
+    loadSignatures(bookmark->offset);
+    setBookmark(*bookmark);
+    add_ref_scan_point(bookmark->offset);
+    return skipToCall(call_no);
+}
+
+
+bool Parser::jumpToFrame(unsigned frame_no) {
+    if (!getIndex() || frame_no >= index->frames.size()) {
+        return false;
+    }
+
+    const ParseBookmark &bookmark = index->frames[frame_no].start;
+    loadSignatures(bookmark.offset);
+    setBookmark(bookmark);
+    add_ref_scan_point(bookmark.offset);
+    return true;
+}
+
+
+bool Parser::jumpToSyncPoint(const File::Offset &offset) {
+    File::Offset syncOffset = offset;
+    if (version < 6 || !file->findSyncPoint(syncOffset)) {
+        return false;
+    }
+
+    file->setCurrentOffset(syncOffset);
+    calls.clear();
+
+    int c = read_byte();
+    if (c != trace::EVENT_SYNC) {
+        std::cerr << "error: expected synchronization event\n";
+        return false;
+    }
+    parse_sync();
+    return true;
+}
+
+
+/**
+ * Scan the whole trace, recording frame and call bookmarks, and where
+ * signatures are defined.
+ */
+void Parser::buildIndex(Index &index) {
+    index.frames.clear();
+    index.calls.clear();
+    index.signatures.clear();
+    index.refs.clear();
+
+    setBookmark(startBookmark);
+
+    // Blob and string definitions since the last synchronization event, which
+    // are only indexed if a bookmark follows them
+    std::vector<IndexRef> refs;
+    indexRefs = &refs;
+    auto flushRefs = [&]() {
+        index.refs.insert(index.refs.end(), refs.begin(), refs.end());
+        refs.clear();
+    };
+
+    IndexFrame frame;
+    frame.start = startBookmark;
+    frame.numCalls = 0;
+    frame.lastCall = 0;
+
+    ParseBookmark bookmark;
+    while (true) {
+        getBookmark(bookmark);
+        int c = read_byte();
+        if (c == trace::EVENT_ENTER) {
+            if (next_call_no % index.callInterval == 0) {
+                index.calls.push_back(bookmark);
+                flushRefs();
+            }
+            parse_enter(SCAN);
+        } else if (c == trace::EVENT_SYNC) {
+            parse_sync();
+            refs.clear();
+        } else if (c == trace::EVENT_LEAVE) {
+            Call *call = parse_leave(SCAN);
+            if (call) {
+                adjust_call_flags(call);
+                ++frame.numCalls;
+                if (call->flags & CALL_FLAG_END_FRAME) {
+                    frame.lastCall = call->no;
+                    index.frames.push_back(frame);
+                    getBookmark(frame.start);
+                    flushRefs();
+                    frame.numCalls = 0;
+                }
+                delete call;
+            }
+        } else if (c == -1) {
+            break;
+        } else {
+            std::cerr << "error: unknown event " << c << "\n";
+            exit(1);
+        }
+    }
+
+    // Incomplete calls are returned at the end of the trace
+    while (!calls.empty()) {
+        Call *call = calls.pop_front();
+        ++frame.numCalls;
+        frame.lastCall = call->no;
+        delete call;
+    }
+
+    if (frame.numCalls) {
+        index.frames.push_back(frame);
+    }
+
+    IndexSignature signature;
+    for (auto sig : functions) {
+        if (sig) {
+            signature.kind = IndexSignature::FUNCTION;
+            signature.id = sig->id;
+            signature.offset = sig->definitionOffset;
+            index.signatures.push_back(signature);
+        }
+    }
+    for (auto sig : structs) {
+        if (sig) {
+            signature.kind = IndexSignature::STRUCT;
+            signature.id = sig->id;
+            signature.offset = sig->definitionOffset;
+            index.signatures.push_back(signature);
+        }
+    }
+    for (auto sig : enums) {
+        if (sig) {
+            signature.kind = IndexSignature::ENUM;
+            signature.id = sig->id;
+            signature.offset = sig->definitionOffset;
+            index.signatures.push_back(signature);
+        }
+    }
+    for (auto sig : bitmasks) {
+        if (sig) {
+            signature.kind = IndexSignature::BITMASK;
+            signature.id = sig->id;
+            signature.offset = sig->definitionOffset;
+            index.signatures.push_back(signature);
+        }
+    }
+    for (unsigned id = 0; id < frames.size(); ++id) {
+        if (frames[id]) {
+            signature.kind = IndexSignature::FRAME;
+            signature.id = id;
+            signature.offset = frames[id]->definitionOffset;
+            index.signatures.push_back(signature);
+        }
+    }
+    std::sort(index.signatures.begin(), index.signatures.end(),
+              [](const IndexSignature &a, const IndexSignature &b) {
+                  return a.offset < b.offset;
+              });
+
+    indexRefs = NULL;
+    std::sort(index.refs.begin(), index.refs.end(),
+              [](const IndexRef &a, const IndexRef &b) {
+                  return a.kind < b.kind || (a.kind == b.kind && a.id < b.id);
+              });
+}
+
+
+/**
+ * Parse all signature definitions preceding the given offset which weren't
+ * seen yet, as if the trace had been parsed up to there.
+ */
+void Parser::loadSignatures(const File::Offset &offset) {
+    assert(index);
+
+    for (auto & signature : index->signatures) {
+        if (!(signature.offset < offset)) {
+            break;
+        }
+
+        bool known;
+        switch (signature.kind) {
+        case IndexSignature::FUNCTION:
+            known = signature.id < functions.size() && functions[signature.id];
+            break;
+        case IndexSignature::STRUCT:
+            known = signature.id < structs.size() && structs[signature.id];
+            break;
+        case IndexSignature::ENUM:
+            known = signature.id < enums.size() && enums[signature.id];
+            break;
+        case IndexSignature::BITMASK:
+            known = signature.id < bitmasks.size() && bitmasks[signature.id];
+            break;
+        case IndexSignature::FRAME:
+            known = signature.id < frames.size() && frames[signature.id];
+            break;
+        default:
+            assert(0);
+            known = true;
+        }
+        if (known) {
+            continue;
+        }
+
+        file->setCurrentOffset(signature.offset);
+        switch (signature.kind) {
+        case IndexSignature::FUNCTION:
+            parse_function_sig();
+            break;
+        case IndexSignature::STRUCT:
+            parse_struct_sig();
+            break;
+        case IndexSignature::ENUM:
+            if (version >= 3) {
+                parse_enum_sig();
+            } else {
+                parse_old_enum_sig();
+            }
+            break;
+        case IndexSignature::BITMASK:
+            parse_bitmask_sig();
+            break;
+        case IndexSignature::FRAME:
+            parse_backtrace_frame(FULL);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+
+/**
+ * Skip events until right before the enter event of the given call.
+ */
+bool Parser::skipToCall(unsigned call_no) {
+    while (next_call_no < call_no) {
+        int c = read_byte();
+        switch (c) {
+        case trace::EVENT_ENTER:
+            parse_enter(SKIP);
+            break;
+        case trace::EVENT_LEAVE:
+            delete parse_leave(SKIP);
+            break;
+        case trace::EVENT_SYNC:
+            parse_sync();
+            break;
+        case -1:
+            calls.clear();
+            return false;
+        default:
+            std::cerr << "error: unknown event " << c << "\n";
+            exit(1);
+        }
+    }
+
+    calls.clear();
+    return true;
 }
 
 
@@ -190,14 +597,19 @@ Call *Parser::parse_call(Mode mode) {
                 return call;
             }
             break;
+        case trace::EVENT_SYNC:
+#if TRACE_VERBOSE
+            std::cerr << "\tSYNC\n";
+#endif
+            parse_sync();
+            break;
         default:
             std::cerr << "error: unknown event " << c << "\n";
             exit(1);
         case -1:
             if (!calls.empty()) {
-                call = calls.front();
+                call = calls.pop_front();
                 call->flags |= CALL_FLAG_INCOMPLETE;
-                calls.pop_front();
                 adjust_call_flags(call);
                 return call;
             }
@@ -221,15 +633,46 @@ T *lookup(std::vector<T *> &map, size_t index) {
 }
 
 
+/**
+ * Read a signature ID.
+ *
+ * Since version 6 its least significant bit tells whether the signature
+ * definition follows.  Before that it can only be told from whether the
+ * signature was seen before, and where.
+ */
+size_t Parser::read_sig_id(bool &definition) {
+    size_t id = read_uint();
+    if (version >= 6) {
+        definition = id & 1;
+        return id >> 1;
+    }
+    definition = false;
+    return id;
+}
+
+
+void Parser::undefined_sig(size_t id) {
+    std::cerr << "error: reference to undefined signature " << id << "\n";
+    exit(1);
+}
+
+
 Parser::FunctionSigFlags *
 Parser::parse_function_sig(void) {
-    size_t id = read_uint();
+    File::Offset offset = file->currentOffset();
+    bool definition;
+    size_t id = read_sig_id(definition);
 
     FunctionSigState *sig = lookup(functions, id);
 
     if (!sig) {
+        if (version >= 6 && !definition) {
+            undefined_sig(id);
+        }
+
         /* parse the signature */
         sig = new FunctionSigState;
+        sig->definitionOffset = offset;
         sig->id = id;
         sig->name = read_string();
         sig->num_args = read_uint();
@@ -277,7 +720,8 @@ Parser::parse_function_sig(void) {
             glGetErrorSig = sig;
         }
 
-    } else if (file->currentOffset() < sig->fileOffset) {
+    } else if (definition ||
+               (version < 6 && file->currentOffset() < sig->fileOffset)) {
         /* skip over the signature */
         skip_string(); /* name */
         unsigned num_args = read_uint();
@@ -292,13 +736,20 @@ Parser::parse_function_sig(void) {
 
 
 StructSig *Parser::parse_struct_sig() {
-    size_t id = read_uint();
+    File::Offset offset = file->currentOffset();
+    bool definition;
+    size_t id = read_sig_id(definition);
 
     StructSigState *sig = lookup(structs, id);
 
     if (!sig) {
+        if (version >= 6 && !definition) {
+            undefined_sig(id);
+        }
+
         /* parse the signature */
         sig = new StructSigState;
+        sig->definitionOffset = offset;
         sig->id = id;
         sig->name = read_string();
         sig->num_members = read_uint();
@@ -309,7 +760,8 @@ StructSig *Parser::parse_struct_sig() {
         sig->member_names = member_names;
         sig->fileOffset = file->currentOffset();
         structs[id] = sig;
-    } else if (file->currentOffset() < sig->fileOffset) {
+    } else if (definition ||
+               (version < 6 && file->currentOffset() < sig->fileOffset)) {
         /* skip over the signature */
         skip_string(); /* name */
         unsigned num_members = read_uint();
@@ -330,6 +782,7 @@ StructSig *Parser::parse_struct_sig() {
  *            | id
  */
 EnumSig *Parser::parse_old_enum_sig() {
+    File::Offset offset = file->currentOffset();
     size_t id = read_uint();
 
     EnumSigState *sig = lookup(enums, id);
@@ -337,6 +790,7 @@ EnumSig *Parser::parse_old_enum_sig() {
     if (!sig) {
         /* parse the signature */
         sig = new EnumSigState;
+        sig->definitionOffset = offset;
         sig->id = id;
         sig->num_values = 1;
         EnumValue *values = new EnumValue[sig->num_values];
@@ -357,13 +811,20 @@ EnumSig *Parser::parse_old_enum_sig() {
 
 
 EnumSig *Parser::parse_enum_sig() {
-    size_t id = read_uint();
+    File::Offset offset = file->currentOffset();
+    bool definition;
+    size_t id = read_sig_id(definition);
 
     EnumSigState *sig = lookup(enums, id);
 
     if (!sig) {
+        if (version >= 6 && !definition) {
+            undefined_sig(id);
+        }
+
         /* parse the signature */
         sig = new EnumSigState;
+        sig->definitionOffset = offset;
         sig->id = id;
         sig->num_values = read_uint();
         EnumValue *values = new EnumValue[sig->num_values];
@@ -374,7 +835,8 @@ EnumSig *Parser::parse_enum_sig() {
         sig->values = values;
         sig->fileOffset = file->currentOffset();
         enums[id] = sig;
-    } else if (file->currentOffset() < sig->fileOffset) {
+    } else if (definition ||
+               (version < 6 && file->currentOffset() < sig->fileOffset)) {
         /* skip over the signature */
         int num_values = read_uint();
         for (int i = 0; i < num_values; ++i) {
@@ -389,13 +851,20 @@ EnumSig *Parser::parse_enum_sig() {
 
 
 BitmaskSig *Parser::parse_bitmask_sig() {
-    size_t id = read_uint();
+    File::Offset offset = file->currentOffset();
+    bool definition;
+    size_t id = read_sig_id(definition);
 
     BitmaskSigState *sig = lookup(bitmasks, id);
 
     if (!sig) {
+        if (version >= 6 && !definition) {
+            undefined_sig(id);
+        }
+
         /* parse the signature */
         sig = new BitmaskSigState;
+        sig->definitionOffset = offset;
         sig->id = id;
         sig->num_flags = read_uint();
         BitmaskFlag *flags = new BitmaskFlag[sig->num_flags];
@@ -409,7 +878,8 @@ BitmaskSig *Parser::parse_bitmask_sig() {
         sig->flags = flags;
         sig->fileOffset = file->currentOffset();
         bitmasks[id] = sig;
-    } else if (file->currentOffset() < sig->fileOffset) {
+    } else if (definition ||
+               (version < 6 && file->currentOffset() < sig->fileOffset)) {
         /* skip over the signature */
         int num_flags = read_uint();
         for (int i = 0; i < num_flags; ++i) {
@@ -438,24 +908,32 @@ void Parser::parse_enter(Mode mode) {
 
     call->no = next_call_no++;
 
-    if (parse_call_details(call, mode)) {
-        calls.push_back(call);
+    arena = useCallArenas ? &call->arena : NULL;
+    detailsSize = 0;
+    bool complete = parse_call_details(call, mode);
+    arena = NULL;
+
+    if (complete) {
+        calls.push_back(call, sizeof *call + call->args.size() * sizeof(Arg) + detailsSize);
     } else {
         delete call;
     }
 }
 
 
+void Parser::parse_sync(void) {
+    next_call_no = read_uint();
+
+    // Blobs and strings defined before can't be referred from here on
+    blobs.clear();
+    strings.clear();
+    add_ref_scan_point(file->currentOffset());
+}
+
+
 Call *Parser::parse_leave(Mode mode) {
     unsigned call_no = read_uint();
-    Call *call = NULL;
-    for (CallList::iterator it = calls.begin(); it != calls.end(); ++it) {
-        if ((*it)->no == call_no) {
-            call = *it;
-            calls.erase(it);
-            break;
-        }
-    }
+    Call *call = calls.take(call_no);
     if (!call) {
         /* This might happen on random access, when an asynchronous call is stranded
          * between two frames.  We won't return this call, but we still need to skip 
@@ -468,7 +946,11 @@ Call *Parser::parse_leave(Mode mode) {
         return NULL;
     }
 
-    if (parse_call_details(call, mode)) {
+    arena = useCallArenas ? &call->arena : NULL;
+    bool complete = parse_call_details(call, mode);
+    arena = NULL;
+
+    if (complete) {
         return call;
     } else {
         delete call;
@@ -504,6 +986,17 @@ bool Parser::parse_call_details(Call *call, Mode mode) {
 #endif
             parse_call_backtrace(call, mode);
             break;
+        case trace::CALL_LENGTH:
+#if TRACE_VERBOSE
+            std::cerr << "\tCALL_LENGTH\n";
+#endif
+            if (mode == FULL) {
+                skip_uint();
+            } else {
+                // Skip the remaining details in one go
+                return file->skip(read_uint());
+            }
+            break;
         default:
             std::cerr << "error: ("<<call->name()<< ") unknown call detail "
                       << c << "\n";
@@ -525,12 +1018,19 @@ bool Parser::parse_call_backtrace(Call *call, Mode mode) {
 }
 
 StackFrame * Parser::parse_backtrace_frame(Mode mode) {
-    size_t id = read_uint();
+    File::Offset offset = file->currentOffset();
+    bool definition;
+    size_t id = read_sig_id(definition);
 
     StackFrameState *frame = lookup(frames, id);
 
     if (!frame) {
+        if (version >= 6 && !definition) {
+            undefined_sig(id);
+        }
+
         frame = new StackFrameState;
+        frame->definitionOffset = offset;
         int c = read_byte();
         while (c != trace::BACKTRACE_END &&
                c != -1) {
@@ -560,7 +1060,8 @@ StackFrame * Parser::parse_backtrace_frame(Mode mode) {
 
         frame->fileOffset = file->currentOffset();
         frames[id] = frame;
-    } else if (file->currentOffset() < frame->fileOffset) {
+    } else if (definition ||
+               (version < 6 && file->currentOffset() < frame->fileOffset)) {
         int c = read_byte();
         while (c != trace::BACKTRACE_END &&
                c != -1) {
@@ -609,50 +1110,117 @@ void Parser::adjust_call_flags(Call *call) {
 
 void Parser::parse_arg(Call *call, Mode mode) {
     unsigned index = read_uint();
-    Value *value = parse_value(mode);
-    if (value) {
-        if (index >= call->args.size()) {
-            call->args.resize(index + 1);
-        }
-        call->args[index].value = value;
+    if (mode != FULL) {
+        scan_value();
+        return;
+    }
+    if (index >= call->args.size()) {
+        call->args.resize(index + 1);
+    }
+    Arg &arg = call->args[index];
+    if (useLazyArgs && file->supportsOffsets()) {
+        arg.value = parse_lazy_value(&arg);
+    } else {
+        arg.value = parse_value(&arg);
     }
 }
 
 
-Value *Parser::parse_value(void) {
-    int c;
+class Parser::LazyValue : public Lazy
+{
+public:
+    LazyValue(Parser *_parser, const File::Offset &_offset, Arena *_arena) :
+        parser(_parser),
+        offset(_offset),
+        arena(_arena)
+    {}
+
+protected:
+    Value *decode(void) const override {
+        return parser->decode_lazy_value(offset, arena);
+    }
+
+private:
+    Parser *parser;
+    File::Offset offset;
+    Arena *arena;
+};
+
+
+Value *Parser::parse_lazy_value(Arg *arg) {
+    File::Offset offset = file->currentOffset();
+    int c = read_byte();
+    switch (c) {
+    case trace::TYPE_STRING:
+    case trace::TYPE_ARRAY:
+    case trace::TYPE_STRUCT:
+    case trace::TYPE_BLOB:
+    case trace::TYPE_REPR:
+    case trace::TYPE_WSTRING:
+    case trace::TYPE_BLOB_REF:
+    case trace::TYPE_STRING_REF:
+        scan_value(c);
+        return newValue<LazyValue>(this, offset, arena);
+    default:
+        return parse_value(c, arg);
+    }
+}
+
+
+Value *Parser::decode_lazy_value(const File::Offset &offset, Arena *valueArena) {
+    File::Offset currentOffset = file->currentOffset();
+    file->setCurrentOffset(offset);
+
+    assert(!arena);
+    arena = valueArena;
+    Value *value = parse_value();
+    if (!value) {
+        value = newValue<Null>();
+    }
+    arena = NULL;
+
+    file->setCurrentOffset(currentOffset);
+    return value;
+}
+
+
+Value *Parser::parse_value(Arg *arg) {
+    return parse_value(read_byte(), arg);
+}
+
+
+Value *Parser::parse_value(int c, Arg *arg) {
     Value *value;
-    c = read_byte();
     switch (c) {
     case trace::TYPE_NULL:
-        value = new Null;
+        value = newScalar<Null>(arg);
         break;
     case trace::TYPE_FALSE:
-        value = new Bool(false);
+        value = newScalar<Bool>(arg, false);
         break;
     case trace::TYPE_TRUE:
-        value = new Bool(true);
+        value = newScalar<Bool>(arg, true);
         break;
     case trace::TYPE_SINT:
-        value = parse_sint();
+        value = parse_sint(arg);
         break;
     case trace::TYPE_UINT:
-        value = parse_uint();
+        value = parse_uint(arg);
         break;
     case trace::TYPE_FLOAT:
-        value = parse_float();
+        value = parse_float(arg);
         break;
     case trace::TYPE_DOUBLE:
-        value = parse_double();
+        value = parse_double(arg);
         break;
     case trace::TYPE_STRING:
         value = parse_string();
         break;
     case trace::TYPE_ENUM:
-        value = parse_enum();
+        value = parse_enum(arg);
         break;
     case trace::TYPE_BITMASK:
-        value = parse_bitmask();
+        value = parse_bitmask(arg);
         break;
     case trace::TYPE_ARRAY:
         value = parse_array();
@@ -664,7 +1232,7 @@ Value *Parser::parse_value(void) {
         value = parse_blob();
         break;
     case trace::TYPE_OPAQUE:
-        value = parse_opaque();
+        value = parse_opaque(arg);
         break;
     case trace::TYPE_REPR:
         value = parse_repr();
@@ -672,6 +1240,12 @@ Value *Parser::parse_value(void) {
     case trace::TYPE_WSTRING:
         value = parse_wstring();
         break;
+    case trace::TYPE_BLOB_REF:
+        value = parse_blob_ref();
+        break;
+    case trace::TYPE_STRING_REF:
+        value = parse_string_ref();
+        break;
     default:
         std::cerr << "error: unknown type " << c << "\n";
         exit(1);
@@ -691,7 +1265,11 @@ Value *Parser::parse_value(void) {
 
 
 void Parser::scan_value(void) {
-    int c = read_byte();
+    scan_value(read_byte());
+}
+
+
+void Parser::scan_value(int c) {
     switch (c) {
     case trace::TYPE_NULL:
     case trace::TYPE_FALSE:
@@ -736,6 +1314,12 @@ void Parser::scan_value(void) {
     case trace::TYPE_WSTRING:
         scan_wstring();
         break;
+    case trace::TYPE_BLOB_REF:
+        scan_blob_ref();
+        break;
+    case trace::TYPE_STRING_REF:
+        scan_string_ref();
+        break;
     default:
         std::cerr << "error: unknown type " << c << "\n";
         exit(1);
@@ -745,8 +1329,8 @@ void Parser::scan_value(void) {
 }
 
 
-Value *Parser::parse_sint() {
-    return new SInt(-(signed long long)read_uint());
+Value *Parser::parse_sint(Arg *arg) {
+    return newScalar<SInt>(arg, -(signed long long)read_uint());
 }
 
 
@@ -755,8 +1339,8 @@ void Parser::scan_sint() {
 }
 
 
-Value *Parser::parse_uint() {
-    return new UInt(read_uint());
+Value *Parser::parse_uint(Arg *arg) {
+    return newScalar<UInt>(arg, read_uint());
 }
 
 
@@ -765,10 +1349,10 @@ void Parser::scan_uint() {
 }
 
 
-Value *Parser::parse_float() {
+Value *Parser::parse_float(Arg *arg) {
     float value;
     file->read(&value, sizeof value);
-    return new Float(value);
+    return newScalar<Float>(arg, value);
 }
 
 
@@ -777,10 +1361,10 @@ void Parser::scan_float() {
 }
 
 
-Value *Parser::parse_double() {
+Value *Parser::parse_double(Arg *arg) {
     double value;
     file->read(&value, sizeof value);
-    return new Double(value);
+    return newScalar<Double>(arg, value);
 }
 
 
@@ -790,7 +1374,14 @@ void Parser::scan_double() {
 
 
 Value *Parser::parse_string() {
-    return new String(read_string());
+    if (!useInternedStrings) {
+        const char *value = read_string(arena);
+        detailsSize += strlen(value) + 1;
+        return newValue<String>(value);
+    }
+    std::shared_ptr<void> owner;
+    const char *value = read_shared_string(read_uint(), owner);
+    return newValue<String>(value, owner);
 }
 
 
@@ -799,7 +1390,18 @@ void Parser::scan_string() {
 }
 
 
-Value *Parser::parse_enum() {
+Value *Parser::parse_string_ref() {
+    RefEntry *entry = read_ref(strings);
+    return newValue<String>(static_cast<const char *>(entry->data), entry->owner);
+}
+
+
+void Parser::scan_string_ref() {
+    skip_ref(strings);
+}
+
+
+Value *Parser::parse_enum(Arg *arg) {
     EnumSig *sig;
     signed long long value;
     if (version >= 3) {
@@ -810,7 +1412,7 @@ Value *Parser::parse_enum() {
         assert(sig->num_values == 1);
         value = sig->values->value;
     }
-    return new Enum(sig, value);
+    return newScalar<Enum>(arg, sig, value);
 }
 
 
@@ -824,12 +1426,12 @@ void Parser::scan_enum() {
 }
 
 
-Value *Parser::parse_bitmask() {
+Value *Parser::parse_bitmask(Arg *arg) {
     BitmaskSig *sig = parse_bitmask_sig();
 
     unsigned long long value = read_uint();
 
-    return new Bitmask(sig, value);
+    return newScalar<Bitmask>(arg, sig, value);
 }
 
 
@@ -841,7 +1443,7 @@ void Parser::scan_bitmask() {
 
 Value *Parser::parse_array(void) {
     size_t len = read_uint();
-    Array *array = new Array(len);
+    Array *array = newValue<Array>(len);
     for (size_t i = 0; i < len; ++i) {
         array->values[i] = parse_value();
     }
@@ -859,7 +1461,15 @@ void Parser::scan_array(void) {
 
 Value *Parser::parse_blob(void) {
     size_t size = read_uint();
-    Blob *blob = new Blob(size);
+    detailsSize += size;
+    if (size >= BLOB_IN_PLACE_MIN_SIZE) {
+        std::shared_ptr<void> owner;
+        const void *buf = file->readInPlace(size, owner);
+        if (buf) {
+            return newValue<Blob>(size, buf, owner);
+        }
+    }
+    Blob *blob = newValue<Blob>(size);
     if (size) {
         file->read(blob->buf, size);
     }
@@ -875,9 +1485,199 @@ void Parser::scan_blob(void) {
 }
 
 
+Value *Parser::parse_blob_ref(void) {
+    RefEntry *entry = read_ref(blobs);
+    return newValue<Blob>(entry->size, entry->data, entry->owner);
+}
+
+
+void Parser::scan_blob_ref(void) {
+    skip_ref(blobs);
+}
+
+
+/**
+ * Read a blob or string reference, along with its definition if it follows,
+ * and make sure the contents are loaded.
+ */
+Parser::RefEntry *
+Parser::read_ref(RefTable &table) {
+    File::Offset offset = file->currentOffset();
+    bool definition;
+    unsigned long long id = read_sig_id(definition);
+
+    RefEntry *entry;
+    if (definition) {
+        entry = define_ref(table, id, offset);
+        if (entry->owner) {
+            file->skip(entry->size);
+        } else {
+            load_ref(table, *entry);
+        }
+        return entry;
+    }
+
+    RefTable::Map::iterator it = table.entries.find(id);
+    if (it != table.entries.end()) {
+        entry = &it->second;
+    } else {
+        // Defined before the point we seeked to
+        entry = find_ref(table, id, offset);
+        if (!entry) {
+            std::cerr << "error: reference to undefined " << table.name << " " << id << "\n";
+            exit(1);
+        }
+    }
+
+    if (!entry->owner) {
+        if (!file->supportsOffsets()) {
+            std::cerr << "error: reference to released " << table.name << " " << id << "\n";
+            exit(1);
+        }
+        File::Offset currentOffset = file->currentOffset();
+        file->setCurrentOffset(entry->offset);
+        read_uint();
+        read_uint();
+        load_ref(table, *entry);
+        file->setCurrentOffset(currentOffset);
+    }
+    return entry;
+}
+
+
+void Parser::skip_ref(RefTable &table) {
+    File::Offset offset = file->currentOffset();
+    bool definition;
+    unsigned long long id = read_sig_id(definition);
+    if (definition) {
+        RefEntry *entry = define_ref(table, id, offset);
+        file->skip(entry->size);
+    }
+}
+
+
+/**
+ * Record the blob or string defined at the given offset, leaving the file
+ * right before its contents.
+ */
+Parser::RefEntry *
+Parser::define_ref(RefTable &table, unsigned long long id, const File::Offset &offset) {
+    size_t size = read_uint();
+    if (indexRefs) {
+        IndexRef ref;
+        ref.kind = static_cast<IndexSignature::Kind>(table.indexKind);
+        ref.id = id;
+        ref.offset = offset;
+        indexRefs->push_back(ref);
+    }
+    std::pair<RefTable::Map::iterator, bool> result =
+        table.entries.insert({id, RefEntry()});
+    RefEntry *entry = &result.first->second;
+    if (result.second) {
+        entry->offset = offset;
+        entry->size = size;
+        entry->data = NULL;
+    }
+    return entry;
+}
+
+
+void Parser::load_ref(RefTable &table, RefEntry &entry) {
+    std::shared_ptr<void> owner;
+    const void *data = NULL;
+    if (table.strings) {
+        data = read_shared_string(entry.size, owner);
+    } else {
+        if (entry.size >= BLOB_IN_PLACE_MIN_SIZE) {
+            data = file->readInPlace(entry.size, owner);
+        }
+        if (!data) {
+            char *buf = new char[entry.size];
+            owner.reset(buf, std::default_delete<char[]>());
+            file->read(buf, entry.size);
+            data = buf;
+        }
+    }
+    entry.data = data;
+    entry.owner = owner;
+}
+
+
+/**
+ * Find the definition of a blob or string referred at the given offset,
+ * which precedes the point the parser last seeked to, either through the
+ * index, or by scanning again from the closest point it can be found from.
+ */
+Parser::RefEntry *
+Parser::find_ref(RefTable &table, unsigned long long id, const File::Offset &offset) {
+    if (!file->supportsOffsets()) {
+        return NULL;
+    }
+
+    File::Offset currentOffset = file->currentOffset();
+    const IndexRef *ref =
+        index ? index->findDefinition(static_cast<IndexSignature::Kind>(table.indexKind), id) : NULL;
+    if (ref) {
+        file->setCurrentOffset(ref->offset);
+        skip_ref(table);
+    } else {
+        auto it = std::upper_bound(refScanPoints.begin(), refScanPoints.end(), offset);
+        if (it != refScanPoints.begin()) {
+            scan_refs(*--it, offset);
+        }
+    }
+    file->setCurrentOffset(currentOffset);
+
+    RefTable::Map::iterator it = table.entries.find(id);
+    if (it == table.entries.end()) {
+        return NULL;
+    }
+    return &it->second;
+}
+
+
+void Parser::add_ref_scan_point(const File::Offset &offset) {
+    if (!file->supportsOffsets()) {
+        return;
+    }
+    auto it = std::lower_bound(refScanPoints.begin(), refScanPoints.end(), offset);
+    if (it == refScanPoints.end() || !(*it == offset)) {
+        refScanPoints.insert(it, offset);
+    }
+}
+
+
+/**
+ * Scan the events between the given offsets, recording the blobs and
+ * strings they define, without otherwise affecting the parser's state.
+ */
+void Parser::scan_refs(const File::Offset &from, const File::Offset &to) {
+    const FunctionSig sig = {0, NULL, 0, NULL};
+    file->setCurrentOffset(from);
+    while (file->currentOffset() < to) {
+        int c = read_byte();
+        if (c == trace::EVENT_ENTER) {
+            if (version >= 4) {
+                skip_uint();
+            }
+            parse_function_sig();
+        } else if (c == trace::EVENT_LEAVE) {
+            skip_uint();
+        } else if (c == trace::EVENT_SYNC) {
+            skip_uint();
+            continue;
+        } else {
+            break;
+        }
+        Call call(&sig, 0, 0);
+        parse_call_details(&call, SCAN);
+    }
+}
+
+
 Value *Parser::parse_struct() {
     StructSig *sig = parse_struct_sig();
-    Struct *value = new Struct(sig);
+    Struct *value = newValue<Struct>(sig);
 
     for (size_t i = 0; i < sig->num_members; ++i) {
         value->members[i] = parse_value();
@@ -895,10 +1695,10 @@ void Parser::scan_struct() {
 }
 
 
-Value *Parser::parse_opaque() {
+Value *Parser::parse_opaque(Arg *arg) {
     unsigned long long addr;
     addr = read_uint();
-    return new Pointer(addr);
+    return newScalar<Pointer>(arg, addr);
 }
 
 
@@ -910,7 +1710,7 @@ void Parser::scan_opaque() {
 Value *Parser::parse_repr() {
     Value *humanValue = parse_value();
     Value *machineValue = parse_value();
-    return new Repr(humanValue, machineValue);
+    return newValue<Repr>(humanValue, machineValue);
 }
 
 
@@ -922,7 +1722,13 @@ void Parser::scan_repr() {
 
 Value *Parser::parse_wstring() {
     size_t len = read_uint();
-    wchar_t * value = new wchar_t[len + 1];
+    detailsSize += (len + 1) * sizeof(wchar_t);
+    wchar_t * value;
+    if (arena) {
+        value = static_cast<wchar_t *>(arena->allocate((len + 1) * sizeof *value));
+    } else {
+        value = new wchar_t[len + 1];
+    }
     for (size_t i = 0; i < len; ++i) {
         value[i] = read_uint();
     }
@@ -930,7 +1736,7 @@ Value *Parser::parse_wstring() {
 #if TRACE_VERBOSE
     std::cerr << "\tWSTRING \"" << value << "\"\n";
 #endif
-    return new WString(value);
+    return newValue<WString>(value);
 }
 
 
@@ -942,9 +1748,14 @@ void Parser::scan_wstring() {
 }
 
 
-const char * Parser::read_string(void) {
+const char * Parser::read_string(Arena *stringArena) {
     size_t len = read_uint();
-    char * value = new char[len + 1];
+    char * value;
+    if (stringArena) {
+        value = static_cast<char *>(stringArena->allocate(len + 1));
+    } else {
+        value = new char[len + 1];
+    }
     if (len) {
         file->read(value, len);
     }
@@ -956,6 +1767,77 @@ const char * Parser::read_string(void) {
 }
 
 
+/**
+ * Read a string of the given length into a zero terminated copy which may be
+ * shared with other values, interning it if enabled.
+ */
+const char *Parser::read_shared_string(size_t len, std::shared_ptr<void> &owner) {
+    const char *data = "";
+    if (len) {
+        std::shared_ptr<void> chunk;
+        data = static_cast<const char *>(file->readInPlace(len, chunk));
+        if (!data) {
+            stringBuffer.resize(len);
+            file->read(stringBuffer.data(), len);
+            data = stringBuffer.data();
+        }
+    }
+
+    if (useInternedStrings && len <= STRING_INTERN_MAX_LENGTH) {
+        return intern_string(data, len, owner);
+    }
+
+    char *copy = new char[len + 1];
+    memcpy(copy, data, len);
+    copy[len] = 0;
+    owner.reset(copy, std::default_delete<char[]>());
+    return copy;
+}
+
+
+const char *Parser::intern_string(const char *str, size_t len, std::shared_ptr<void> &owner) {
+    InternKey key = {str, len};
+    InternMap::iterator it = internedStrings.find(key);
+    if (it != internedStrings.end()) {
+        owner = it->second;
+        return static_cast<const char *>(owner.get());
+    }
+
+    if (internedSize + len > STRING_INTERN_MAX_SIZE) {
+        internedStrings.clear();
+        internedSize = 0;
+    }
+
+    char *copy = new char[len + 1];
+    memcpy(copy, str, len);
+    copy[len] = 0;
+    owner.reset(copy, std::default_delete<char[]>());
+
+    key.str = copy;
+    internedStrings.emplace(key, owner);
+    internedSize += len + 1;
+    return copy;
+}
+
+
+size_t Parser::InternHash::operator () (const InternKey &key) const {
+    // FNV-1a, a word at a time
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(key.str);
+    const unsigned char *end = p + key.len;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; p + 8 <= end; p += 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof word);
+        h = (h ^ word) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    for (; p < end; ++p) {
+        h = (h ^ *p) * 0x100000001b3ULL;
+    }
+    return static_cast<size_t>(h ^ (h >> 32));
+}
+
+
 void Parser::skip_string(void) {
     size_t len = read_uint();
     file->skip(len);
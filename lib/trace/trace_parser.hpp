@@ -26,8 +26,14 @@
 #pragma once
 
 
+#include <string.h>
+
 #include <iostream>
 #include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "trace_file.hpp"
 #include "trace_format.hpp"
@@ -35,9 +41,20 @@
 #include "trace_api.hpp"
 
 
+// Limits on calls entered but not left yet.  Besides malformed traces, only
+// calls which never return (e.g., exit) or are blocked on another thread are
+// left pending, so these are never reached in practice.
+#define PARSER_MAX_PENDING_CALLS (64 * 1024)
+#define PARSER_MAX_PENDING_SIZE (256 * 1024 * 1024)
+
+
 namespace trace {
 
 
+class Index;
+struct IndexRef;
+
+
 struct ParseBookmark
 {
     File::Offset offset;
@@ -70,8 +87,75 @@ protected:
         SKIP
     };
 
-    typedef std::list<Call *> CallList;
-    CallList calls;
+    /*
+     * Calls entered but not left yet, in the order they were entered, and
+     * indexed by call number.
+     *
+     * Their number and (approximate) size are capped, so that traces with
+     * many calls which are never left, as malformed or truncated traces may
+     * have, can't exhaust memory.  The oldest calls are dropped when past
+     * either limit.
+     */
+    class PendingCalls
+    {
+    public:
+        PendingCalls() : totalSize(0), dropped(false) {}
+        ~PendingCalls() { clear(); }
+
+        inline bool
+        empty(void) const {
+            return list.empty();
+        }
+
+        inline size_t
+        size(void) const {
+            return list.size();
+        }
+
+        // Approximate memory used by the pending calls
+        inline size_t
+        memorySize(void) const {
+            return totalSize;
+        }
+
+        // Most recently entered call
+        inline Call *
+        back(void) const {
+            return list.empty() ? NULL : list.back().call;
+        }
+
+        void push_back(Call *call, size_t size);
+
+        // Remove the call with the given number, returning NULL if there's
+        // no such call pending
+        Call *take(unsigned no);
+
+        Call *pop_front(void);
+        Call *pop_back(void);
+
+        // Delete all pending calls
+        void clear(void);
+
+    private:
+        struct Entry {
+            Call *call;
+            size_t size;
+        };
+
+        typedef std::list<Entry> List;
+        List list;
+        std::unordered_map<unsigned, List::iterator> byNo;
+        size_t totalSize;
+        bool dropped;
+
+        Call *remove(List::iterator it);
+    };
+
+    PendingCalls calls;
+
+    // Memory allocated for the values of the call being parsed, used to
+    // account for pending calls' size
+    size_t detailsSize;
 
     struct FunctionSigFlags : public FunctionSig {
         CallFlags flags;
@@ -85,6 +169,10 @@ protected:
         // reparsing to determine whether the signature definition is to be
         // expected next or not.
         File::Offset fileOffset;
+
+        // Offset in the file where the signature definition starts, used
+        // when indexing.
+        File::Offset definitionOffset;
     };
 
     typedef SigState<FunctionSigFlags> FunctionSigState;
@@ -105,11 +193,94 @@ protected:
     BitmaskMap bitmasks;
     StackFrameMap frames;
 
+    /*
+     * Deduplicated blobs and strings defined since the last synchronization
+     * event, by ID, as nothing before it can be referred from there on.
+     * Contents are shared by all the values referring to them.
+     *
+     * When seeking back, definitions preceding the new position are looked
+     * up in the index, or found again by scanning from the closest point
+     * in refScanPoints.
+     */
+    struct RefEntry {
+        // Offset of the definition's ID
+        File::Offset offset;
+        size_t size;
+        const void *data;
+        std::shared_ptr<void> owner;
+    };
+
+    struct RefTable {
+        typedef std::unordered_map<unsigned long long, RefEntry> Map;
+
+        // For error messages
+        const char *name;
+        // IndexSignature::Kind of the definitions
+        unsigned indexKind;
+        // Whether contents are zero terminated strings
+        bool strings;
+
+        Map entries;
+
+        RefTable(const char *_name, unsigned _indexKind, bool _strings) :
+            name(_name), indexKind(_indexKind), strings(_strings)
+        {}
+
+        void clear(void) {
+            entries.clear();
+        }
+    };
+
+    RefTable blobs;
+    RefTable strings;
+
+    // Where to record blob and string definitions while building an index
+    std::vector<IndexRef> *indexRefs;
+
+    // Sorted offsets of the synchronization events parsed so far, and of the
+    // points jumped to with the index, from which scanning forward finds
+    // any blob or string definition that isn't in the index
+    std::vector<File::Offset> refScanPoints;
+
+    /*
+     * Interned strings, keyed by their contents, so that String values
+     * which repeat share one immutable copy.  The table is emptied whenever
+     * it grows too large; strings in use are kept alive by their values.
+     */
+    struct InternKey {
+        const char *str;
+        size_t len;
+
+        bool operator == (const InternKey &other) const {
+            return len == other.len && memcmp(str, other.str, len) == 0;
+        }
+    };
+
+    struct InternHash {
+        size_t operator () (const InternKey &key) const;
+    };
+
+    typedef std::unordered_map<InternKey, std::shared_ptr<void>, InternHash> InternMap;
+    InternMap internedStrings;
+    size_t internedSize;
+    std::vector<char> stringBuffer;
+
     FunctionSig *glGetErrorSig;
 
     unsigned next_call_no;
 
     unsigned long long version;
+
+    std::string filename;
+    ParseBookmark startBookmark;
+    Index *index;
+
+    bool useCallArenas;
+    bool useLazyArgs;
+    bool useInternedStrings;
+
+    // Arena of the call whose details are being parsed, if any
+    Arena *arena;
 public:
     API api;
 
@@ -147,7 +318,80 @@ public:
         return parse_call(SCAN);
     }
 
+    /**
+     * Get the trace index, loading it from the sidecar file, or building
+     * and saving it when missing or out of date if so requested.
+     *
+     * Building the index requires scanning the whole trace, and discards any
+     * pending calls.  Returns NULL if the trace doesn't support offsets.
+     */
+    const Index *getIndex(bool build = true);
+
+    /**
+     * Position the parser right before the enter event of the given call,
+     * using the index.
+     *
+     * Pending calls are discarded, so calls preceding the given one which
+     * only complete afterwards won't be returned.
+     */
+    bool jumpToCall(unsigned call_no);
+
+    /**
+     * Position the parser at the start of the given frame, using the index.
+     */
+    bool jumpToFrame(unsigned frame_no);
+
+    /**
+     * Position the parser right after the first synchronization event at or
+     * after the given offset.  Calls can be parsed from there on without
+     * having parsed anything before, though calls entered before it are not
+     * returned.
+     *
+     * Only traces from version 6 onwards have synchronization events.
+     */
+    bool jumpToSyncPoint(const File::Offset &offset);
+
+    /**
+     * Allocate the values of each call from an arena owned by the call,
+     * which is much cheaper than allocating them one by one.
+     *
+     * The values of such calls must not be deleted nor replaced
+     * individually; they are all destroyed along with the call.
+     */
+    void setCallArenas(bool enable) {
+        useCallArenas = enable;
+    }
+
+    /**
+     * Defer decoding strings, blobs, arrays and structures passed as
+     * arguments until they are accessed, by seeking back to them, which is
+     * worthwhile when most calls' arguments are never looked at.
+     *
+     * Only takes effect on traces supporting offsets.  Such arguments must
+     * only be accessed while the parser is open, and from the thread using
+     * it.
+     */
+    void setLazyArgs(bool enable) {
+        useLazyArgs = enable;
+    }
+
+    /**
+     * Share one immutable copy between all String values with the same
+     * contents, so that they can be compared by pointer.  Enabled by
+     * default.
+     *
+     * Such values must not be modified in place; use String::reset()
+     * instead.
+     */
+    void setInternedStrings(bool enable) {
+        useInternedStrings = enable;
+    }
+
 protected:
+    void buildIndex(Index &index);
+    void loadSignatures(const File::Offset &offset);
+    bool skipToCall(unsigned call_no);
+
     Call *parse_call(Mode mode);
 
     FunctionSigFlags *parse_function_sig(void);
@@ -155,6 +399,9 @@ protected:
     EnumSig *parse_old_enum_sig();
     EnumSig *parse_enum_sig();
     BitmaskSig *parse_bitmask_sig();
+
+    size_t read_sig_id(bool &definition);
+    void undefined_sig(size_t id);
     
 public:
     static CallFlags
@@ -165,6 +412,8 @@ protected:
 
     void parse_enter(Mode mode);
 
+    void parse_sync(void);
+
     Call *parse_leave(Mode mode);
 
     bool parse_call_details(Call *call, Mode mode);
@@ -176,8 +425,33 @@ protected:
 
     void parse_arg(Call *call, Mode mode);
 
-    Value *parse_value(void);
+    template< class T, class... Args >
+    inline T *newValue(Args&&... args) {
+        detailsSize += sizeof(T);
+        if (arena) {
+            return arena->create<T>(std::forward<Args>(args)...);
+        }
+        return new T(std::forward<Args>(args)...);
+    }
+
+    template< class T, class... Args >
+    inline T *newScalar(Arg *arg, Args&&... args) {
+        if (arg) {
+            return arg->emplace<T>(std::forward<Args>(args)...);
+        }
+        return newValue<T>(std::forward<Args>(args)...);
+    }
+
+    class LazyValue;
+
+    Value *parse_lazy_value(Arg *arg);
+    Value *decode_lazy_value(const File::Offset &offset, Arena *valueArena);
+
+    // Scalars are stored inline in the given argument, if any
+    Value *parse_value(Arg *arg = NULL);
+    Value *parse_value(int type, Arg *arg);
     void scan_value(void);
+    void scan_value(int type);
     inline Value *parse_value(Mode mode) {
         if (mode == FULL) {
             return parse_value();
@@ -187,25 +461,25 @@ protected:
         }
     }
 
-    Value *parse_sint();
+    Value *parse_sint(Arg *arg);
     void scan_sint();
 
-    Value *parse_uint();
+    Value *parse_uint(Arg *arg);
     void scan_uint();
 
-    Value *parse_float();
+    Value *parse_float(Arg *arg);
     void scan_float();
 
-    Value *parse_double();
+    Value *parse_double(Arg *arg);
     void scan_double();
 
     Value *parse_string();
     void scan_string();
 
-    Value *parse_enum();
+    Value *parse_enum(Arg *arg);
     void scan_enum();
 
-    Value *parse_bitmask();
+    Value *parse_bitmask(Arg *arg);
     void scan_bitmask();
 
     Value *parse_array(void);
@@ -217,7 +491,7 @@ protected:
     Value *parse_struct();
     void scan_struct();
 
-    Value *parse_opaque();
+    Value *parse_opaque(Arg *arg);
     void scan_opaque();
 
     Value *parse_repr();
@@ -226,7 +500,24 @@ protected:
     Value *parse_wstring();
     void scan_wstring();
 
-    const char * read_string(void);
+    Value *parse_blob_ref();
+    void scan_blob_ref();
+
+    Value *parse_string_ref();
+    void scan_string_ref();
+
+    RefEntry *read_ref(RefTable &table);
+    void skip_ref(RefTable &table);
+    RefEntry *define_ref(RefTable &table, unsigned long long id, const File::Offset &offset);
+    void load_ref(RefTable &table, RefEntry &entry);
+    RefEntry *find_ref(RefTable &table, unsigned long long id, const File::Offset &offset);
+    void add_ref_scan_point(const File::Offset &offset);
+    void scan_refs(const File::Offset &from, const File::Offset &to);
+
+    const char *read_shared_string(size_t len, std::shared_ptr<void> &owner);
+    const char *intern_string(const char *str, size_t len, std::shared_ptr<void> &owner);
+
+    const char * read_string(Arena *stringArena = NULL);
     void skip_string(void);
 
     signed long long read_sint(void);
@@ -244,5 +535,47 @@ AbstractParser *
 lastFrameLoopParser(AbstractParser *parser, int loopCount);
 
 
+// See frameLoopParser()
+#define LOOP_LAST_FRAME (~0U)
+
+/**
+ * Wrap a parser so that once past the given range of frames (or the end of
+ * the trace, for LOOP_LAST_FRAME), they are returned again loopCount more
+ * times, or forever if negative, after which no more calls are returned.
+ *
+ * When caching, the frames are parsed once more, and their calls are kept in
+ * memory and returned as shallow copies, rather than parsed on every loop.
+ *
+ * The frames preceding the range are returned as usual rather than skipped
+ * with the index, as replaying them sets up the state the range relies on.
+ */
+AbstractParser *
+frameLoopParser(AbstractParser *parser, int loopCount,
+                unsigned firstFrame, unsigned lastFrame,
+                bool cache);
+
+
+/**
+ * Wrap a parser so that calls are parsed on a separate thread, up to the
+ * given number of calls ahead of the calls being returned.
+ *
+ * Calls may then be requested from any thread, but the wrapped parser must
+ * not defer decoding arguments (see Parser::setLazyArgs).
+ */
+AbstractParser *
+parseAheadParser(AbstractParser *parser, size_t maxCalls);
+
+
+/**
+ * Whether the file is a compiled trace (see trace_compiled.hpp), which must
+ * be read with compiledParser() instead of Parser, and which API it is of.
+ */
+bool
+isCompiledTrace(const char *filename, API *api = nullptr);
+
+AbstractParser *
+compiledParser(void);
+
+
 } /* namespace trace */
 
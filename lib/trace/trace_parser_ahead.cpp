@@ -0,0 +1,258 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <assert.h>
+
+#include <deque>
+
+#include "os_thread.hpp"
+#include "trace_parser.hpp"
+
+
+// Maximum amount of blob data in parsed calls waiting to be returned, so that
+// parsing ahead calls with large blobs doesn't hold onto too much memory
+#define PARSE_AHEAD_MAX_BLOB_SIZE (64 * 1024 * 1024)
+
+
+namespace trace {
+
+
+/*
+ * Decorator for parser which parses calls on a separate thread, ahead of the
+ * calls being returned.
+ */
+class ParseAheadParser : public AbstractParser  {
+public:
+    ParseAheadParser(AbstractParser *p, size_t c) :
+        parser(p),
+        maxCalls(c ? c : 1)
+    {
+    }
+
+    ~ParseAheadParser() {
+        close();
+        delete parser;
+    }
+
+    Call *parse_call(void) override;
+
+    void getBookmark(ParseBookmark &bookmark) override;
+    void setBookmark(const ParseBookmark &bookmark) override;
+    bool open(const char *filename) override;
+    void close(void) override;
+    unsigned long long getVersion(void) const override { return parser->getVersion(); }
+
+private:
+    struct Item {
+        Call *call;
+        // Where the call was parsed from
+        ParseBookmark bookmark;
+        size_t blobSize;
+    };
+
+    AbstractParser *parser;
+    size_t maxCalls;
+
+    os::thread thread;
+
+    /*
+     * These are protected by the mutex.
+     */
+    os::mutex mutex;
+    os::condition_variable readyCond;
+    os::condition_variable spaceCond;
+    std::deque<Item> items;
+    size_t blobSize = 0;
+    bool finished = false;
+    bool stopping = false;
+
+    inline bool
+    full(void) const {
+        return items.size() >= maxCalls ||
+               blobSize >= PARSE_AHEAD_MAX_BLOB_SIZE;
+    }
+
+    void start(void);
+    void stop(void);
+    void clear(void);
+
+    static void parserThread(ParseAheadParser *_this);
+    void run(void);
+};
+
+
+void
+ParseAheadParser::parserThread(ParseAheadParser *_this)
+{
+    _this->run();
+}
+
+
+void
+ParseAheadParser::run(void)
+{
+    os::unique_lock<os::mutex> lock(mutex);
+    while (true) {
+        while (!stopping && full()) {
+            spaceCond.wait(lock);
+        }
+        if (stopping) {
+            break;
+        }
+
+        // Only this thread touches the wrapped parser while running
+        lock.unlock();
+        Item item;
+        parser->getBookmark(item.bookmark);
+        item.call = parser->parse_call();
+        item.blobSize = item.call ? item.call->blobSize() : 0;
+        lock.lock();
+
+        if (!item.call) {
+            finished = true;
+            readyCond.notify_all();
+            break;
+        }
+
+        items.push_back(item);
+        blobSize += item.blobSize;
+        readyCond.notify_one();
+    }
+}
+
+
+void
+ParseAheadParser::start(void)
+{
+    assert(!thread.joinable());
+    finished = false;
+    stopping = false;
+    thread = os::thread(parserThread, this);
+}
+
+
+void
+ParseAheadParser::stop(void)
+{
+    if (!thread.joinable()) {
+        return;
+    }
+
+    {
+        os::unique_lock<os::mutex> lock(mutex);
+        stopping = true;
+        spaceCond.notify_all();
+    }
+    thread.join();
+}
+
+
+void
+ParseAheadParser::clear(void)
+{
+    for (auto & item : items) {
+        delete item.call;
+    }
+    items.clear();
+    blobSize = 0;
+}
+
+
+bool
+ParseAheadParser::open(const char *filename)
+{
+    close();
+    if (!parser->open(filename)) {
+        return false;
+    }
+    start();
+    return true;
+}
+
+
+void
+ParseAheadParser::close(void)
+{
+    stop();
+    clear();
+    parser->close();
+}
+
+
+Call *
+ParseAheadParser::parse_call(void)
+{
+    os::unique_lock<os::mutex> lock(mutex);
+    while (items.empty() && !finished) {
+        readyCond.wait(lock);
+    }
+    if (items.empty()) {
+        return NULL;
+    }
+
+    Item item = items.front();
+    items.pop_front();
+    blobSize -= item.blobSize;
+    spaceCond.notify_one();
+    return item.call;
+}
+
+
+void
+ParseAheadParser::getBookmark(ParseBookmark &bookmark)
+{
+    // Bookmarks aren't taken often, so rather than tracking where the parser
+    // thread is at, pause it
+    stop();
+    if (items.empty()) {
+        parser->getBookmark(bookmark);
+    } else {
+        bookmark = items.front().bookmark;
+    }
+    if (!finished) {
+        start();
+    }
+}
+
+
+void
+ParseAheadParser::setBookmark(const ParseBookmark &bookmark)
+{
+    stop();
+    clear();
+    parser->setBookmark(bookmark);
+    start();
+}
+
+
+AbstractParser *
+parseAheadParser(AbstractParser *parser, size_t maxCalls)
+{
+    return new ParseAheadParser(parser, maxCalls);
+}
+
+
+} /* namespace trace */
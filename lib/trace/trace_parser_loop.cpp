@@ -24,6 +24,11 @@
  **************************************************************************/
 
 
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
 #include "trace_parser.hpp"
 
 
@@ -31,14 +36,18 @@ namespace trace {
 
 
 // Decorator for parser which loops
-class LastFrameLoopParser : public AbstractParser  {
+class FrameLoopParser : public AbstractParser  {
 public:
-    LastFrameLoopParser(AbstractParser *p, int c) {
+    FrameLoopParser(AbstractParser *p, int c, unsigned first, unsigned last, bool cache) {
         parser = p;
         loopCount = c;
+        firstFrame = first;
+        lastFrame = last;
+        useCache = cache;
     }
 
-    ~LastFrameLoopParser() {
+    ~FrameLoopParser() {
+        cachedCalls.clear();
         delete parser;
     }
 
@@ -48,18 +57,47 @@ public:
     void getBookmark(ParseBookmark &bookmark) override { parser->getBookmark(bookmark); }
     void setBookmark(const ParseBookmark &bookmark) override { parser->setBookmark(bookmark); }
     bool open(const char *filename) override;
-    void close(void) override { parser->close(); }
+    void close(void) override;
     unsigned long long getVersion(void) const override { return parser->getVersion(); }
 private:
     int loopCount;
     AbstractParser *parser;
+
+    // Frames to loop, or only the last frame of the trace if lastFrame is
+    // LOOP_LAST_FRAME
+    unsigned firstFrame;
+    unsigned lastFrame;
+
+    bool useCache;
+
+    // Frame of the next call, and of the last one
+    unsigned frameNo;
+    unsigned lastCallFrameNo;
+
+    // Where the frame of the next call starts
     ParseBookmark frameStart;
-    ParseBookmark lastFrameStart;
+
+    // Where the frames to loop start
+    ParseBookmark loopStart;
+    unsigned loopFrame;
+
+    // Whether calls of the frames to loop were reached, and past
+    bool loopBegin;
+    bool loopEnd;
+
+    // Calls of the frames to loop, once cached
+    typedef std::vector<std::shared_ptr<const Call>> CallList;
+    CallList cachedCalls;
+    size_t nextCachedCall;
+
+    Call *parse_frame_call(void);
+    Call *restart(void);
+    void fillCache(void);
 };
 
 
 bool
-LastFrameLoopParser::open(const char *filename)
+FrameLoopParser::open(const char *filename)
 {
     bool ret = parser->open(filename);
     if (ret) {
@@ -68,33 +106,146 @@ LastFrameLoopParser::open(const char *filename)
          * for a trace that has only one frame we need to get it at the
          * beginning. */
         parser->getBookmark(frameStart);
-        lastFrameStart = frameStart;
+        loopStart = frameStart;
+        frameNo = 0;
+        lastCallFrameNo = 0;
+        loopFrame = lastFrame == LOOP_LAST_FRAME ? 0 : firstFrame;
+        loopBegin = false;
+        loopEnd = false;
+        cachedCalls.clear();
+        nextCachedCall = 0;
     }
     return ret;
 }
 
+
+void
+FrameLoopParser::close(void)
+{
+    cachedCalls.clear();
+    parser->close();
+}
+
+
+/*
+ * Parse the next call, keeping track of frames.
+ */
 Call *
-LastFrameLoopParser::parse_call(void)
+FrameLoopParser::parse_frame_call(void)
 {
-    trace::Call *call;
+    Call *call = parser->parse_call();
+    if (!call) {
+        return NULL;
+    }
+
+    lastCallFrameNo = frameNo;
 
-    call = parser->parse_call();
+    if (lastFrame == LOOP_LAST_FRAME) {
+        // Loop the frame of the last call, should it be the last one
+        loopStart = frameStart;
+        loopFrame = frameNo;
+        loopBegin = true;
+    } else if (frameNo >= firstFrame) {
+        loopBegin = true;
+    }
 
-    /* Restart last frame when looping is requested. */
-    if (call) {
-        lastFrameStart = frameStart;
-        if (call->flags & trace::CALL_FLAG_END_FRAME) {
-            parser->getBookmark(frameStart);
+    if (call->flags & trace::CALL_FLAG_END_FRAME) {
+        if (frameNo == lastFrame) {
+            loopEnd = true;
         }
+        ++frameNo;
+        parser->getBookmark(frameStart);
+        if (frameNo == firstFrame) {
+            loopStart = frameStart;
+        }
+    }
+
+    return call;
+}
+
+
+/*
+ * Parse the frames to loop once more, and keep their calls.
+ */
+void
+FrameLoopParser::fillCache(void)
+{
+    parser->setBookmark(loopStart);
+    frameNo = loopFrame;
+    loopEnd = false;
+
+    size_t memorySize = 0;
+    Call *call;
+    while (!loopEnd && (call = parse_frame_call())) {
+        memorySize += sizeof *call + call->args.size() * sizeof(Arg) +
+                      call->arena.size() + call->blobSize();
+        cachedCalls.emplace_back(call);
+    }
+
+    std::cerr << "info: looping " << cachedCalls.size() << " calls of frame";
+    if (lastCallFrameNo > loopFrame) {
+        std::cerr << "s " << loopFrame << "-" << lastCallFrameNo;
     } else {
-        if (loopCount) {
-            frameStart = lastFrameStart;
-            parser->setBookmark(frameStart);
-            call = parser->parse_call();
-            if (loopCount > 0) {
-                --loopCount;
+        std::cerr << " " << loopFrame;
+    }
+    std::cerr << " from memory (" << std::fixed << std::setprecision(1)
+              << memorySize / (1024.0 * 1024.0) << " MB)\n";
+}
+
+
+/*
+ * Go back to the start of the frames to loop.
+ */
+Call *
+FrameLoopParser::restart(void)
+{
+    if (!loopCount) {
+        return NULL;
+    }
+    if (loopCount > 0) {
+        --loopCount;
+    }
+
+    if (useCache) {
+        if (cachedCalls.empty()) {
+            fillCache();
+            if (cachedCalls.empty()) {
+                return NULL;
             }
         }
+        nextCachedCall = 0;
+        return new Call(cachedCalls[nextCachedCall++]);
+    }
+
+    parser->setBookmark(loopStart);
+    frameNo = loopFrame;
+    loopEnd = false;
+    return parse_frame_call();
+}
+
+
+Call *
+FrameLoopParser::parse_call(void)
+{
+    if (!cachedCalls.empty()) {
+        if (nextCachedCall < cachedCalls.size()) {
+            return new Call(cachedCalls[nextCachedCall++]);
+        }
+        return restart();
+    }
+
+    /* Restart the frames when looping is requested. */
+    if (loopEnd) {
+        return restart();
+    }
+
+    Call *call = parse_frame_call();
+    if (!call) {
+        // Frames past the end of the trace can't be looped
+        if (!loopBegin) {
+            return NULL;
+        }
+        call = restart();
     }
 
     return call;
@@ -104,7 +255,16 @@ LastFrameLoopParser::parse_call(void)
 AbstractParser *
 lastFrameLoopParser(AbstractParser *parser, int loopCount)
 {
-    return new LastFrameLoopParser(parser, loopCount);
+    return new FrameLoopParser(parser, loopCount, LOOP_LAST_FRAME, LOOP_LAST_FRAME, false);
+}
+
+
+AbstractParser *
+frameLoopParser(AbstractParser *parser, int loopCount,
+                unsigned firstFrame, unsigned lastFrame,
+                bool cache)
+{
+    return new FrameLoopParser(parser, loopCount, firstFrame, lastFrame, cache);
 }
 
 
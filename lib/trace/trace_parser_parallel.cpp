@@ -0,0 +1,411 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+
+#include "os_thread.hpp"
+#include "trace_parser_parallel.hpp"
+
+
+// Compressed size of the ranges the trace is split into
+#define PARALLEL_PARSER_RANGE_SIZE (2 * 1024 * 1024)
+
+// Number of ranges which may be parsed ahead of the one being visited, per
+// worker, bounding memory usage
+#define PARALLEL_PARSER_BATCHES_PER_THREAD 2
+
+
+namespace trace {
+
+
+ParallelParser::Batch::~Batch() {
+    for (auto call : calls) {
+        delete call;
+    }
+}
+
+
+class ParallelParser::RangeParser : public Parser
+{
+public:
+    bool open(const char *filename) override;
+
+    void findSyncPoints(std::vector<File::Offset> &syncPoints);
+
+    void parseRange(const Range &range, const Range *next, Batch &batch);
+
+private:
+    void addCall(Batch &batch, Call *call, const File::Offset &offset);
+};
+
+
+bool ParallelParser::RangeParser::open(const char *filename) {
+    if (!Parser::open(filename)) {
+        return false;
+    }
+
+    // Worker threads already keep all cores busy
+    file->setReadAhead(0);
+    return true;
+}
+
+
+void ParallelParser::RangeParser::findSyncPoints(std::vector<File::Offset> &syncPoints) {
+    if (version < 6) {
+        return;
+    }
+
+    File::Offset offset = startBookmark.offset;
+    while (file->findSyncPoint(offset)) {
+        syncPoints.push_back(offset);
+        offset.offsetInChunk = 1;
+    }
+}
+
+
+void ParallelParser::RangeParser::addCall(Batch &batch, Call *call, const File::Offset &offset) {
+    adjust_call_flags(call);
+    batch.calls.push_back(call);
+    batch.leaveOffsets.push_back(offset);
+    batch.callNos.push_back(call->no);
+}
+
+
+void ParallelParser::RangeParser::parseRange(const Range &range, const Range *next, Batch &batch) {
+    if (range.first) {
+        setBookmark(startBookmark);
+    } else {
+        bool ok = jumpToSyncPoint(range.start);
+        assert(ok);
+        (void)ok;
+    }
+
+    // Parse all events until the next range starts
+    bool end = false;
+    while (!end) {
+        File::Offset offset = file->currentOffset();
+        int c = file->getc();
+        switch (c) {
+        case trace::EVENT_ENTER:
+            parse_enter(FULL);
+            break;
+        case trace::EVENT_LEAVE:
+            {
+                Call *call = parse_leave(FULL);
+                if (call) {
+                    addCall(batch, call, offset);
+                }
+            }
+            break;
+        case trace::EVENT_SYNC:
+            parse_sync();
+            end = next && !(file->currentOffset() < next->start);
+            break;
+        case -1:
+            end = true;
+            break;
+        default:
+            std::cerr << "error: unknown event " << c << "\n";
+            exit(1);
+        }
+    }
+    batch.numLeft = batch.calls.size();
+
+    // Keep going until all calls entered within the range are left, ignoring
+    // the calls entered past its end
+    bool eof = false;
+    while (!calls.empty() && !eof) {
+        File::Offset offset = file->currentOffset();
+        int c = file->getc();
+        switch (c) {
+        case trace::EVENT_ENTER:
+            {
+                Call *last = calls.back();
+                parse_enter(SKIP);
+                if (calls.back() != last) {
+                    delete calls.pop_back();
+                }
+            }
+            break;
+        case trace::EVENT_LEAVE:
+            {
+                Call *call = parse_leave(FULL);
+                if (call) {
+                    addCall(batch, call, offset);
+                }
+            }
+            break;
+        case trace::EVENT_SYNC:
+            parse_sync();
+            break;
+        case -1:
+            eof = true;
+            break;
+        default:
+            std::cerr << "error: unknown event " << c << "\n";
+            exit(1);
+        }
+    }
+
+    // Incomplete calls go last, as with Parser::parse_call
+    File::Offset eofOffset(UINT64_MAX, UINT32_MAX);
+    while (!calls.empty()) {
+        Call *call = calls.pop_front();
+        call->flags |= CALL_FLAG_INCOMPLETE;
+        addCall(batch, call, eofOffset);
+    }
+}
+
+
+ParallelParser::ParallelParser() :
+    version(0),
+    useCallArenas(false)
+{
+}
+
+
+ParallelParser::~ParallelParser() {
+    close();
+}
+
+
+bool ParallelParser::open(const char *filename) {
+    close();
+
+    this->filename = filename;
+
+    RangeParser *parser = getParser(0);
+    if (!parser) {
+        return false;
+    }
+    version = parser->getVersion();
+
+    std::vector<File::Offset> syncPoints;
+    parser->findSyncPoints(syncPoints);
+
+    Range range;
+    range.first = true;
+    ranges.push_back(range);
+
+    range.first = false;
+    uint64_t rangeStart = 0;
+    for (auto & syncPoint : syncPoints) {
+        if (syncPoint.chunk - rangeStart >= PARALLEL_PARSER_RANGE_SIZE) {
+            range.start = syncPoint;
+            ranges.push_back(range);
+            rangeStart = syncPoint.chunk;
+        }
+    }
+
+    return true;
+}
+
+
+void ParallelParser::close(void) {
+    for (auto parser : parsers) {
+        delete parser;
+    }
+    parsers.clear();
+    ranges.clear();
+    version = 0;
+}
+
+
+ParallelParser::RangeParser *ParallelParser::getParser(unsigned worker) {
+    if (worker < parsers.size()) {
+        return parsers[worker];
+    }
+
+    assert(worker == parsers.size());
+    RangeParser *parser = new RangeParser;
+    parser->setCallArenas(useCallArenas);
+    if (!parser->open(filename.c_str())) {
+        delete parser;
+        return nullptr;
+    }
+    parsers.push_back(parser);
+    return parser;
+}
+
+
+/*
+ * State shared between the worker threads and the thread visiting the
+ * calls.
+ */
+struct ParallelParser::Context
+{
+    ParallelParser *parser;
+    Visitor *visitor;
+
+    os::mutex mutex;
+    os::condition_variable cond;
+
+    // Next range to be parsed
+    size_t nextRange = 0;
+
+    // Ranges whose calls were all visited
+    size_t numVisited = 0;
+
+    // Ranges which may be in flight
+    size_t window = 0;
+
+    // Batches parsed but not visited yet, indexed by range
+    std::vector<Batch *> batches;
+};
+
+
+void ParallelParser::workerThread(Context *context, RangeParser *rangeParser) {
+    context->parser->work(*context, rangeParser);
+}
+
+
+void ParallelParser::work(Context &context, RangeParser *rangeParser) {
+    os::unique_lock<os::mutex> lock(context.mutex);
+    while (true) {
+        while (context.nextRange < ranges.size() &&
+               context.nextRange >= context.numVisited + context.window) {
+            context.cond.wait(lock);
+        }
+        if (context.nextRange >= ranges.size()) {
+            break;
+        }
+
+        size_t index = context.nextRange++;
+        lock.unlock();
+
+        Batch *batch = context.visitor->createBatch();
+        batch->index = index;
+        const Range *next = index + 1 < ranges.size() ? &ranges[index + 1] : nullptr;
+        rangeParser->parseRange(ranges[index], next, *batch);
+        context.visitor->visitBatch(*batch);
+
+        lock.lock();
+        context.batches[index] = batch;
+        context.cond.notify_all();
+    }
+}
+
+
+void ParallelParser::parse(Visitor &visitor, unsigned numThreads) {
+    if (ranges.empty()) {
+        return;
+    }
+
+    if (!numThreads) {
+        numThreads = std::max(os::thread::hardware_concurrency(), 1U);
+    }
+    numThreads = std::min(numThreads, unsigned(ranges.size()));
+
+    Context context;
+    context.parser = this;
+    context.visitor = &visitor;
+    context.window = numThreads * PARALLEL_PARSER_BATCHES_PER_THREAD;
+    context.batches.resize(ranges.size());
+
+    std::vector<os::thread> workers;
+    for (unsigned i = 0; i < numThreads; ++i) {
+        RangeParser *rangeParser = getParser(i);
+        if (!rangeParser) {
+            break;
+        }
+        workers.emplace_back(workerThread, &context, rangeParser);
+    }
+    assert(!workers.empty());
+
+    /*
+     * Calls left past the end of the range they were entered in, to be
+     * visited along with the calls of the following ranges, in the order of
+     * their leave events.
+     */
+    struct Pending {
+        File::Offset offset;
+        unsigned no;
+        std::shared_ptr<Batch> batch;
+        size_t index;
+
+        bool operator < (const Pending &other) const {
+            return offset < other.offset ||
+                   (offset == other.offset && no < other.no);
+        }
+    };
+    std::deque<Pending> pending;
+
+    for (size_t index = 0; index < ranges.size(); ++index) {
+        std::shared_ptr<Batch> batch;
+        {
+            os::unique_lock<os::mutex> lock(context.mutex);
+            while (!context.batches[index]) {
+                context.cond.wait(lock);
+            }
+            batch.reset(context.batches[index]);
+            context.batches[index] = nullptr;
+        }
+
+        for (size_t i = 0; i < batch->numLeft; ++i) {
+            while (!pending.empty() &&
+                   pending.front().offset < batch->leaveOffsets[i]) {
+                visitor.visitCall(*pending.front().batch, pending.front().index);
+                pending.pop_front();
+            }
+            visitor.visitCall(*batch, i);
+        }
+
+        if (batch->calls.size() > batch->numLeft) {
+            for (size_t i = batch->numLeft; i < batch->calls.size(); ++i) {
+                Pending call;
+                call.offset = batch->leaveOffsets[i];
+                call.no = batch->callNos[i];
+                call.batch = batch;
+                call.index = i;
+                pending.push_back(call);
+            }
+            std::stable_sort(pending.begin(), pending.end());
+        }
+
+        batch.reset();
+
+        os::unique_lock<os::mutex> lock(context.mutex);
+        context.numVisited = index + 1;
+        context.cond.notify_all();
+    }
+
+    while (!pending.empty()) {
+        visitor.visitCall(*pending.front().batch, pending.front().index);
+        pending.pop_front();
+    }
+
+    for (auto & worker : workers) {
+        worker.join();
+    }
+}
+
+
+} /* namespace trace */
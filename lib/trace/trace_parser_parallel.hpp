@@ -0,0 +1,167 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Multi-threaded trace parsing.
+ *
+ * The trace is split into ranges of chunks at synchronization points (see
+ * FORMAT.markdown), each of which is parsed by a worker thread with its own
+ * Parser.  A worker parses the calls entered within its range, plus the
+ * remaining events up to their leave events.
+ *
+ * Traces older than version 6 have no synchronization points, so they are
+ * parsed by a single worker.
+ */
+
+#pragma once
+
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "trace_parser.hpp"
+
+
+namespace trace {
+
+
+class ParallelParser
+{
+public:
+    /**
+     * Calls entered within one range of the trace.
+     */
+    struct Batch
+    {
+        virtual ~Batch();
+
+        // Position of the range in the trace
+        unsigned index = 0;
+
+        // Calls, in the order their leave events appear, followed by the
+        // calls left past the end of the range, or never left at all
+        std::vector<Call *> calls;
+
+        // Where each call's leave event is, used to merge calls left past
+        // the end of the range with those of the following ranges
+        std::vector<File::Offset> leaveOffsets;
+
+        // Number of each call, which visitors may clear from calls, used to
+        // order calls never left as they were entered
+        std::vector<unsigned> callNos;
+
+        // Number of calls left within the range
+        size_t numLeft = 0;
+    };
+
+    class Visitor
+    {
+    public:
+        virtual ~Visitor() {}
+
+        /**
+         * Create a batch.  Visitors may return a derived structure, to keep
+         * their own per batch data.
+         */
+        virtual Batch *createBatch(void) {
+            return new Batch;
+        }
+
+        /**
+         * Called on the worker threads, concurrently and in no particular
+         * order, once all calls in the batch were parsed.
+         */
+        virtual void visitBatch(Batch &batch) {}
+
+        /**
+         * Called on the thread invoking parse(), for every call, in the same
+         * order Parser::parse_call() would return them.
+         *
+         * The call is batch.calls[index], and is deleted along with the batch
+         * unless the visitor takes ownership and clears it.
+         */
+        virtual void visitCall(Batch &batch, size_t index) {}
+    };
+
+    ParallelParser();
+    ~ParallelParser();
+
+    bool open(const char *filename);
+    void close(void);
+
+    unsigned long long getVersion(void) const {
+        return version;
+    }
+
+    /**
+     * Number of ranges the trace was split into.
+     */
+    size_t numRanges(void) const {
+        return ranges.size();
+    }
+
+    /**
+     * See Parser::setCallArenas.  Must be called before open().
+     */
+    void setCallArenas(bool enable) {
+        useCallArenas = enable;
+    }
+
+    /**
+     * Parse the whole trace with the given number of worker threads, or
+     * one per core if zero.
+     */
+    void parse(Visitor &visitor, unsigned numThreads = 0);
+
+private:
+    struct Range
+    {
+        // Start of the range, either the start of the trace or a
+        // synchronization point
+        File::Offset start;
+        bool first;
+    };
+
+    class RangeParser;
+    struct Context;
+
+    std::string filename;
+    unsigned long long version;
+    bool useCallArenas;
+    std::vector<Range> ranges;
+
+    // Parsers, kept open as long as the calls they parsed may refer to
+    // their signatures
+    std::vector<RangeParser *> parsers;
+
+    RangeParser *getParser(unsigned worker);
+
+    static void workerThread(Context *context, RangeParser *rangeParser);
+    void work(Context &context, RangeParser *rangeParser);
+};
+
+
+} /* namespace trace */
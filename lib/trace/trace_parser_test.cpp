@@ -0,0 +1,687 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Traces are written into memory, with synchronization events wherever the
+ * test asks for them, and then parsed back from a Snappy compressed file.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <functional>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "trace_dump.hpp"
+#include "trace_format.hpp"
+#include "trace_ostream.hpp"
+#include "trace_parser.hpp"
+#include "trace_parser_parallel.hpp"
+#include "trace_synth.hpp"
+#include "trace_writer.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace trace;
+
+
+static const char *filename = "trace_parser_test.trace";
+
+
+struct Encoded
+{
+    std::string data;
+
+    // Where each synchronization event starts
+    std::vector<size_t> syncOffsets;
+};
+
+
+/*
+ * Stream keeping what is written in memory, and starting a new chunk (so
+ * that the writer emits a synchronization event) once syncInterval bytes
+ * were written since the last one.
+ */
+class MemoryStream : public OutStream
+{
+    Encoded &encoded;
+    size_t syncInterval;
+    size_t lastSync;
+
+public:
+    MemoryStream(Encoded &_encoded, size_t _syncInterval) :
+        encoded(_encoded),
+        syncInterval(_syncInterval),
+        lastSync(0)
+    {}
+
+    bool write(const void *buffer, size_t length) override {
+        encoded.data.append(static_cast<const char *>(buffer), length);
+        return true;
+    }
+
+    void flush(void) override {}
+
+    bool beginEvent(void) override {
+        if (encoded.data.size() - lastSync < syncInterval) {
+            return false;
+        }
+        lastSync = encoded.data.size();
+        encoded.syncOffsets.push_back(lastSync);
+        return true;
+    }
+};
+
+
+/*
+ * Write the events out as a Snappy compressed trace, starting a chunk at
+ * every synchronization event as `apitrace repack` does.
+ */
+static void
+writeTrace(const Encoded &encoded)
+{
+    OutStream *stream = createSnappyStream(filename);
+    ASSERT_TRUE(stream != NULL);
+
+    size_t start = 0;
+    for (size_t i = 0; i <= encoded.syncOffsets.size(); ++i) {
+        size_t end = i < encoded.syncOffsets.size() ? encoded.syncOffsets[i] : encoded.data.size();
+        if (i > 0) {
+            stream->beginSyncPoint(end - start);
+        }
+        stream->write(encoded.data.data() + start, end - start);
+        start = end;
+    }
+
+    delete stream;
+}
+
+
+static std::vector<Call *>
+synthesize(const SynthOptions &options)
+{
+    std::unique_ptr<Synthesizer> synthesizer(createSynthesizer(options));
+    std::vector<Call *> calls;
+    for (unsigned long long no = 0; no < options.calls; ++no) {
+        calls.push_back(synthesizer->call(no));
+    }
+    return calls;
+}
+
+
+/*
+ * Synthetic calls with large blobs, so that synchronization events are
+ * every few calls, and far enough apart to start chunks of their own.
+ */
+static std::vector<Call *>
+synthesizeLarge(void)
+{
+    SynthOptions options;
+    options.calls = 2000;
+    options.frames = 20;
+    options.minBlobSize = 64 * 1024;
+    options.maxBlobSize = 1024 * 1024;
+    return synthesize(options);
+}
+
+
+static void
+deleteCalls(std::vector<Call *> &calls)
+{
+    for (auto call : calls) {
+        delete call;
+    }
+    calls.clear();
+}
+
+
+/*
+ * Describe the call in a single line, followed by a hash of the contents
+ * of its blobs, which dumping omits.
+ */
+static std::string
+describe(Call *call)
+{
+    std::ostringstream os;
+    dump(*call, os, DUMP_FLAG_NO_COLOR | DUMP_FLAG_NO_MULTILINE);
+    for (auto &arg : call->args) {
+        const Blob *blob = arg.value ? arg.value->toBlob() : NULL;
+        if (blob) {
+            os << " // " << std::hash<std::string>()(std::string(blob->buf, blob->size));
+        }
+    }
+    return os.str();
+}
+
+
+/*
+ * Parse the remaining calls, expecting them to match calls[first] onwards.
+ */
+static void
+expectCalls(Parser &parser, const std::vector<Call *> &calls, size_t first)
+{
+    size_t i = first;
+    Call *call;
+    while ((call = parser.parse_call())) {
+        std::string actual = describe(call);
+        delete call;
+        ASSERT_LT(i, calls.size());
+        ASSERT_EQ(describe(calls[i]), actual) << "call " << i;
+        ++i;
+    }
+    EXPECT_EQ(calls.size(), i);
+}
+
+
+/*
+ * Parser exposing the skip mode.
+ */
+class SkipParser : public Parser
+{
+public:
+    Call *skip_call(void) {
+        return parse_call(SKIP);
+    }
+};
+
+
+static void
+putUInt(std::string &data, unsigned long long value)
+{
+    while (value >= 0x80) {
+        data += static_cast<char>(0x80 | (value & 0x7f));
+        value >>= 7;
+    }
+    data += static_cast<char>(value);
+}
+
+
+static void
+putString(std::string &data, const char *str)
+{
+    putUInt(data, strlen(str));
+    data += str;
+}
+
+
+/*
+ * Every version from synchronization events onwards, with the features it
+ * introduced enabled.
+ */
+TEST(trace_parser, roundTrip)
+{
+    SynthOptions options;
+    options.calls = 5000;
+    options.frames = 10;
+    std::vector<Call *> calls = synthesize(options);
+
+    size_t previousSize = 0;
+    for (unsigned version = 6; version <= TRACE_VERSION; ++version) {
+        SCOPED_TRACE(version);
+
+        Encoded encoded;
+        {
+            Writer writer;
+            writer.open(new MemoryStream(encoded, 256 * 1024));
+            writer.setCallLengths(version >= 7);
+            writer.setDedupBlobs(version >= 8);
+            writer.setStringRefs(version >= 9);
+            for (auto call : calls) {
+                writer.writeCall(call);
+            }
+        }
+        EXPECT_FALSE(encoded.syncOffsets.empty());
+
+        // Length prefixes make calls larger, whereas references make them
+        // smaller
+        if (version == 7) {
+            EXPECT_GT(encoded.data.size(), previousSize);
+        } else if (version > 7) {
+            EXPECT_LT(encoded.data.size(), previousSize);
+        }
+        previousSize = encoded.data.size();
+
+        // The writer always writes the latest version
+        encoded.data[0] = static_cast<char>(version);
+        writeTrace(encoded);
+
+        Parser parser;
+        ASSERT_TRUE(parser.open(filename));
+        EXPECT_EQ(version, parser.getVersion());
+        expectCalls(parser, calls, 0);
+    }
+
+    deleteCalls(calls);
+    remove(filename);
+}
+
+
+/*
+ * Signature IDs without a definition flag, and no synchronization events.
+ */
+TEST(trace_parser, oldVersion)
+{
+    Encoded encoded;
+    std::string &data = encoded.data;
+    putUInt(data, 5);
+
+    data += static_cast<char>(EVENT_ENTER);
+    putUInt(data, 0); // thread
+    putUInt(data, 0); // signature
+    putString(data, "glFoo");
+    putUInt(data, 1);
+    putString(data, "x");
+    data += static_cast<char>(CALL_ARG);
+    putUInt(data, 0);
+    data += static_cast<char>(TYPE_UINT);
+    putUInt(data, 7);
+    data += static_cast<char>(CALL_END);
+
+    data += static_cast<char>(EVENT_LEAVE);
+    putUInt(data, 0);
+    data += static_cast<char>(CALL_RET);
+    data += static_cast<char>(TYPE_TRUE);
+    data += static_cast<char>(CALL_END);
+
+    data += static_cast<char>(EVENT_ENTER);
+    putUInt(data, 0); // thread
+    putUInt(data, 0); // signature, already defined
+    data += static_cast<char>(CALL_ARG);
+    putUInt(data, 0);
+    data += static_cast<char>(TYPE_STRING);
+    putString(data, "bar");
+    data += static_cast<char>(CALL_END);
+
+    data += static_cast<char>(EVENT_LEAVE);
+    putUInt(data, 1);
+    data += static_cast<char>(CALL_END);
+
+    writeTrace(encoded);
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+    EXPECT_EQ(5, parser.getVersion());
+
+    Call *call = parser.parse_call();
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ("0 glFoo(x = 7) = true", describe(call));
+    delete call;
+
+    call = parser.parse_call();
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ("1 glFoo(x = \"bar\")", describe(call));
+    delete call;
+
+    EXPECT_TRUE(parser.parse_call() == NULL);
+
+    EXPECT_FALSE(parser.jumpToSyncPoint(File::Offset()));
+
+    parser.close();
+    remove(filename);
+}
+
+
+/*
+ * Calls skipped at once, by their length prefix, interleaved with calls
+ * parsed in full.
+ */
+TEST(trace_parser, callLengths)
+{
+    SynthOptions options;
+    options.calls = 5000;
+    options.frames = 10;
+    std::vector<Call *> calls = synthesize(options);
+
+    Encoded encoded;
+    {
+        Writer writer;
+        writer.open(new MemoryStream(encoded, 256 * 1024));
+        writer.setCallLengths(true);
+        for (auto call : calls) {
+            writer.writeCall(call);
+        }
+    }
+    writeTrace(encoded);
+
+    SkipParser parser;
+    ASSERT_TRUE(parser.open(filename));
+    for (size_t i = 0; i < calls.size(); ++i) {
+        Call *call = i % 3 ? parser.skip_call() : parser.parse_call();
+        ASSERT_TRUE(call != NULL);
+        EXPECT_EQ(i, call->no);
+        EXPECT_STREQ(calls[i]->sig->name, call->sig->name);
+        if (i % 3 == 0) {
+            EXPECT_EQ(describe(calls[i]), describe(call)) << "call " << i;
+        }
+        delete call;
+    }
+    EXPECT_TRUE(parser.parse_call() == NULL);
+
+    parser.close();
+    deleteCalls(calls);
+    remove(filename);
+}
+
+
+/*
+ * Decoding from every synchronization event, and seeking back, with blobs
+ * and strings referring to definitions preceding them.
+ */
+TEST(trace_parser, syncPoints)
+{
+    std::vector<Call *> calls = synthesizeLarge();
+
+    Encoded encoded;
+    {
+        Writer writer;
+        writer.open(new MemoryStream(encoded, 2 * 1024 * 1024));
+        writer.setCallLengths(true);
+        writer.setDedupBlobs(true);
+        writer.setStringRefs(true);
+        for (auto call : calls) {
+            writer.writeCall(call);
+        }
+    }
+    ASSERT_GT(encoded.syncOffsets.size(), 2);
+    writeTrace(encoded);
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+
+    std::vector<ParseBookmark> bookmarks;
+    std::set<uint64_t> chunks;
+    while (true) {
+        ParseBookmark bookmark;
+        parser.getBookmark(bookmark);
+        Call *call = parser.parse_call();
+        if (!call) {
+            break;
+        }
+        bookmarks.push_back(bookmark);
+        chunks.insert(bookmark.offset.chunk);
+        delete call;
+    }
+    ASSERT_EQ(calls.size(), bookmarks.size());
+
+    // Jump to the first synchronization event following each chunk start,
+    // and decode from there to the end
+    std::set<unsigned> syncCalls;
+    for (auto chunk : chunks) {
+        if (!parser.jumpToSyncPoint(File::Offset(chunk, 0))) {
+            continue;
+        }
+        ParseBookmark bookmark;
+        parser.getBookmark(bookmark);
+        syncCalls.insert(bookmark.next_call_no);
+        SCOPED_TRACE(bookmark.next_call_no);
+        expectCalls(parser, calls, bookmark.next_call_no);
+    }
+    EXPECT_EQ(encoded.syncOffsets.size(), syncCalls.size());
+
+    // Seek back to calls in the middle of synchronization intervals
+    for (size_t i = bookmarks.size(); i > 0; i -= std::min<size_t>(i, 150)) {
+        SCOPED_TRACE(i - 1);
+        parser.setBookmark(bookmarks[i - 1]);
+        expectCalls(parser, calls, i - 1);
+    }
+
+    parser.close();
+    deleteCalls(calls);
+    remove(filename);
+}
+
+
+class DescribeVisitor : public ParallelParser::Visitor
+{
+public:
+    std::vector<std::string> descriptions;
+
+    void visitCall(ParallelParser::Batch &batch, size_t index) override {
+        descriptions.push_back(describe(batch.calls[index]));
+    }
+};
+
+
+/*
+ * Calls left after later ones, possibly in a following range, or never
+ * left at all, must be returned in the same order as Parser does.
+ */
+TEST(trace_parser, parallelOrder)
+{
+    static const FunctionSig finishSig = {100, "glFinish", 0, NULL};
+
+    std::vector<Call *> calls = synthesizeLarge();
+
+    Encoded encoded;
+    {
+        Writer writer;
+        writer.open(new MemoryStream(encoded, 2 * 1024 * 1024));
+        std::vector<unsigned> entered;
+        for (size_t i = 0; i < calls.size(); ++i) {
+            if (i % 50 == 0) {
+                entered.push_back(writer.beginEnter(&finishSig, 0));
+                writer.endEnter();
+            }
+            writer.writeCall(calls[i]);
+            // Leave every other call a while later, and never the others
+            if (i % 50 == 49 && entered.size() >= 4) {
+                writer.beginLeave(entered[entered.size() - 4]);
+                writer.endLeave();
+                entered.erase(entered.end() - 4);
+                entered.erase(entered.begin());
+            }
+        }
+    }
+    ASSERT_GT(encoded.syncOffsets.size(), 2);
+    writeTrace(encoded);
+
+    std::vector<std::string> expected;
+    {
+        Parser parser;
+        ASSERT_TRUE(parser.open(filename));
+        Call *call;
+        while ((call = parser.parse_call())) {
+            expected.push_back(describe(call));
+            delete call;
+        }
+    }
+    EXPECT_GT(expected.size(), calls.size());
+
+    ParallelParser parser;
+    ASSERT_TRUE(parser.open(filename));
+    EXPECT_GT(parser.numRanges(), 1);
+    DescribeVisitor visitor;
+    parser.parse(visitor, 4);
+    parser.close();
+
+    ASSERT_EQ(expected.size(), visitor.descriptions.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(expected[i], visitor.descriptions[i]) << "call " << i;
+    }
+
+    deleteCalls(calls);
+    remove(filename);
+}
+
+
+/*
+ * Parser exposing its pending calls.
+ */
+class PendingParser : public Parser
+{
+public:
+    PendingCalls &pending(void) {
+        return calls;
+    }
+};
+
+
+static Call *
+newCall(unsigned no)
+{
+    static const FunctionSig sig = {0, "glFinish", 0, NULL};
+    Call *call = new Call(&sig, 0, 0);
+    call->no = no;
+    return call;
+}
+
+
+TEST(trace_parser, pendingCalls)
+{
+    PendingParser parser;
+    auto &pending = parser.pending();
+
+    // The oldest calls are dropped once past the limit
+    const unsigned numCalls = PARSER_MAX_PENDING_CALLS + 100;
+    for (unsigned no = 0; no < numCalls; ++no) {
+        pending.push_back(newCall(no), 64);
+    }
+    EXPECT_EQ(PARSER_MAX_PENDING_CALLS, pending.size());
+    EXPECT_EQ(PARSER_MAX_PENDING_CALLS * 64, pending.memorySize());
+
+    // Leaving dropped calls finds nothing
+    EXPECT_TRUE(pending.take(0) == NULL);
+    EXPECT_TRUE(pending.take(99) == NULL);
+
+    Call *call = pending.take(100);
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ(100, call->no);
+    delete call;
+    EXPECT_TRUE(pending.take(100) == NULL);
+
+    // Reusing the number of a pending call replaces it
+    Call *reused = newCall(200);
+    pending.push_back(reused, 128);
+    EXPECT_EQ(PARSER_MAX_PENDING_CALLS - 1, pending.size());
+    EXPECT_EQ(PARSER_MAX_PENDING_CALLS * 64, pending.memorySize());
+    EXPECT_EQ(reused, pending.back());
+    EXPECT_EQ(reused, pending.take(200));
+    delete reused;
+    EXPECT_TRUE(pending.take(200) == NULL);
+
+    // Calls after the reused one are still found, and in order
+    call = pending.pop_front();
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ(101, call->no);
+    delete call;
+    call = pending.take(numCalls - 1);
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ(numCalls - 1, call->no);
+    delete call;
+
+    // A single call may take all the memory allowed
+    pending.push_back(newCall(numCalls), PARSER_MAX_PENDING_SIZE);
+    EXPECT_EQ(1, pending.size());
+    EXPECT_EQ(PARSER_MAX_PENDING_SIZE, pending.memorySize());
+
+    pending.clear();
+    EXPECT_TRUE(pending.empty());
+    EXPECT_EQ(0, pending.memorySize());
+}
+
+
+/*
+ * Leave events of calls dropped from the pending ones are skipped, values
+ * and all.
+ */
+TEST(trace_parser, strandedLeaves)
+{
+    static const FunctionSig finishSig = {0, "glFinish", 0, NULL};
+    static const char *getErrorArgs[] = {"x"};
+    static const FunctionSig getErrorSig = {1, "glGetError", 1, getErrorArgs};
+
+    const unsigned numCalls = PARSER_MAX_PENDING_CALLS + 100;
+
+    Encoded encoded;
+    {
+        Writer writer;
+        writer.open(new MemoryStream(encoded, ~size_t(0)));
+        for (unsigned i = 0; i < numCalls; ++i) {
+            writer.beginEnter(&finishSig, 0);
+            writer.endEnter();
+        }
+        for (unsigned no : {0U, 50U, numCalls - 1, 99U}) {
+            writer.beginLeave(no);
+            writer.beginReturn();
+            writer.writeString("stranded");
+            writer.endReturn();
+            writer.endLeave();
+        }
+        unsigned no = writer.beginEnter(&getErrorSig, 0);
+        writer.beginArg(0);
+        writer.writeUInt(1);
+        writer.endArg();
+        writer.endEnter();
+        writer.beginLeave(no);
+        writer.beginReturn();
+        writer.writeUInt(0);
+        writer.endReturn();
+        writer.endLeave();
+    }
+    writeTrace(encoded);
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+
+    Call *call = parser.parse_call();
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ(numCalls - 1, call->no);
+    ASSERT_TRUE(call->ret != NULL);
+    EXPECT_STREQ("stranded", call->ret->toString());
+    delete call;
+
+    call = parser.parse_call();
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ(numCalls, call->no);
+    EXPECT_STREQ("glGetError", call->sig->name);
+    EXPECT_EQ(1, call->arg(0).toUInt());
+    delete call;
+
+    // Calls never left, dropped calls aside
+    unsigned expected = 100;
+    while ((call = parser.parse_call())) {
+        EXPECT_EQ(expected, call->no);
+        EXPECT_TRUE(call->flags & CALL_FLAG_INCOMPLETE);
+        ++expected;
+        delete call;
+    }
+    EXPECT_EQ(numCalls - 1, expected);
+
+    parser.close();
+    remove(filename);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
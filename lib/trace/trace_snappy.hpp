@@ -31,4 +31,11 @@
 #define SNAPPY_BYTE1 'a'
 #define SNAPPY_BYTE2 't'
 
+// Zstandard compressed traces use the same container as Snappy
+#define ZSTD_BYTE1 'a'
+#define ZSTD_BYTE2 'z'
 
+
+
+// Set in the compressed length of chunks starting with a synchronization event
+#define SNAPPY_SYNC_FLAG 0x80000000U
@@ -0,0 +1,427 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "trace_synth.hpp"
+#include "trace_synth_sigs.hpp"
+
+
+namespace trace {
+
+
+const char *synthCategoryNames[SYNTH_NUM_CATEGORIES] = {
+    "draw",
+    "state",
+    "uniform",
+    "upload",
+    "shader",
+};
+
+
+class GLSynthesizer : public Synthesizer
+{
+    SynthOptions options;
+    Random random;
+
+    unsigned totalWeight;
+
+    // Random bytes which blobs are sliced from
+    std::shared_ptr<void> poolOwner;
+    const char *pool;
+    size_t poolSize;
+
+    struct BlobRef {
+        size_t offset;
+        size_t size;
+    };
+    std::vector<BlobRef> recentBlobs;
+    size_t nextRecentBlob = 0;
+
+    // Strings of one kind, which may be repeated
+    struct SharedString {
+        const char *value;
+        std::shared_ptr<void> owner;
+    };
+    struct StringPool {
+        const char *format;
+        std::vector<SharedString> strings;
+        unsigned long long nextId = 0;
+
+        StringPool(const char *_format) : format(_format) {}
+    };
+    StringPool sources;
+    StringPool uniformNames;
+    StringPool labels;
+
+public:
+    GLSynthesizer(const SynthOptions &_options) :
+        options(_options),
+        random(_options.seed),
+        sources("#version 330\n"
+                "uniform mat4 mvp%llu;\n"
+                "in vec4 position;\n"
+                "out vec4 color;\n"
+                "void main() {\n"
+                "    gl_Position = mvp%llu * position;\n"
+                "    color = vec4(%llu.0);\n"
+                "}\n"),
+        uniformNames("uniform%llu"),
+        labels("buffer object %llu")
+    {
+        totalWeight = 0;
+        for (unsigned i = 0; i < SYNTH_NUM_CATEGORIES; ++i) {
+            totalWeight += options.weights[i];
+        }
+
+        poolSize = options.maxBlobSize * 2;
+        char *buf = new char[poolSize];
+        poolOwner.reset(buf, std::default_delete<char[]>());
+        pool = buf;
+        for (size_t i = 0; i < poolSize; ++i) {
+            buf[i] = static_cast<char>(random.next());
+        }
+    }
+
+    Call *
+    call(unsigned long long no) override {
+        Call *call = makeCall(no);
+        call->no = no;
+        return call;
+    }
+
+private:
+    Call *
+    makeCall(unsigned long long no) {
+        // Frames end with a swap on the first thread, evenly spread so that
+        // the last call ends the last frame
+        if ((no + 1) * options.frames / options.calls !=
+            no * options.frames / options.calls) {
+            Call *call = newCall(SWAP_BUFFERS, 0);
+            call->args[0].emplace<Pointer>(0x1000);
+            call->args[1].emplace<UInt>(0x2000);
+            return call;
+        }
+
+        unsigned thread = random(options.threads);
+
+        unsigned long long weight = random(totalWeight);
+        unsigned category = 0;
+        while (weight >= options.weights[category]) {
+            weight -= options.weights[category];
+            ++category;
+        }
+        assert(category < SYNTH_NUM_CATEGORIES);
+
+        switch (category) {
+        case SYNTH_DRAW:
+            return drawCall(thread);
+        case SYNTH_STATE:
+            return stateCall(thread);
+        case SYNTH_UNIFORM:
+            return uniformCall(thread);
+        case SYNTH_UPLOAD:
+            return uploadCall(thread);
+        case SYNTH_SHADER:
+        default:
+            return shaderCall(thread);
+        }
+    }
+
+    Call *
+    newCall(Function function, unsigned thread) {
+        return new Call(&functionSigs[function], 0, thread);
+    }
+
+    static void
+    glenum(Call *call, unsigned index, signed long long value) {
+        const EnumSig *sig = enumArgSigs[call->sig->id][index];
+        assert(sig);
+        call->args[index].emplace<Enum>(sig, value);
+    }
+
+    static void
+    glbitfield(Call *call, unsigned index, unsigned long long value) {
+        const BitmaskSig *sig = bitmaskArgSigs[call->sig->id][index];
+        assert(sig);
+        call->args[index].emplace<Bitmask>(sig, value);
+    }
+
+    static void
+    sint(Call *call, unsigned index, signed long long value) {
+        call->args[index].emplace<SInt>(value);
+    }
+
+    static void
+    uint(Call *call, unsigned index, unsigned long long value) {
+        call->args[index].emplace<UInt>(value);
+    }
+
+    void
+    floats(Call *call, unsigned index, unsigned count) {
+        Array *array = call->arena.create<Array>(count);
+        for (auto & value : array->values) {
+            value = call->arena.create<Float>(random(1000) / 1000.0f);
+        }
+        call->args[index].value = array;
+    }
+
+    Call *
+    drawCall(unsigned thread) {
+        Call *call;
+        if (random(2)) {
+            call = newCall(DRAW_ARRAYS, thread);
+            glenum(call, 0, GL_TRIANGLES);
+            sint(call, 1, random(1024));
+            sint(call, 2, 3 * (1 + random(2048)));
+        } else {
+            call = newCall(DRAW_ELEMENTS, thread);
+            glenum(call, 0, GL_TRIANGLES);
+            sint(call, 1, 3 * (1 + random(2048)));
+            glenum(call, 2, GL_UNSIGNED_SHORT);
+            call->args[3].emplace<Pointer>(2 * random(65536));
+        }
+        return call;
+    }
+
+    Call *
+    stateCall(unsigned thread) {
+        Call *call;
+        switch (random(8)) {
+        case 0:
+            call = newCall(BIND_BUFFER, thread);
+            glenum(call, 0, random(2) ? GL_ARRAY_BUFFER : GL_ELEMENT_ARRAY_BUFFER);
+            uint(call, 1, 1 + random(64));
+            break;
+        case 1:
+            call = newCall(BIND_TEXTURE, thread);
+            glenum(call, 0, GL_TEXTURE_2D);
+            uint(call, 1, 1 + random(64));
+            break;
+        case 2:
+            call = newCall(ENABLE, thread);
+            glenum(call, 0, random(2) ? GL_DEPTH_TEST : GL_BLEND);
+            break;
+        case 3:
+            call = newCall(DISABLE, thread);
+            glenum(call, 0, random(2) ? GL_DEPTH_TEST : GL_BLEND);
+            break;
+        case 4:
+            call = newCall(USE_PROGRAM, thread);
+            uint(call, 0, 1 + random(16));
+            break;
+        case 5:
+            call = newCall(VIEWPORT, thread);
+            sint(call, 0, 0);
+            sint(call, 1, 0);
+            sint(call, 2, 1920);
+            sint(call, 3, 1080);
+            break;
+        case 6:
+            call = newCall(VERTEX_ATTRIB_POINTER, thread);
+            uint(call, 0, random(8));
+            sint(call, 1, 1 + random(4));
+            glenum(call, 2, GL_FLOAT);
+            glenum(call, 3, GL_FALSE);
+            sint(call, 4, 4 * random(16));
+            call->args[5].emplace<Pointer>(4 * random(4096));
+            break;
+        default:
+            call = newCall(CLEAR, thread);
+            glbitfield(call, 0, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            break;
+        }
+        return call;
+    }
+
+    Call *
+    uniformCall(unsigned thread) {
+        Call *call;
+        if (random(2)) {
+            call = newCall(UNIFORM4FV, thread);
+            sint(call, 0, random(32));
+            sint(call, 1, 1);
+            floats(call, 2, 4);
+        } else {
+            call = newCall(UNIFORM_MATRIX4FV, thread);
+            sint(call, 0, random(32));
+            sint(call, 1, 1);
+            glenum(call, 2, GL_FALSE);
+            floats(call, 3, 16);
+        }
+        return call;
+    }
+
+    /*
+     * Blob sizes are spread evenly across powers of two, so that smaller
+     * blobs are more common, as they are in practice.
+     */
+    size_t
+    blobSize(void) {
+        unsigned levels = 0;
+        while ((options.minBlobSize << (levels + 1)) <= options.maxBlobSize) {
+            ++levels;
+        }
+        size_t base = options.minBlobSize << random(levels + 1);
+        size_t size = base + random(base);
+        return std::min(size, options.maxBlobSize);
+    }
+
+    Blob *
+    blob(Call *call, size_t &size) {
+        BlobRef ref;
+        if (!recentBlobs.empty() && random.percent(options.blobRepeat)) {
+            ref = recentBlobs[random(recentBlobs.size())];
+        } else {
+            ref.size = blobSize();
+            ref.offset = random(poolSize - ref.size + 1);
+            const size_t maxRecentBlobs = 32;
+            if (recentBlobs.size() < maxRecentBlobs) {
+                recentBlobs.push_back(ref);
+            } else {
+                recentBlobs[nextRecentBlob++ % maxRecentBlobs] = ref;
+            }
+        }
+        size = ref.size;
+        return call->arena.create<Blob>(ref.size, pool + ref.offset, poolOwner);
+    }
+
+    Call *
+    uploadCall(unsigned thread) {
+        Call *call;
+        size_t size;
+        switch (random(3)) {
+        case 0:
+            call = newCall(BUFFER_DATA, thread);
+            glenum(call, 0, GL_ARRAY_BUFFER);
+            call->args[2].value = blob(call, size);
+            sint(call, 1, size);
+            glenum(call, 3, random(2) ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+            break;
+        case 1:
+            call = newCall(BUFFER_SUB_DATA, thread);
+            glenum(call, 0, GL_ARRAY_BUFFER);
+            sint(call, 1, 16 * random(1024));
+            call->args[3].value = blob(call, size);
+            sint(call, 2, size);
+            break;
+        default:
+            call = newCall(TEX_SUB_IMAGE_2D, thread);
+            call->args[8].value = blob(call, size);
+            glenum(call, 0, GL_TEXTURE_2D);
+            sint(call, 1, 0);
+            sint(call, 2, 0);
+            sint(call, 3, 0);
+            // A single row of RGBA pixels, rounding the blob size down
+            sint(call, 4, size / 4);
+            sint(call, 5, 1);
+            glenum(call, 6, GL_RGBA);
+            glenum(call, 7, GL_UNSIGNED_BYTE);
+            break;
+        }
+        return call;
+    }
+
+    /*
+     * Pick a string from the pool, either repeating an earlier one, or making
+     * a new one.
+     */
+    String *
+    string(Call *call, StringPool &pool) {
+        std::vector<SharedString> &strings = pool.strings;
+        if (!strings.empty() && random.percent(options.stringRepeat)) {
+            const SharedString &string = strings[random(strings.size())];
+            return call->arena.create<String>(string.value, string.owner);
+        }
+
+        unsigned long long id = pool.nextId++;
+        int length = snprintf(NULL, 0, pool.format, id, id, id);
+        char *value = new char[length + 1];
+        snprintf(value, length + 1, pool.format, id, id, id);
+        SharedString string;
+        string.value = value;
+        string.owner.reset(value, std::default_delete<char[]>());
+
+        const size_t maxStrings = 1024;
+        if (strings.size() < maxStrings) {
+            strings.push_back(string);
+        } else {
+            strings[id % maxStrings] = string;
+        }
+        return call->arena.create<String>(string.value, string.owner);
+    }
+
+    Call *
+    shaderCall(unsigned thread) {
+        Call *call;
+        switch (random(3)) {
+        case 0:
+            {
+                call = newCall(SHADER_SOURCE, thread);
+                uint(call, 0, 1 + random(64));
+                sint(call, 1, 1);
+                Array *strings = call->arena.create<Array>(1);
+                strings->values[0] = string(call, sources);
+                call->args[2].value = strings;
+                call->args[3].value = call->arena.create<Null>();
+            }
+            break;
+        case 1:
+            call = newCall(GET_UNIFORM_LOCATION, thread);
+            uint(call, 0, 1 + random(16));
+            call->args[1].value = string(call, uniformNames);
+            call->ret = call->arena.create<SInt>(random(32));
+            break;
+        default:
+            {
+                call = newCall(OBJECT_LABEL, thread);
+                glenum(call, 0, GL_BUFFER);
+                uint(call, 1, 1 + random(64));
+                String *label = string(call, labels);
+                sint(call, 2, strlen(label->value));
+                call->args[3].value = label;
+            }
+            break;
+        }
+        return call;
+    }
+};
+
+
+Synthesizer *
+createSynthesizer(const SynthOptions &options)
+{
+    return new GLSynthesizer(options);
+}
+
+
+} /* namespace trace */
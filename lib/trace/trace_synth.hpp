@@ -0,0 +1,128 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Synthetic GL calls, as used by `apitrace synth` and the benchmarks.
+ */
+
+#pragma once
+
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "trace_model.hpp"
+
+
+namespace trace {
+
+
+/**
+ * Small linear congruential generator, so that the output doesn't depend on
+ * the C library's rand().  Only integer arithmetic is used throughout, for
+ * the same reason.
+ */
+class Random
+{
+    uint64_t state;
+
+public:
+    Random(uint64_t seed) : state(seed * 2 + 1) {}
+
+    uint32_t next(void) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<uint32_t>(state >> 33);
+    }
+
+    // Uniformly distributed in [0, n)
+    uint64_t operator () (uint64_t n) {
+        assert(n > 0);
+        uint64_t value = (uint64_t(next()) << 32) | next();
+        return value % n;
+    }
+
+    bool percent(unsigned pct) {
+        return (*this)(100) < pct;
+    }
+};
+
+
+enum SynthCategory {
+    SYNTH_DRAW = 0,
+    SYNTH_STATE,
+    SYNTH_UNIFORM,
+    SYNTH_UPLOAD,
+    SYNTH_SHADER,
+    SYNTH_NUM_CATEGORIES
+};
+
+extern const char *synthCategoryNames[SYNTH_NUM_CATEGORIES];
+
+
+struct SynthOptions
+{
+    unsigned long long calls = 100000;
+    unsigned frames = 100;
+    unsigned threads = 1;
+
+    // Range of blob sizes, smaller ones being more common
+    size_t minBlobSize = 64;
+    size_t maxBlobSize = 65536;
+
+    // Percentage of blobs repeating a recent one, and of strings repeating
+    // an earlier one
+    unsigned blobRepeat = 30;
+    unsigned stringRepeat = 90;
+
+    // Relative weight of each category of calls
+    unsigned weights[SYNTH_NUM_CATEGORIES] = {35, 30, 25, 7, 3};
+
+    uint64_t seed = 1;
+};
+
+
+class Synthesizer
+{
+public:
+    virtual ~Synthesizer() {}
+
+    /**
+     * Make the call with the given number.  Calls must be made in order,
+     * and the caller owns them.
+     */
+    virtual Call *call(unsigned long long no) = 0;
+};
+
+
+/**
+ * Create a synthesizer of GL calls, as the GL tracer writes them.  The same
+ * options and seed always produce the same calls.
+ */
+Synthesizer *
+createSynthesizer(const SynthOptions &options);
+
+
+} /* namespace trace */
@@ -0,0 +1,183 @@
+##########################################################################
+#
+# Copyright 2026 VMware, Inc.
+# All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+##########################################################################/
+
+
+"""Generate trace_synth_sigs.hpp, with the signatures of the calls which
+trace_synth.cpp synthesizes, as the GL tracer writes them.
+"""
+
+
+import os.path
+import sys
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', '..'))
+
+import specs.stdapi as stdapi
+from specs.glapi import glapi
+from specs.glxapi import glxapi
+
+
+# Synthesized functions, and the name of their Function enum value
+functions = [
+    ('DRAW_ARRAYS', 'glDrawArrays'),
+    ('DRAW_ELEMENTS', 'glDrawElements'),
+    ('BIND_BUFFER', 'glBindBuffer'),
+    ('BIND_TEXTURE', 'glBindTexture'),
+    ('ENABLE', 'glEnable'),
+    ('DISABLE', 'glDisable'),
+    ('USE_PROGRAM', 'glUseProgram'),
+    ('VIEWPORT', 'glViewport'),
+    ('VERTEX_ATTRIB_POINTER', 'glVertexAttribPointer'),
+    ('CLEAR', 'glClear'),
+    ('UNIFORM4FV', 'glUniform4fv'),
+    ('UNIFORM_MATRIX4FV', 'glUniformMatrix4fv'),
+    ('BUFFER_DATA', 'glBufferData'),
+    ('BUFFER_SUB_DATA', 'glBufferSubData'),
+    ('TEX_SUB_IMAGE_2D', 'glTexSubImage2D'),
+    ('SHADER_SOURCE', 'glShaderSource'),
+    ('GET_UNIFORM_LOCATION', 'glGetUniformLocation'),
+    ('OBJECT_LABEL', 'glObjectLabel'),
+    ('SWAP_BUFFERS', 'glXSwapBuffers'),
+]
+
+
+def getFunction(name):
+    for module in (glapi, glxapi):
+        function = module.getFunctionByName(name)
+        if function is not None:
+            return function
+    raise KeyError(name)
+
+
+def unwrap(type):
+    '''Strip aliases and qualifiers, down to the type the tracer writes.'''
+    while isinstance(type, (stdapi.Alias, stdapi.Const)):
+        type = type.type
+    return type
+
+
+def writeEnum(enum):
+    print 'static const trace::EnumValue _enum%s_values[] = {' % (enum.tag)
+    for value in enum.values:
+        print '    {"%s", %s},' % (value, value)
+    print '};'
+    print
+    print 'static const trace::EnumSig _enum%s_sig = {' % (enum.tag)
+    print '    %u, %u, _enum%s_values' % (enum.id, len(enum.values), enum.tag)
+    print '};'
+    print
+
+
+def writeBitmask(bitmask):
+    print 'static const trace::BitmaskFlag _bitmask%s_flags[] = {' % (bitmask.tag)
+    for value in bitmask.values:
+        print '    {"%s", %s},' % (value, value)
+    print '};'
+    print
+    print 'static const trace::BitmaskSig _bitmask%s_sig = {' % (bitmask.tag)
+    print '    %u, %u, _bitmask%s_flags' % (bitmask.id, len(bitmask.values), bitmask.tag)
+    print '};'
+    print
+
+
+def argSigs(function, kind, prefix):
+    '''Array with the signature of each argument of the given kind.'''
+    sigs = []
+    for arg in function.args:
+        type = unwrap(arg.type)
+        if isinstance(type, kind):
+            sigs.append('&_%s%s_sig' % (prefix, type.tag))
+        else:
+            sigs.append('nullptr')
+    return '{%s}' % ', '.join(sigs)
+
+
+def main():
+    print '/* Generated by %s from the API specs -- do not edit */' % os.path.basename(__file__)
+    print
+    print '#pragma once'
+    print
+    print '#include "glimports.hpp"'
+    print
+    print '#include "trace_model.hpp"'
+    print
+    print
+    print 'namespace trace {'
+    print
+
+    enums = []
+    bitmasks = []
+    for _, name in functions:
+        function = getFunction(name)
+        for arg in function.args:
+            type = unwrap(arg.type)
+            if isinstance(type, stdapi.Enum) and type not in enums:
+                enums.append(type)
+            if isinstance(type, stdapi.Bitmask) and type not in bitmasks:
+                bitmasks.append(type)
+    for enum in enums:
+        writeEnum(enum)
+    for bitmask in bitmasks:
+        writeBitmask(bitmask)
+
+    print 'enum Function {'
+    for value, _ in functions:
+        print '    %s,' % value
+    print '    NUM_FUNCTIONS'
+    print '};'
+    print
+
+    for _, name in functions:
+        function = getFunction(name)
+        print 'static const char * _%s_args[%u] = {%s};' % (function.name, len(function.args), ', '.join(['"%s"' % arg.name for arg in function.args]))
+    print
+
+    print 'static const FunctionSig functionSigs[NUM_FUNCTIONS] = {'
+    for value, name in functions:
+        function = getFunction(name)
+        print '    {%s, "%s", %u, _%s_args},' % (value, function.sigName(), len(function.args), function.name)
+    print '};'
+    print
+
+    # Enum and bitmask signatures of each function's arguments, nullptr for
+    # arguments of other types
+    for kind, prefix, sigType in (
+        (stdapi.Enum, 'enum', 'EnumSig'),
+        (stdapi.Bitmask, 'bitmask', 'BitmaskSig'),
+    ):
+        for _, name in functions:
+            function = getFunction(name)
+            print 'static const %s * _%s_%s_sigs[%u] = %s;' % (sigType, function.name, prefix, len(function.args), argSigs(function, kind, prefix))
+        print
+        print 'static const %s * const * %sArgSigs[NUM_FUNCTIONS] = {' % (sigType, prefix)
+        for _, name in functions:
+            print '    _%s_%s_sigs,' % (name, prefix)
+        print '};'
+        print
+
+    print '} /* namespace trace */'
+
+
+if __name__ == '__main__':
+    main()
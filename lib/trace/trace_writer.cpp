@@ -40,10 +40,127 @@
 namespace trace {
 
 
+// Larger call details are written without a length prefix
+#define CALL_DETAILS_MAX_BUFFERED (64 * 1024)
+
+// Smaller blobs are always written in full, as references would save little
+#define BLOB_DEDUP_MIN_SIZE 256
+
+// Forget blobs written since the last synchronization event once they take
+// this much memory.  Larger blobs are always written in full.
+#define BLOB_DEDUP_MAX_SIZE (32 * 1024 * 1024)
+
+// Shorter strings are always written in full
+#define STRING_REF_MIN_LENGTH 8
+
+// Forget strings written since the last synchronization event once they
+// take this much memory
+#define STRING_REF_MAX_SIZE (4 * 1024 * 1024)
+
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t
+rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+load64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static inline uint64_t
+hashRound(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t
+hashMerge(uint64_t acc, uint64_t v) {
+    acc ^= hashRound(0, v);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * 64-bit hash of blob contents, following the XXH64 algorithm, which
+ * processes 32 bytes per iteration.
+ */
+static uint64_t
+hashBlob(const void *data, size_t size) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = PRIME64_1 + PRIME64_2;
+        uint64_t v2 = PRIME64_2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - PRIME64_1;
+        do {
+            v1 = hashRound(v1, load64(p));
+            v2 = hashRound(v2, load64(p + 8));
+            v3 = hashRound(v3, load64(p + 16));
+            v4 = hashRound(v4, load64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = hashMerge(h, v1);
+        h = hashMerge(h, v2);
+        h = hashMerge(h, v3);
+        h = hashMerge(h, v4);
+    } else {
+        h = PRIME64_5;
+    }
+
+    h += size;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= hashRound(0, load64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        uint32_t v;
+        memcpy(&v, p, sizeof v);
+        h ^= uint64_t(v) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= *p * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+
+
 Writer::Writer() :
-    call_no(0)
+    call_no(0),
+    m_callLengths(false),
+    m_bufferingDetails(false),
+    m_skippableDetails(false),
+    m_dedupBlobs(false),
+    m_stringRefs(false)
 {
     m_file = nullptr;
+    m_blobs.size = 0;
+    m_blobs.nextId = 0;
+    m_strings.size = 0;
+    m_strings.nextId = 0;
 }
 
 Writer::~Writer()
@@ -59,19 +176,24 @@ Writer::close(void) {
 
 bool
 Writer::open(const char *filename) {
+    return open(createSnappyStream(filename));
+}
+
+bool
+Writer::open(OutStream *stream) {
     close();
 
-    m_file = createSnappyStream(filename);
+    m_file = stream;
     if (!m_file) {
         return false;
     }
 
     call_no = 0;
-    functions.clear();
-    structs.clear();
-    enums.clear();
-    bitmasks.clear();
-    frames.clear();
+    clearSigDefinitions();
+    m_bufferingDetails = false;
+    m_details.clear();
+    m_blobs.nextId = 0;
+    m_strings.nextId = 0;
 
     _writeUInt(TRACE_VERSION);
 
@@ -80,6 +202,14 @@ Writer::open(const char *filename) {
 
 void inline
 Writer::_write(const void *sBuffer, size_t dwBytesToWrite) {
+    if (m_bufferingDetails) {
+        if (m_details.size() + dwBytesToWrite <= CALL_DETAILS_MAX_BUFFERED) {
+            const char *data = static_cast<const char *>(sBuffer);
+            m_details.insert(m_details.end(), data, data + dwBytesToWrite);
+            return;
+        }
+        _flushDetails();
+    }
     m_file->write(sBuffer, dwBytesToWrite);
 }
 
@@ -135,68 +265,230 @@ inline bool lookup(std::vector<bool> &map, size_t index) {
     }
 }
 
-void Writer::beginBacktrace(unsigned num_frames) {
-    if (num_frames) {
-        _writeByte(trace::CALL_BACKTRACE);
-        _writeUInt(num_frames);
+void Writer::clearSigDefinitions(void) {
+    functions.clear();
+    structs.clear();
+    enums.clear();
+    bitmasks.clear();
+    frames.clear();
+    m_blobs.definitions.clear();
+    m_blobs.size = 0;
+    m_strings.definitions.clear();
+    m_strings.size = 0;
+}
+
+bool Writer::beginSigDefinition(SigKind kind, size_t id, const void *sig) {
+    std::vector<bool> *map;
+    switch (kind) {
+    case SIG_FUNCTION:
+        map = &functions;
+        break;
+    case SIG_STRUCT:
+        map = &structs;
+        break;
+    case SIG_ENUM:
+        map = &enums;
+        break;
+    case SIG_BITMASK:
+        map = &bitmasks;
+        break;
+    case SIG_FRAME:
+        map = &frames;
+        break;
+    default:
+        assert(0);
+        return false;
     }
+
+    if (lookup(*map, id)) {
+        return false;
+    }
+    (*map)[id] = true;
+    return true;
 }
 
-void Writer::writeStackFrame(const RawStackFrame *frame) {
-    _writeUInt(frame->id);
-    if (!lookup(frames, frame->id)) {
-        if (frame->module != NULL) {
-            _writeByte(trace::BACKTRACE_MODULE);
-            _writeString(frame->module);
+/**
+ * Emit a synchronization event if the stream just started a new chunk.
+ */
+void Writer::_beginEvent(void) {
+    if (m_file->beginEvent()) {
+        _writeSync(call_no);
+    }
+}
+
+/**
+ * Start buffering the details of a call, to write their length first.
+ */
+void Writer::_beginDetails(void) {
+    if (m_callLengths) {
+        assert(m_details.empty());
+        m_bufferingDetails = true;
+        m_skippableDetails = true;
+    }
+}
+
+/**
+ * Write the details buffered so far without a length prefix, and the rest
+ * of them straight away.  Skipping large details costs little anyway.
+ */
+void Writer::_flushDetails(void) {
+    m_bufferingDetails = false;
+    m_file->write(m_details.data(), m_details.size());
+    m_details.clear();
+}
+
+void Writer::_endDetails(void) {
+    if (!m_bufferingDetails) {
+        return;
+    }
+
+    m_bufferingDetails = false;
+
+    // Signatures defined within the details must not be skipped
+    if (m_skippableDetails) {
+        _writeByte(trace::CALL_LENGTH);
+        _writeUInt(m_details.size());
+    }
+
+    m_file->write(m_details.data(), m_details.size());
+    m_details.clear();
+}
+
+void Writer::_writeSync(unsigned next_call_no) {
+    // Signatures and blobs must be defined again after synchronization events
+    clearSigDefinitions();
+
+    _writeByte(trace::EVENT_SYNC);
+    _writeUInt(next_call_no);
+}
+
+/**
+ * Write a signature reference, followed by its definition when needed.  The
+ * least significant bit of the ID tells the parser whether the definition
+ * follows.
+ */
+void Writer::_writeSig(SigKind kind, size_t id, const void *sig) {
+    bool define = beginSigDefinition(kind, id, sig);
+    _writeUInt(id << 1 | (define ? 1 : 0));
+    if (define) {
+        m_skippableDetails = false;
+        _writeSigDefinition(kind, sig);
+        endSigDefinition();
+    }
+}
+
+void Writer::_writeSigDefinition(SigKind kind, const void *sig) {
+    switch (kind) {
+    case SIG_FUNCTION:
+        {
+            const FunctionSig *function = static_cast<const FunctionSig *>(sig);
+            _writeString(function->name);
+            _writeUInt(function->num_args);
+            for (unsigned i = 0; i < function->num_args; ++i) {
+                _writeString(function->arg_names[i]);
+            }
         }
-        if (frame->function != NULL) {
-            _writeByte(trace::BACKTRACE_FUNCTION);
-            _writeString(frame->function);
+        break;
+    case SIG_STRUCT:
+        {
+            const StructSig *structure = static_cast<const StructSig *>(sig);
+            _writeString(structure->name);
+            _writeUInt(structure->num_members);
+            for (unsigned i = 0; i < structure->num_members; ++i) {
+                _writeString(structure->member_names[i]);
+            }
         }
-        if (frame->filename != NULL) {
-            _writeByte(trace::BACKTRACE_FILENAME);
-            _writeString(frame->filename);
+        break;
+    case SIG_ENUM:
+        {
+            const EnumSig *enumeration = static_cast<const EnumSig *>(sig);
+            _writeUInt(enumeration->num_values);
+            for (unsigned i = 0; i < enumeration->num_values; ++i) {
+                _writeString(enumeration->values[i].name);
+                writeSInt(enumeration->values[i].value);
+            }
         }
-        if (frame->linenumber >= 0) {
-            _writeByte(trace::BACKTRACE_LINENUMBER);
-            _writeUInt(frame->linenumber);
+        break;
+    case SIG_BITMASK:
+        {
+            const BitmaskSig *bitmask = static_cast<const BitmaskSig *>(sig);
+            _writeUInt(bitmask->num_flags);
+            for (unsigned i = 0; i < bitmask->num_flags; ++i) {
+                if (i != 0 && bitmask->flags[i].value == 0) {
+                    os::log("apitrace: warning: sig %s is zero but is not first flag\n", bitmask->flags[i].name);
+                }
+                _writeString(bitmask->flags[i].name);
+                _writeUInt(bitmask->flags[i].value);
+            }
         }
-        if (frame->offset >= 0) {
-            _writeByte(trace::BACKTRACE_OFFSET);
-            _writeUInt(frame->offset);
+        break;
+    case SIG_FRAME:
+        {
+            const RawStackFrame *frame = static_cast<const RawStackFrame *>(sig);
+            if (frame->module != NULL) {
+                _writeByte(trace::BACKTRACE_MODULE);
+                _writeString(frame->module);
+            }
+            if (frame->function != NULL) {
+                _writeByte(trace::BACKTRACE_FUNCTION);
+                _writeString(frame->function);
+            }
+            if (frame->filename != NULL) {
+                _writeByte(trace::BACKTRACE_FILENAME);
+                _writeString(frame->filename);
+            }
+            if (frame->linenumber >= 0) {
+                _writeByte(trace::BACKTRACE_LINENUMBER);
+                _writeUInt(frame->linenumber);
+            }
+            if (frame->offset >= 0) {
+                _writeByte(trace::BACKTRACE_OFFSET);
+                _writeUInt(frame->offset);
+            }
+            _writeByte(trace::BACKTRACE_END);
         }
-        _writeByte(trace::BACKTRACE_END);
-        frames[frame->id] = true;
+        break;
+    default:
+        assert(0);
     }
 }
 
+void Writer::beginBacktrace(unsigned num_frames) {
+    if (num_frames) {
+        _writeByte(trace::CALL_BACKTRACE);
+        _writeUInt(num_frames);
+    }
+}
+
+void Writer::writeStackFrame(const RawStackFrame *frame) {
+    _writeSig(SIG_FRAME, frame->id, frame);
+}
+
 unsigned Writer::beginEnter(const FunctionSig *sig, unsigned thread_id) {
+    _beginEvent();
     _writeByte(trace::EVENT_ENTER);
     _writeUInt(thread_id);
-    _writeUInt(sig->id);
-    if (!lookup(functions, sig->id)) {
-        _writeString(sig->name);
-        _writeUInt(sig->num_args);
-        for (unsigned i = 0; i < sig->num_args; ++i) {
-            _writeString(sig->arg_names[i]);
-        }
-        functions[sig->id] = true;
-    }
+    _writeSig(SIG_FUNCTION, sig->id, sig);
+    _beginDetails();
 
     return call_no++;
 }
 
 void Writer::endEnter(void) {
     _writeByte(trace::CALL_END);
+    _endDetails();
 }
 
 void Writer::beginLeave(unsigned call) {
+    _beginEvent();
     _writeByte(trace::EVENT_LEAVE);
     _writeUInt(call);
+    _beginDetails();
 }
 
 void Writer::endLeave(void) {
     _writeByte(trace::CALL_END);
+    _endDetails();
 }
 
 void Writer::beginArg(unsigned index) {
@@ -215,15 +507,7 @@ void Writer::beginArray(size_t length) {
 
 void Writer::beginStruct(const StructSig *sig) {
     _writeByte(trace::TYPE_STRUCT);
-    _writeUInt(sig->id);
-    if (!lookup(structs, sig->id)) {
-        _writeString(sig->name);
-        _writeUInt(sig->num_members);
-        for (unsigned i = 0; i < sig->num_members; ++i) {
-            _writeString(sig->member_names[i]);
-        }
-        structs[sig->id] = true;
-    }
+    _writeSig(SIG_STRUCT, sig->id, sig);
 }
 
 void Writer::beginRepr(void) {
@@ -264,8 +548,7 @@ void Writer::writeString(const char *str) {
         Writer::writeNull();
         return;
     }
-    _writeByte(trace::TYPE_STRING);
-    _writeString(str);
+    writeString(str, strlen(str));
 }
 
 void Writer::writeString(const char *str, size_t len) {
@@ -273,6 +556,10 @@ void Writer::writeString(const char *str, size_t len) {
         Writer::writeNull();
         return;
     }
+    if (m_stringRefs && len >= STRING_REF_MIN_LENGTH &&
+        _writeRef(m_strings, STRING_REF_MAX_SIZE, trace::TYPE_STRING_REF, str, len)) {
+        return;
+    }
     _writeByte(trace::TYPE_STRING);
     _writeUInt(len);
     _write(str, len);
@@ -316,6 +603,10 @@ void Writer::writeBlob(const void *data, size_t size) {
         Writer::writeNull();
         return;
     }
+    if (m_dedupBlobs && size >= BLOB_DEDUP_MIN_SIZE &&
+        _writeRef(m_blobs, BLOB_DEDUP_MAX_SIZE, trace::TYPE_BLOB_REF, data, size)) {
+        return;
+    }
     _writeByte(trace::TYPE_BLOB);
     _writeUInt(size);
     if (size) {
@@ -323,34 +614,62 @@ void Writer::writeBlob(const void *data, size_t size) {
     }
 }
 
+/**
+ * Write a blob or string reference, followed by the contents unless
+ * identical contents were written since the last synchronization event.
+ * The least significant bit of the ID tells the parser whether the contents
+ * follow.
+ *
+ * Returns false, writing nothing, if the contents are too large to be kept
+ * for comparison, in which case they must be written in full.
+ */
+bool Writer::_writeRef(RefWindow &window, size_t maxSize, char type,
+                       const void *data, size_t size) {
+    if (size > maxSize) {
+        return false;
+    }
+
+    uint64_t hash = hashBlob(data, size);
+    auto it = window.definitions.find(hash);
+    if (it != window.definitions.end() &&
+        it->second.value.size() == size &&
+        memcmp(it->second.value.data(), data, size) == 0) {
+        _writeByte(type);
+        _writeUInt(it->second.id << 1);
+        return true;
+    }
+
+    if (window.size + size > maxSize) {
+        window.definitions.clear();
+        window.size = 0;
+    }
+
+    unsigned long long id = window.nextId++;
+    RefDefinition &definition = window.definitions[hash];
+    window.size -= definition.value.size();
+    window.size += size;
+    definition.value.assign(static_cast<const char *>(data), size);
+    definition.id = id;
+
+    // The parser must see the definition for later references to resolve
+    m_skippableDetails = false;
+
+    _writeByte(type);
+    _writeUInt(id << 1 | 1);
+    _writeUInt(size);
+    _write(data, size);
+    return true;
+}
+
 void Writer::writeEnum(const EnumSig *sig, signed long long value) {
     _writeByte(trace::TYPE_ENUM);
-    _writeUInt(sig->id);
-    if (!lookup(enums, sig->id)) {
-        _writeUInt(sig->num_values);
-        for (unsigned i = 0; i < sig->num_values; ++i) {
-            _writeString(sig->values[i].name);
-            writeSInt(sig->values[i].value);
-        }
-        enums[sig->id] = true;
-    }
+    _writeSig(SIG_ENUM, sig->id, sig);
     writeSInt(value);
 }
 
 void Writer::writeBitmask(const BitmaskSig *sig, unsigned long long value) {
     _writeByte(trace::TYPE_BITMASK);
-    _writeUInt(sig->id);
-    if (!lookup(bitmasks, sig->id)) {
-        _writeUInt(sig->num_flags);
-        for (unsigned i = 0; i < sig->num_flags; ++i) {
-            if (i != 0 && sig->flags[i].value == 0) {
-                os::log("apitrace: warning: sig %s is zero but is not first flag\n", sig->flags[i].name);
-            }
-            _writeString(sig->flags[i].name);
-            _writeUInt(sig->flags[i].value);
-        }
-        bitmasks[sig->id] = true;
-    }
+    _writeSig(SIG_BITMASK, sig->id, sig);
     _writeUInt(value);
 }
 
@@ -32,6 +32,11 @@
 
 #include <stddef.h>
 
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "trace_model.hpp"
@@ -42,7 +47,7 @@ namespace trace {
     class Writer {
     protected:
         OutStream *m_file;
-        unsigned call_no;
+        std::atomic<unsigned> call_no;
 
         std::vector<bool> functions;
         std::vector<bool> structs;
@@ -50,11 +55,80 @@ namespace trace {
         std::vector<bool> bitmasks;
         std::vector<bool> frames;
 
+        /**
+         * Whether to prefix call details with their length, so that parsers
+         * can skip whole calls at once.  Details are buffered while the
+         * call is written, and are written unprefixed if they grow large or
+         * define signatures.  Off by default, as buffering costs a copy of
+         * every call.
+         */
+        bool m_callLengths;
+        bool m_bufferingDetails;
+        bool m_skippableDetails;
+        std::vector<char> m_details;
+
+        /**
+         * Blobs or strings written since the last synchronization event, by
+         * hash of their contents.  The contents are kept too, so that hash
+         * collisions are never mistaken for repeats.
+         */
+        struct RefDefinition {
+            std::string value;
+            unsigned long long id;
+        };
+
+        struct RefWindow {
+            std::unordered_map<uint64_t, RefDefinition> definitions;
+            size_t size;
+            unsigned long long nextId;
+        };
+
+        /**
+         * Whether to write large blobs already written since the last
+         * synchronization event as references to the earlier copy.  Off by
+         * default, as every such blob is hashed and copied.
+         */
+        bool m_dedupBlobs;
+        RefWindow m_blobs;
+
+        /**
+         * Whether to likewise write strings already written since the last
+         * synchronization event as references.  Off by default.
+         */
+        bool m_stringRefs;
+        RefWindow m_strings;
+
     public:
+        enum SigKind {
+            SIG_FUNCTION = 0,
+            SIG_STRUCT,
+            SIG_ENUM,
+            SIG_BITMASK,
+            SIG_FRAME,
+            SIG_KIND_COUNT
+        };
+
         Writer();
-        ~Writer();
+        virtual ~Writer();
 
         bool open(const char *filename);
+
+        /**
+         * Write to the given stream, taking ownership of it.
+         */
+        bool open(OutStream *stream);
+
+        void setCallLengths(bool enable) {
+            m_callLengths = enable;
+        }
+
+        void setDedupBlobs(bool enable) {
+            m_dedupBlobs = enable;
+        }
+
+        void setStringRefs(bool enable) {
+            m_stringRefs = enable;
+        }
         void close(void);
 
         unsigned beginEnter(const FunctionSig *sig, unsigned thread_id);
@@ -103,6 +177,26 @@ namespace trace {
         void writeCall(Call *call);
 
     protected:
+        /**
+         * Called whenever a signature is referred.  Returns true if its
+         * definition must follow, in which case endSigDefinition() is called
+         * once it has been written.
+         */
+        virtual bool beginSigDefinition(SigKind kind, size_t id, const void *sig);
+        virtual void endSigDefinition(void) {}
+
+        void clearSigDefinitions(void);
+
+        void _beginEvent(void);
+        void _beginDetails(void);
+        void _flushDetails(void);
+        void _endDetails(void);
+        void _writeSync(unsigned next_call_no);
+        void _writeSig(SigKind kind, size_t id, const void *sig);
+        void _writeSigDefinition(SigKind kind, const void *sig);
+        bool _writeRef(RefWindow &window, size_t maxSize, char type,
+                       const void *data, size_t size);
+
         void inline _write(const void *sBuffer, size_t dwBytesToWrite);
         void inline _writeByte(char c);
         void inline _writeUInt(unsigned long long value);
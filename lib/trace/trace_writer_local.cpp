@@ -30,6 +30,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <vector>
+
 #include "os.hpp"
 #include "os_thread.hpp"
 #include "os_string.hpp"
@@ -43,6 +45,13 @@
 namespace trace {
 
 
+// Number of times to poll for our turn to commit, before blocking
+#define THREAD_RECORD_SPIN_COUNT 1024
+
+// Larger record buffers are released after being committed
+#define THREAD_RECORD_MAX_RETAINED_SIZE (256 * 1024)
+
+
 static const char *memcpy_args[3] = {"dest", "src", "n"};
 const FunctionSig memcpy_sig = {0, "memcpy", 3, memcpy_args};
 
@@ -56,6 +65,145 @@ static const char *realloc_args[2] = {"ptr", "size"};
 const FunctionSig realloc_sig = {3, "realloc", 2, realloc_args};
 
 
+/**
+ * Call record being serialized by a thread.
+ */
+struct ThreadRecord
+{
+    std::vector<char> data;
+
+    /**
+     * Signature reference in data, whose definition is only committed if it
+     * isn't already defined in the trace file at that point.
+     */
+    struct Reference {
+        // Offset of the signature ID
+        size_t begin;
+        // End of the definition, when included
+        size_t end;
+        bool defined;
+        Writer::SigKind kind;
+        size_t id;
+        const void *sig;
+    };
+    std::vector<Reference> references;
+
+    // Signatures known to be defined in the trace file, as of epoch
+    std::vector<bool> defined[Writer::SIG_KIND_COUNT];
+    unsigned epoch = 0;
+
+    // Whether an event was begun but not committed yet
+    bool pending = false;
+
+    bool enter = false;
+    unsigned call = 0;
+
+    // Size of the enter event header, and the references therein
+    size_t enterSize = 0;
+    size_t enterReferences = 0;
+};
+
+static OS_THREAD_SPECIFIC_PTR(ThreadRecord)
+threadRecord;
+
+
+/*
+ * Records of threads which exited, for new threads to reuse, so that
+ * applications creating many short lived threads don't leak a record each.
+ */
+static os::mutex freeRecordsMutex;
+static std::vector<ThreadRecord *> freeRecords;
+
+
+static void
+threadExit(void *ptr)
+{
+    localWriter.releaseRecord(static_cast<ThreadRecord *>(ptr));
+}
+
+/*
+ * Same record as threadRecord, through a key whose destructor releases it
+ * when the thread exits.  Compiler TLS can't have destructors, so
+ * threadRecord remains the one looked up on every event.
+ */
+static os::thread_specific<ThreadRecord *>
+threadRecordKey(threadExit);
+
+/*
+ * Set once the thread's record was released, after which records are only
+ * lent for one event at a time, since the key destructor won't run again.
+ */
+static OS_THREAD_SPECIFIC(uintptr_t)
+threadExited;
+
+
+static ThreadRecord *
+newThreadRecord(void)
+{
+    ThreadRecord *record = nullptr;
+    {
+        os::unique_lock<os::mutex> lock(freeRecordsMutex);
+        if (!freeRecords.empty()) {
+            record = freeRecords.back();
+            freeRecords.pop_back();
+        }
+    }
+    if (!record) {
+        record = new ThreadRecord;
+    }
+    if (!threadExited) {
+        threadRecordKey = record;
+    }
+    threadRecord = record;
+    return record;
+}
+
+
+static void
+freeThreadRecord(ThreadRecord *record)
+{
+    threadRecord = nullptr;
+    record->data.clear();
+    record->references.clear();
+    record->epoch = 0;
+    record->pending = false;
+    record->enter = false;
+    os::unique_lock<os::mutex> lock(freeRecordsMutex);
+    freeRecords.push_back(record);
+}
+
+
+/**
+ * Stream which appends everything written to the calling thread's record,
+ * wrapping the trace file stream to which records are eventually committed.
+ */
+class ThreadBufferedStream : public OutStream
+{
+public:
+    OutStream *stream;
+
+    ThreadBufferedStream(OutStream *_stream) :
+        stream(_stream)
+    {}
+
+    ~ThreadBufferedStream() {
+        delete stream;
+    }
+
+    bool write(const void *buffer, size_t length) override {
+        ThreadRecord *record = threadRecord;
+        assert(record);
+        const char *data = static_cast<const char *>(buffer);
+        record->data.insert(record->data.end(), data, data + length);
+        return true;
+    }
+
+    void flush(void) override {
+        stream->flush();
+    }
+};
+
+
 static void exceptionCallback(void)
 {
     localWriter.flush();
@@ -63,11 +211,30 @@ static void exceptionCallback(void)
 
 
 LocalWriter::LocalWriter() :
-    acquired(0)
+    acquired(0),
+    epoch(0),
+    nextEnter(0),
+    orderWaiters(0)
 {
     os::String process = os::getProcessName();
     os::log("apitrace: loaded into %s\n", process.str());
 
+    const char *threadBuffers = getenv("APITRACE_THREAD_BUFFERS");
+    bufferPerThread = threadBuffers && atoi(threadBuffers) != 0;
+    if (bufferPerThread) {
+        os::log("apitrace: buffering calls per thread\n");
+
+        // Records only know which signatures they define when committed,
+        // so neither call lengths nor references can be used
+    } else {
+        const char *callLengths = getenv("APITRACE_CALL_LENGTHS");
+        m_callLengths = callLengths && atoi(callLengths) != 0;
+        const char *dedupBlobs = getenv("APITRACE_DEDUP_BLOBS");
+        m_dedupBlobs = dedupBlobs && atoi(dedupBlobs) != 0;
+        const char *stringRefs = getenv("APITRACE_STRING_REFS");
+        m_stringRefs = stringRefs && atoi(stringRefs) != 0;
+    }
+
     // Install the signal handlers as early as possible, to prevent
     // interfering with the application's signal handling.
     os::setExceptionCallback(exceptionCallback);
@@ -144,15 +311,22 @@ LocalWriter::open(void) {
         os::abort();
     }
 
+    if (bufferPerThread) {
+        m_file = new ThreadBufferedStream(m_file);
+        nextEnter = 0;
+    }
+
     pid = os::getCurrentProcessId();
 
+    ++epoch;
+
 #if 0
     // For debugging the exception handler
     *((int *)0) = 0;
 #endif
 }
 
-static uintptr_t next_thread_num = 1;
+static std::atomic<uintptr_t> next_thread_num(1);
 
 static OS_THREAD_SPECIFIC(uintptr_t)
 thread_num;
@@ -163,8 +337,9 @@ void LocalWriter::checkProcessId(void) {
         // We are a forked child process that inherited the trace file, so
         // create a new file.  We can't call any method of the current
         // file, as it may cause it to flush and corrupt the parent's
-        // trace, so we effectively leak the old file object.
-        close();
+        // trace, nor wait on its compression thread, which didn't survive
+        // the fork, so we effectively leak the old file object.
+        m_file = nullptr;
         // Don't want to open the same file again
         os::unsetEnvironment("TRACE_FILE");
         open();
@@ -172,12 +347,17 @@ void LocalWriter::checkProcessId(void) {
 }
 
 unsigned LocalWriter::beginEnter(const FunctionSig *sig, bool fake) {
-    mutex.lock();
-    ++acquired;
+    ThreadRecord *record = nullptr;
+    if (bufferPerThread) {
+        record = beginRecord();
+    } else {
+        mutex.lock();
+        ++acquired;
 
-    checkProcessId();
-    if (!m_file) {
-        open();
+        checkProcessId();
+        if (!m_file) {
+            open();
+        }
     }
 
     uintptr_t this_thread_num = thread_num;
@@ -189,6 +369,12 @@ unsigned LocalWriter::beginEnter(const FunctionSig *sig, bool fake) {
     assert(this_thread_num);
     unsigned thread_id = this_thread_num - 1;
     unsigned call_no = Writer::beginEnter(sig, thread_id);
+    if (record) {
+        record->enter = true;
+        record->call = call_no;
+        record->enterSize = record->data.size();
+        record->enterReferences = record->references.size();
+    }
     if (!fake && os::backtrace_is_needed(sig->name)) {
         std::vector<RawStackFrame> backtrace = os::get_backtrace();
         beginBacktrace(backtrace.size());
@@ -202,20 +388,229 @@ unsigned LocalWriter::beginEnter(const FunctionSig *sig, bool fake) {
 
 void LocalWriter::endEnter(void) {
     Writer::endEnter();
-    --acquired;
-    mutex.unlock();
+    if (bufferPerThread) {
+        commitRecord(threadRecord);
+    } else {
+        --acquired;
+        mutex.unlock();
+    }
 }
 
 void LocalWriter::beginLeave(unsigned call) {
-    mutex.lock();
-    ++acquired;
+    if (bufferPerThread) {
+        ThreadRecord *record = beginRecord();
+        record->enter = false;
+    } else {
+        mutex.lock();
+        ++acquired;
+    }
     Writer::beginLeave(call);
 }
 
 void LocalWriter::endLeave(void) {
     Writer::endLeave();
+    if (bufferPerThread) {
+        commitRecord(threadRecord);
+    } else {
+        --acquired;
+        mutex.unlock();
+    }
+}
+
+/**
+ * Prepare the calling thread's record for a new enter/leave event.
+ */
+ThreadRecord *LocalWriter::beginRecord(void) {
+    unsigned currentEpoch = epoch.load(std::memory_order_acquire);
+    if (!currentEpoch || os::getCurrentProcessId() != pid) {
+        mutex.lock();
+        ++acquired;
+        checkProcessId();
+        if (!m_file) {
+            open();
+        }
+        currentEpoch = epoch;
+        --acquired;
+        mutex.unlock();
+    }
+
+    ThreadRecord *record = threadRecord;
+    if (!record) {
+        record = newThreadRecord();
+    }
+
+    if (record->epoch != currentEpoch) {
+        for (auto & defined : record->defined) {
+            defined.clear();
+        }
+        record->epoch = currentEpoch;
+    }
+
+    assert(record->data.empty());
+    assert(record->references.empty());
+    record->pending = true;
+    return record;
+}
+
+/**
+ * Write the calling thread's record into the trace file, along with any
+ * signature definitions not yet committed by other threads.
+ */
+void LocalWriter::commitRecord(ThreadRecord *record) {
+    assert(record);
+
+    if (record->enter) {
+        waitForTurn(record->call);
+    }
+
+    mutex.lock();
+    ++acquired;
+
+    OutStream *stream = static_cast<ThreadBufferedStream *>(m_file)->stream;
+    std::vector<char> &data = record->data;
+    size_t size = data.size();
+
+    // Anything serialized now is appended to the record past its end, and
+    // written out straight away.
+    if (stream->beginEvent()) {
+        _writeSync(nextEnter.load(std::memory_order_relaxed));
+        stream->write(data.data() + size, data.size() - size);
+        data.resize(size);
+    }
+
+    size_t offset = 0;
+    for (auto & reference : record->references) {
+        stream->write(data.data() + offset, reference.begin - offset);
+
+        // Rewrite the ID's least significant bit, which tells whether the
+        // definition follows
+        size_t idEnd = reference.begin;
+        while (data[idEnd++] & 0x80)
+            ;
+        bool define = Writer::beginSigDefinition(reference.kind, reference.id, reference.sig);
+        char c = (data[reference.begin] & ~1) | (define ? 1 : 0);
+        stream->write(&c, 1);
+        stream->write(data.data() + reference.begin + 1, idEnd - reference.begin - 1);
+
+        if (reference.defined) {
+            if (define) {
+                stream->write(data.data() + idEnd, reference.end - idEnd);
+            }
+            offset = reference.end;
+        } else {
+            if (define) {
+                // Only defined before the last synchronization event
+                _writeSigDefinition(reference.kind, reference.sig);
+                stream->write(data.data() + size, data.size() - size);
+                data.resize(size);
+            }
+            offset = idEnd;
+        }
+    }
+    stream->write(data.data() + offset, size - offset);
+
+    if (record->enter) {
+        nextEnter.store(record->call + 1, std::memory_order_release);
+    }
+
     --acquired;
     mutex.unlock();
+
+    if (record->enter) {
+        os::unique_lock<os::mutex> lock(orderMutex);
+        if (orderWaiters) {
+            orderCond.notify_all();
+        }
+    }
+
+    record->references.clear();
+    if (data.capacity() > THREAD_RECORD_MAX_RETAINED_SIZE) {
+        std::vector<char>().swap(data);
+    } else {
+        data.clear();
+    }
+    record->pending = false;
+
+    if (threadExited) {
+        freeThreadRecord(record);
+    }
+}
+
+/**
+ * Release the record of an exiting thread.
+ *
+ * The thread may exit in the middle of an event.  Later calls wait for an
+ * enter record to be committed, so one is still committed for the call,
+ * stripped of whatever was serialized past its signature.
+ */
+void LocalWriter::releaseRecord(ThreadRecord *record) {
+    threadExited = 1;
+    threadRecord = record;
+
+    if (record->pending && record->enter) {
+        record->data.resize(record->enterSize);
+        record->references.resize(record->enterReferences);
+        Writer::endEnter();
+        commitRecord(record);
+    } else {
+        freeThreadRecord(record);
+    }
+}
+
+/**
+ * Wait for all enter records preceding the given call to be committed.
+ */
+void LocalWriter::waitForTurn(unsigned call) {
+    for (unsigned i = 0; i < THREAD_RECORD_SPIN_COUNT; ++i) {
+        if (nextEnter.load(std::memory_order_acquire) == call) {
+            return;
+        }
+    }
+
+    os::unique_lock<os::mutex> lock(orderMutex);
+    ++orderWaiters;
+    while (nextEnter.load(std::memory_order_acquire) != call) {
+        orderCond.wait(lock);
+    }
+    --orderWaiters;
+}
+
+bool LocalWriter::beginSigDefinition(SigKind kind, size_t id, const void *sig) {
+    if (!bufferPerThread) {
+        return Writer::beginSigDefinition(kind, id, sig);
+    }
+
+    // Whether the definition is really needed is only known at commit time,
+    // so include it unless this thread already did.  Stack frames don't
+    // outlive the call, so their definitions are always included.
+    ThreadRecord *record = threadRecord;
+    bool define = true;
+    if (kind != SIG_FRAME) {
+        std::vector<bool> &defined = record->defined[kind];
+        if (id >= defined.size()) {
+            defined.resize(id + 1);
+        }
+        define = !defined[id];
+        defined[id] = true;
+    }
+
+    ThreadRecord::Reference reference;
+    reference.begin = record->data.size();
+    reference.end = reference.begin;
+    reference.defined = define;
+    reference.kind = kind;
+    reference.id = id;
+    reference.sig = sig;
+    record->references.push_back(reference);
+    return define;
+}
+
+void LocalWriter::endSigDefinition(void) {
+    if (bufferPerThread) {
+        ThreadRecord *record = threadRecord;
+        assert(!record->references.empty());
+        record->references.back().end = record->data.size();
+    }
 }
 
 void LocalWriter::flush(void) {
@@ -32,6 +32,8 @@
 
 #include <stdint.h>
 
+#include <atomic>
+
 #include "os_thread.hpp"
 #include "os_process.hpp"
 #include "trace_writer.hpp"
@@ -44,6 +46,8 @@ namespace trace {
     extern const FunctionSig free_sig;
     extern const FunctionSig realloc_sig;
 
+    struct ThreadRecord;
+
     /**
      * A specialized Writer class, mean to trace the current process.
      *
@@ -52,6 +56,12 @@ namespace trace {
      * - uses mutexes to allow tracing from multiple threades
      * - flushes the output to ensure the last call is traced in event of
      *   abnormal termination
+     *
+     * When the APITRACE_THREAD_BUFFERS environment variable is set, each
+     * thread serializes its calls into a private buffer, and only takes the
+     * mutex to commit each complete enter/leave record to the trace file.
+     * Enter records are committed in call number order, so the trace is
+     * indistinguishable from one written with the mutex held throughout.
      */
     class LocalWriter : public Writer {
     protected:
@@ -77,6 +87,33 @@ namespace trace {
 
         void checkProcessId();
 
+        /**
+         * Whether calls are serialized into per-thread buffers.
+         */
+        bool bufferPerThread;
+
+        /**
+         * Incremented whenever a trace file is opened, so that per-thread
+         * buffers forget which signatures were defined.  Zero while no file
+         * was opened yet.
+         */
+        std::atomic<unsigned> epoch;
+
+        /**
+         * Number of the call whose enter record is to be committed next.
+         */
+        std::atomic<unsigned> nextEnter;
+        os::mutex orderMutex;
+        os::condition_variable orderCond;
+        unsigned orderWaiters;
+
+        ThreadRecord *beginRecord(void);
+        void commitRecord(ThreadRecord *record);
+        void waitForTurn(unsigned call);
+
+        bool beginSigDefinition(SigKind kind, size_t id, const void *sig) override;
+        void endSigDefinition(void) override;
+
     public:
         /**
          * Should never called directly -- use localWriter singleton below
@@ -88,26 +125,31 @@ namespace trace {
         void open(void);
 
         /**
-         * It will acquire the mutex.
+         * It will acquire the mutex, unless buffering per thread.
          */
         unsigned beginEnter(const FunctionSig *sig, bool fake = false);
 
         /**
-         * It will release the mutex.
+         * It will release the mutex, or commit the buffered record.
          */
         void endEnter(void);
 
         /**
-         * It will acquire the mutex.
+         * It will acquire the mutex, unless buffering per thread.
          */
         void beginLeave(unsigned call);
 
         /**
-         * It will release the mutex.
+         * It will release the mutex, or commit the buffered record.
          */
         void endLeave(void);
 
         void flush(void);
+
+        /**
+         * Called when a thread which buffered calls exits.
+         */
+        void releaseRecord(ThreadRecord *record);
     };
 
     /**
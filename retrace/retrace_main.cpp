@@ -28,8 +28,12 @@
 
 #include <string.h>
 #include <limits.h> // for CHAR_MAX
+#include <atomic>
 #include <memory> // for unique_ptr
 #include <iostream>
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h> // for _mm_pause()
+#endif
 #include <getopt.h>
 #ifndef _WIN32
 #include <unistd.h> // for isatty()
@@ -258,6 +262,18 @@ retraceCall(trace::Call *call) {
 }
 
 
+// Number of times runners poll for the baton before going to sleep
+#define RELAY_SPIN_COUNT 4096
+
+
+static inline void
+cpuRelax(void) {
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+    _mm_pause();
+#endif
+}
+
+
 class RelayRunner;
 
 
@@ -267,12 +283,26 @@ class RelayRunner;
 class RelayRace
 {
 private:
+    friend class RelayRunner;
+
     /**
      * Runners indexed by the leg they run (i.e, the thread_ids from the
      * trace).
      */
     std::vector<RelayRunner*> runners;
 
+    /**
+     * How long runners poll for the baton before going to sleep.
+     */
+    unsigned spinCount;
+
+    /**
+     * Number of times the baton was passed, and of those the runner
+     * receiving it had to be woken up.
+     */
+    std::atomic<unsigned long long> handoffs;
+    std::atomic<unsigned long long> wakeups;
+
 public:
     RelayRace();
 
@@ -314,15 +344,22 @@ private:
     RelayRace *race;
 
     unsigned leg;
-    
-    os::mutex mutex;
-    os::condition_variable wake_cond;
 
     /**
-     * There are protected by the mutex.
+     * Set by other runners when passing the baton or ending the race, and
+     * polled by this one for a while before going to sleep, as threads often
+     * pass the baton back and forth in quick succession.
      */
-    bool finished;
-    trace::Call *baton;
+    std::atomic<trace::Call *> baton;
+    std::atomic<bool> finished;
+
+    /**
+     * Whether this runner is sleeping on the condition variable, so that it
+     * only needs to be woken up, under the mutex, then.
+     */
+    std::atomic<bool> sleeping;
+    os::mutex mutex;
+    os::condition_variable wake_cond;
 
     os::thread thread;
 
@@ -333,8 +370,9 @@ public:
     RelayRunner(RelayRace *race, unsigned _leg) :
         race(race),
         leg(_leg),
+        baton(nullptr),
         finished(false),
-        baton(0)
+        sleeping(false)
     {
         /* The fore runner does not need a new thread */
         if (leg) {
@@ -353,21 +391,8 @@ public:
      */
     void
     runRace(void) {
-        os::unique_lock<os::mutex> lock(mutex);
-
-        while (1) {
-            while (!finished && !baton) {
-                wake_cond.wait(lock);
-            }
-
-            if (finished) {
-                break;
-            }
-
-            assert(baton);
-            trace::Call *call = baton;
-            baton = 0;
-
+        trace::Call *call;
+        while ((call = waitBaton())) {
             runLeg(call);
         }
 
@@ -414,18 +439,67 @@ public:
         }
     }
 
+    inline bool
+    ready(void) const {
+        return baton.load() || finished.load();
+    }
+
     /**
-     * Called by other threads when relinquishing the baton.
+     * Wait for the baton, or return NULL once the race is finished.
      */
-    void
-    receiveBaton(trace::Call *call) {
-        assert (call->thread_id == leg);
+    trace::Call *
+    waitBaton(void) {
+        for (unsigned i = 0; i < race->spinCount && !ready(); ++i) {
+            cpuRelax();
+        }
 
+        if (!ready()) {
+            os::unique_lock<os::mutex> lock(mutex);
+            sleeping = true;
+            while (!ready()) {
+                wake_cond.wait(lock);
+            }
+            sleeping = false;
+        }
+
+        if (finished) {
+            return nullptr;
+        }
+
+        return baton.exchange(nullptr);
+    }
+
+    /**
+     * Wake up this runner, if sleeping, returning whether it was.
+     *
+     * Either the runner sees the baton or the end of the race before going
+     * to sleep, or it is seen going to sleep here, as both sides store their
+     * flag before loading the other's.
+     */
+    bool
+    wake(void) {
+        if (!sleeping) {
+            return false;
+        }
+
+        /* Don't notify between the runner checking and waiting */
         mutex.lock();
-        baton = call;
         mutex.unlock();
 
         wake_cond.notify_one();
+        return true;
+    }
+
+    /**
+     * Called by other threads when relinquishing the baton.
+     */
+    bool
+    receiveBaton(trace::Call *call) {
+        assert (call->thread_id == leg);
+        assert(!baton);
+
+        baton = call;
+        return wake();
     }
 
     /**
@@ -435,11 +509,8 @@ public:
     finishRace() {
         if (0) std::cerr << "notify finish to leg " << leg << "\n";
 
-        mutex.lock();
         finished = true;
-        mutex.unlock();
-
-        wake_cond.notify_one();
+        wake();
     }
 };
 
@@ -450,7 +521,13 @@ RelayRunner::runnerThread(RelayRunner *_this) {
 }
 
 
-RelayRace::RelayRace() {
+RelayRace::RelayRace() :
+    handoffs(0),
+    wakeups(0)
+{
+    /* Spinning only helps when another core can pass the baton meanwhile */
+    spinCount = os::thread::hardware_concurrency() > 1 ? RELAY_SPIN_COUNT : 0;
+
     runners.push_back(new RelayRunner(this, 0));
 }
 
@@ -510,6 +587,11 @@ RelayRace::run(void) {
 
     /* Start the forerunner thread */
     foreRunner->runRace();
+
+    if (retrace::verbosity >= 1) {
+        std::cout << "Switched threads " << handoffs << " times, "
+                  << wakeups << " of which woke a sleeping thread\n";
+    }
 }
 
 
@@ -520,7 +602,10 @@ void
 RelayRace::passBaton(trace::Call *call) {
     if (0) std::cerr << "switching to thread " << call->thread_id << "\n";
     RelayRunner *runner = getRunner(call->thread_id);
-    runner->receiveBaton(call);
+    handoffs.fetch_add(1, std::memory_order_relaxed);
+    if (runner->receiveBaton(call)) {
+        wakeups.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 
@@ -598,7 +683,7 @@ static void
 usage(const char *argv0) {
     std::cout << 
         "Usage: " << argv0 << " [OPTION] TRACE [...]\n"
-        "Replay TRACE.\n"
+        "Replay TRACE, which may have been compiled with `apitrace compile`.\n"
         "\n"
         "  -b, --benchmark         benchmark mode (no error checking or warning messages)\n"
         "  -d, --debug             increase debugging checks\n"
@@ -630,6 +715,9 @@ usage(const char *argv0) {
         "      --dump-format=FORMAT dump state format (`json` or `ubjson`)\n"
         "  -w, --wait              waitOnFinish on final frame\n"
         "      --loop[=N]          loop N times (N<0 continuously) replaying final frame.\n"
+        "      --loop-frames=FIRST[-LAST]  loop frames FIRST to LAST instead of the final frame\n"
+        "      --loop-cache        keep the looped frames' calls in memory instead of parsing them again\n"
+        "      --parse-ahead[=N]   parse up to N calls (default is 1024) ahead on a separate thread\n"
         "      --singlethread      use a single thread to replay command stream\n";
 }
 
@@ -656,7 +744,10 @@ enum {
     SINGLETHREAD_OPT,
     SNAPSHOT_INTERVAL_OPT,
     DUMP_FORMAT_OPT,
-    MARKERS_OPT
+    MARKERS_OPT,
+    PARSE_AHEAD_OPT,
+    LOOP_FRAMES_OPT,
+    LOOP_CACHE_OPT
 };
 
 const static char *
@@ -695,6 +786,9 @@ longOptions[] = {
     {"verbose", no_argument, 0, 'v'},
     {"wait", no_argument, 0, 'w'},
     {"loop", optional_argument, 0, LOOP_OPT},
+    {"loop-frames", required_argument, 0, LOOP_FRAMES_OPT},
+    {"loop-cache", no_argument, 0, LOOP_CACHE_OPT},
+    {"parse-ahead", optional_argument, 0, PARSE_AHEAD_OPT},
     {"singlethread", no_argument, 0, SINGLETHREAD_OPT},
     {0, 0, 0, 0}
 };
@@ -711,6 +805,10 @@ int main(int argc, char **argv)
 {
     using namespace retrace;
     int loopCount = 0;
+    unsigned loopFirstFrame = LOOP_LAST_FRAME;
+    unsigned loopLastFrame = LOOP_LAST_FRAME;
+    bool loopCache = false;
+    int parseAhead = 0;
     int i;
     bool snapshotThreaded = false;
 
@@ -843,6 +941,26 @@ int main(int argc, char **argv)
         case LOOP_OPT:
             loopCount = trace::intOption(optarg, -1);
             break;
+        case LOOP_FRAMES_OPT:
+            {
+                char *end;
+                loopFirstFrame = strtoul(optarg, &end, 0);
+                loopLastFrame = *end == '-' ? strtoul(end + 1, &end, 0) : loopFirstFrame;
+                if (*end != '\0' || loopLastFrame < loopFirstFrame) {
+                    std::cerr << "error: invalid frame range " << optarg << "\n";
+                    return 1;
+                }
+                if (!loopCount) {
+                    loopCount = -1;
+                }
+            }
+            break;
+        case LOOP_CACHE_OPT:
+            loopCache = true;
+            break;
+        case PARSE_AHEAD_OPT:
+            parseAhead = trace::intOption(optarg, 1024);
+            break;
         case PGPU_OPT:
             retrace::debug = 0;
             retrace::profiling = true;
@@ -946,9 +1064,18 @@ int main(int argc, char **argv)
          retrace::curPass++)
     {
         for (i = optind; i < argc; ++i) {
-            parser = new trace::Parser;
+            if (trace::isCompiledTrace(argv[i])) {
+                parser = trace::compiledParser();
+            } else {
+                trace::Parser *traceParser = new trace::Parser;
+                traceParser->setCallArenas(true);
+                parser = traceParser;
+            }
             if (loopCount) {
-                parser = lastFrameLoopParser(parser, loopCount);
+                parser = frameLoopParser(parser, loopCount, loopFirstFrame, loopLastFrame, loopCache);
+            }
+            if (parseAhead > 0) {
+                parser = parseAheadParser(parser, parseAhead);
             }
 
             if (!parser->open(argv[i])) {
@@ -0,0 +1,310 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Microbenchmark for retrace::map, the handle maps looked up for nearly every
+ * call when retracing, against the std::map based implementation it
+ * replaced.
+ *
+ * Maps with many live objects are filled with different kinds of keys, and
+ * then looked up in a random order, reporting the best of several runs as
+ * JSON on stdout:
+ *
+ *   retrace_map_bench [--objects=N] [--lookups=N] [--repeat=N]
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "os_time.hpp"
+#include "retrace_swizzle.hpp"
+#include "trace_synth.hpp"
+
+
+/*
+ * Handle map as it was, on top of std::map.
+ */
+template <class T>
+class StdMap
+{
+private:
+    std::map<T, T> base;
+
+public:
+    T & operator[] (const T &key) {
+        typename std::map<T, T>::iterator it;
+        it = base.find(key);
+        if (it == base.end()) {
+            return (base[key] = key);
+        }
+        return it->second;
+    }
+
+    T lookupUniformLocation(const T &key) {
+        typename std::map<T, T>::const_iterator it;
+        it = base.upper_bound(key);
+        if (it != base.begin()) {
+            --it;
+        } else {
+            return (base[key] = key);
+        }
+        T t = it->second + (key - it->first);
+        return t;
+    }
+};
+
+
+struct Lookup
+{
+    template< class Map, class T >
+    T operator () (Map &map, const T &key) const {
+        return map[key];
+    }
+};
+
+
+struct UniformLookup
+{
+    template< class Map, class T >
+    T operator () (Map &map, const T &key) const {
+        return map.lookupUniformLocation(key);
+    }
+};
+
+
+struct Result
+{
+    std::string name;
+    unsigned long long lookups;
+    double seconds;
+};
+
+
+static std::vector<Result> results;
+static unsigned repeat = 3;
+
+
+static double
+now(void)
+{
+    return double(os::getTime()) / os::timeFrequency;
+}
+
+
+/*
+ * Fill a map with the given keys, and time looking them up in the given
+ * order, checking the results against the expected ones.
+ */
+template< class Map, class T, class Lookup >
+static void
+measure(const std::string &name,
+        const std::vector<T> &keys,
+        const std::vector<T> &order,
+        Lookup lookup)
+{
+    Map map;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        map[keys[i]] = T(uintptr_t(i) * 2);
+    }
+
+    uint64_t expected = 0;
+    for (auto & key : order) {
+        expected += uint64_t(lookup(map, key));
+    }
+
+    double best = 0;
+    for (unsigned i = 0; i < repeat; ++i) {
+        double start = now();
+        uint64_t sum = 0;
+        for (auto & key : order) {
+            sum += uint64_t(lookup(map, key));
+        }
+        double seconds = now() - start;
+        if (sum != expected) {
+            std::cerr << "error: " << name << ": inconsistent lookups\n";
+            exit(1);
+        }
+        if (i == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+
+    results.push_back({name, order.size(), best});
+    std::cerr << "info: " << name << ": " << best << " s\n";
+}
+
+
+/*
+ * Time both implementations, checking that they agree.
+ */
+template< class T, class Lookup >
+static void
+compare(const char *name,
+        const std::vector<T> &keys,
+        const std::vector<T> &order,
+        Lookup lookup)
+{
+    uint64_t sums[2] = {0, 0};
+    {
+        StdMap<T> map;
+        retrace::map<T> flatMap;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            map[keys[i]] = T(uintptr_t(i) * 2);
+            flatMap[keys[i]] = T(uintptr_t(i) * 2);
+        }
+        for (auto & key : order) {
+            sums[0] += uint64_t(lookup(map, key));
+            sums[1] += uint64_t(lookup(flatMap, key));
+        }
+    }
+    if (sums[0] != sums[1]) {
+        std::cerr << "error: " << name << ": retrace::map and std::map disagree\n";
+        exit(1);
+    }
+
+    measure<StdMap<T>>(std::string(name) + "_std_map", keys, order, lookup);
+    measure<retrace::map<T>>(std::string(name) + "_retrace_map", keys, order, lookup);
+}
+
+
+template< class T >
+static std::vector<T>
+shuffled(const std::vector<T> &keys, size_t count, trace::Random &random)
+{
+    std::vector<T> order(count);
+    for (auto & key : order) {
+        key = keys[random.next() % keys.size()];
+    }
+    return order;
+}
+
+
+static void
+printResults(void)
+{
+    std::cout << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+        double seconds = std::max(result.seconds, 1e-9);
+        std::cout
+            << "    {\"name\": \"" << result.name << "\""
+            << ", \"lookups\": " << result.lookups
+            << ", \"seconds\": " << result.seconds
+            << ", \"ns_per_lookup\": " << seconds * 1e9 / result.lookups
+            << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}\n";
+}
+
+
+static void
+usage(void)
+{
+    std::cerr
+        << "usage: retrace_map_bench [options]\n"
+        << "\n"
+        << "    --objects=N  Number of live objects in each map [default: 50000]\n"
+        << "    --lookups=N  Number of lookups per run [default: 10000000]\n"
+        << "    --repeat=N   Report the fastest of N runs [default: 3]\n";
+}
+
+
+int
+main(int argc, char **argv)
+{
+    unsigned numObjects = 50000;
+    unsigned numLookups = 10000000;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--objects=", 10) == 0) {
+            numObjects = std::max(atoi(arg + 10), 1);
+        } else if (strncmp(arg, "--lookups=", 10) == 0) {
+            numLookups = std::max(atoi(arg + 10), 1);
+        } else if (strncmp(arg, "--repeat=", 9) == 0) {
+            repeat = std::max(atoi(arg + 9), 1);
+        } else {
+            usage();
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    trace::Random random(1);
+    Lookup lookup;
+    UniformLookup uniformLookup;
+
+    // Names generated by the implementation, counting up from one
+    {
+        std::vector<unsigned> keys(numObjects);
+        for (unsigned i = 0; i < numObjects; ++i) {
+            keys[i] = i + 1;
+        }
+        compare("generated_names", keys, shuffled(keys, numLookups, random), lookup);
+    }
+
+    // Names picked by the application
+    {
+        std::vector<unsigned> keys(numObjects);
+        for (auto & key : keys) {
+            key = random.next() | 0x80000000U;
+        }
+        compare("application_names", keys, shuffled(keys, numLookups, random), lookup);
+    }
+
+    // Pointers, as with D3D interfaces or GL sync objects
+    {
+        std::vector<void *> keys(numObjects);
+        for (unsigned i = 0; i < numObjects; ++i) {
+            keys[i] = reinterpret_cast<void *>(uintptr_t(0x10000000U) + uintptr_t(i) * 48);
+        }
+        compare("pointers", keys, shuffled(keys, numLookups, random), lookup);
+    }
+
+    // Uniform arrays, whose elements are looked up past the array location
+    {
+        std::vector<int> keys(numObjects);
+        for (unsigned i = 0; i < numObjects; ++i) {
+            keys[i] = int(i) * 4;
+        }
+        std::vector<int> order = shuffled(keys, numLookups, random);
+        for (auto & key : order) {
+            key += random.next() % 4;
+        }
+        compare("uniform_locations", keys, order, uniformLookup);
+    }
+
+    printResults();
+
+    return 0;
+}
@@ -26,7 +26,15 @@
 #pragma once
 
 
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
 #include <map>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "trace_model.hpp"
 
@@ -44,43 +52,207 @@ namespace retrace {
  * the implementation to generate an unique name, or pick a value never used
  * before.
  *
+ * As handles are looked up for nearly every call, entries are kept in a
+ * vector indexed by key for small integer keys, like the names GL
+ * implementations generate, and in an open addressing hash table otherwise.
+ * Unlike std::map, inserting invalidates iterators and references to
+ * entries.
+ *
  * XXX: In some cases, instead of returning the key, it would make more sense
  * to return an unused data value (e.g., container count).
  */
 template <class T>
 class map
 {
+public:
+    typedef std::pair<T, T> value_type;
+    typedef const value_type *const_iterator;
+
 private:
-    typedef std::map<T, T> base_type;
-    base_type base;
+    static_assert(sizeof(T) <= sizeof(uint64_t), "handles must fit in 64 bits");
+
+    enum {
+        // Largest key which may be stored by index
+        DENSE_MAX_KEY = 16 * 1024 * 1024,
+
+        // Keys below this many, or twice the number of entries, are stored by
+        // index, so that at least half of the vector ends up used
+        DENSE_MIN_SIZE = 256,
+
+        HASH_MIN_SIZE = 16,
+    };
+
+    struct Slot {
+        value_type entry;
+        bool used;
+
+        Slot() : used(false) {}
+    };
+
+    std::vector<Slot> dense;
+    size_t denseCount;
+
+    // Linear probing, at most half full, and without removals
+    std::vector<Slot> hash;
+    size_t hashCount;
+
+    // Keys in ascending order, for lookupUniformLocation
+    std::vector<T> sortedKeys;
+    bool sortedKeysStale;
+
+    template< class U = T >
+    static inline typename std::enable_if<std::is_integral<U>::value, bool>::type
+    denseIndex(const U &key, size_t &index) {
+        // Negative keys become too large
+        uint64_t value = static_cast<uint64_t>(key);
+        index = static_cast<size_t>(value);
+        return value <= DENSE_MAX_KEY;
+    }
+
+    template< class U = T >
+    static inline typename std::enable_if<!std::is_integral<U>::value, bool>::type
+    denseIndex(const U &, size_t &) {
+        return false;
+    }
+
+    static inline size_t
+    hashKey(const T &key) {
+        uint64_t value = 0;
+        memcpy(&value, &key, sizeof key);
+        value *= 0x9e3779b97f4a7c15ULL;
+        return static_cast<size_t>(value ^ (value >> 32));
+    }
+
+    inline Slot *
+    findHashSlot(const T &key) const {
+        if (hash.empty()) {
+            return nullptr;
+        }
+        size_t mask = hash.size() - 1;
+        for (size_t i = hashKey(key) & mask; ; i = (i + 1) & mask) {
+            const Slot &slot = hash[i];
+            if (!slot.used) {
+                return nullptr;
+            }
+            if (slot.entry.first == key) {
+                return const_cast<Slot *>(&slot);
+            }
+        }
+    }
+
+    inline value_type *
+    lookup(const T &key) const {
+        size_t index;
+        if (denseIndex(key, index) && index < dense.size()) {
+            const Slot &slot = dense[index];
+            return slot.used ? const_cast<value_type *>(&slot.entry) : nullptr;
+        }
+        Slot *slot = findHashSlot(key);
+        return slot ? &slot->entry : nullptr;
+    }
+
+    void
+    insertHash(const value_type &entry) {
+        if (2 * (hashCount + 1) > hash.size()) {
+            std::vector<Slot> old;
+            old.swap(hash);
+            hash.resize(std::max<size_t>(HASH_MIN_SIZE, 2 * old.size()));
+            hashCount = 0;
+            for (auto & slot : old) {
+                if (slot.used) {
+                    insertHash(slot.entry);
+                }
+            }
+        }
+
+        size_t mask = hash.size() - 1;
+        size_t i = hashKey(entry.first) & mask;
+        while (hash[i].used) {
+            i = (i + 1) & mask;
+        }
+        hash[i].entry = entry;
+        hash[i].used = true;
+        ++hashCount;
+    }
+
+    /*
+     * Make room for keys up to the given index, moving the entries in that
+     * range out of the hash table.
+     */
+    void
+    growDense(size_t index) {
+        dense.resize(std::max(index + 1, 2 * dense.size()));
+
+        std::vector<Slot> old;
+        old.swap(hash);
+        hashCount = 0;
+        for (auto & slot : old) {
+            if (slot.used) {
+                size_t i;
+                if (denseIndex(slot.entry.first, i) && i < dense.size()) {
+                    dense[i] = slot;
+                    ++denseCount;
+                } else {
+                    insertHash(slot.entry);
+                }
+            }
+        }
+    }
+
+    value_type *
+    insert(const T &key) {
+        value_type entry(key, key);
+        sortedKeysStale = true;
+
+        size_t index;
+        if (denseIndex(key, index)) {
+            if (index >= dense.size() &&
+                index < std::max<size_t>(DENSE_MIN_SIZE, 2 * (denseCount + 1))) {
+                growDense(index);
+            }
+            if (index < dense.size()) {
+                Slot &slot = dense[index];
+                slot.entry = entry;
+                slot.used = true;
+                ++denseCount;
+                return &slot.entry;
+            }
+        }
+
+        insertHash(entry);
+        return &findHashSlot(key)->entry;
+    }
 
 public:
-    typedef typename base_type::const_iterator const_iterator;
+    map() :
+        denseCount(0),
+        hashCount(0),
+        sortedKeysStale(false)
+    {}
 
     const_iterator end(void) const {
-        return base.end();
+        return nullptr;
     }
 
     const_iterator find(const T & key) const {
-        return base.find(key);
+        return lookup(key);
+    }
+
+    size_t size(void) const {
+        return denseCount + hashCount;
     }
 
     T & operator[] (const T &key) {
-        typename base_type::iterator it;
-        it = base.find(key);
-        if (it == base.end()) {
-            return (base[key] = key);
+        value_type *entry = lookup(key);
+        if (!entry) {
+            entry = insert(key);
         }
-        return it->second;
+        return entry->second;
     }
-    
-    const T & operator[] (const T &key) const {
-        typename base_type::const_iterator it;
-        it = base.find(key);
-        if (it == base.end()) {
-            return (base[key] = key);
-        }
-        return it->second;
+
+    T operator[] (const T &key) const {
+        const value_type *entry = lookup(key);
+        return entry ? entry->second : key;
     }
 
     /*
@@ -93,14 +265,34 @@ public:
      * "myMatrix[0]"), etc.
      */
     T lookupUniformLocation(const T &key) {
-        typename base_type::const_iterator it;
-        it = base.upper_bound(key);
-        if (it != base.begin()) {
-            --it;
-        } else {
-            return (base[key] = key);
+        const value_type *entry = lookup(key);
+        if (entry) {
+            return entry->second;
+        }
+
+        if (sortedKeysStale) {
+            sortedKeys.clear();
+            for (auto & slot : dense) {
+                if (slot.used) {
+                    sortedKeys.push_back(slot.entry.first);
+                }
+            }
+            for (auto & slot : hash) {
+                if (slot.used) {
+                    sortedKeys.push_back(slot.entry.first);
+                }
+            }
+            std::sort(sortedKeys.begin(), sortedKeys.end());
+            sortedKeysStale = false;
+        }
+
+        typename std::vector<T>::const_iterator it;
+        it = std::upper_bound(sortedKeys.begin(), sortedKeys.end(), key);
+        if (it == sortedKeys.begin()) {
+            return (*this)[key];
         }
-        T t = it->second + (key - it->first);
+        --it;
+        T t = lookup(*it)->second + (key - *it);
         return t;
     }
 };
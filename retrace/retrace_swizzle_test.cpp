@@ -0,0 +1,122 @@
+/**************************************************************************
+ *
+ * Copyright 2026 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <map>
+
+#include "retrace_swizzle.hpp"
+
+#include "gtest/gtest.h"
+
+
+TEST(retrace_map, identity)
+{
+    retrace::map<unsigned> m;
+    EXPECT_EQ(m[5], 5u);
+    EXPECT_EQ(m.size(), 1u);
+    EXPECT_TRUE(m.find(6) == m.end());
+
+    m[6] = 60;
+    ASSERT_TRUE(m.find(6) != m.end());
+    EXPECT_EQ(m.find(6)->second, 60u);
+    EXPECT_EQ(m[6], 60u);
+}
+
+
+TEST(retrace_map, sparse_keys)
+{
+    // Exercise keys stored by index, hashed, and moved from one to the other
+    retrace::map<unsigned> m;
+    std::map<unsigned, unsigned> expected;
+    unsigned key = 1;
+    for (unsigned i = 0; i < 50000; ++i) {
+        key = key * 1103515245u + 12345u;
+        unsigned k = i % 3 == 0 ? key : (i % 3 == 1 ? i : key % 100000);
+        m[k] = i;
+        expected[k] = i;
+    }
+
+    EXPECT_EQ(m.size(), expected.size());
+    for (auto & entry : expected) {
+        ASSERT_TRUE(m.find(entry.first) != m.end());
+        EXPECT_EQ(m.find(entry.first)->second, entry.second);
+    }
+}
+
+
+TEST(retrace_map, signed_keys)
+{
+    retrace::map<int> m;
+    m[-1] = 7;
+    m[3] = 30;
+    EXPECT_EQ(m[-1], 7);
+    EXPECT_EQ(m[3], 30);
+    EXPECT_EQ(m[-2], -2);
+}
+
+
+TEST(retrace_map, pointer_keys)
+{
+    int objects[4];
+    retrace::map<void *> m;
+    m[&objects[0]] = &objects[3];
+    EXPECT_EQ(m[&objects[0]], &objects[3]);
+    EXPECT_EQ(m[&objects[1]], &objects[1]);
+    EXPECT_TRUE(m.find(&objects[2]) == m.end());
+}
+
+
+TEST(retrace_map, lookupUniformLocation)
+{
+    retrace::map<int> m;
+
+    // Keys below all others map to themselves
+    EXPECT_EQ(m.lookupUniformLocation(-1), -1);
+
+    m[4] = 40;
+    m[10] = 100;
+    EXPECT_EQ(m.lookupUniformLocation(4), 40);
+    EXPECT_EQ(m.lookupUniformLocation(6), 42);
+    EXPECT_EQ(m.lookupUniformLocation(12), 102);
+    EXPECT_EQ(m.lookupUniformLocation(2), 2);
+    EXPECT_EQ(m.lookupUniformLocation(3), 3);
+
+    // Keys inserted since are taken into account
+    m[5] = 70;
+    EXPECT_EQ(m.lookupUniformLocation(6), 71);
+    EXPECT_EQ(m.lookupUniformLocation(-1), -1);
+
+    // As are large, hashed, keys
+    m[1 << 30] = 5;
+    EXPECT_EQ(m.lookupUniformLocation((1 << 30) + 2), 7);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,171 @@
+#!/usr/bin/env python
+##########################################################################
+#
+# Copyright 2026 VMware, Inc.
+# All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+
+'''Sample reader for the files written by apitrace export command.
+
+See docs/EXPORT.markdown for the layout.  Run as:
+
+   apitrace export -o foo.columns foo.trace
+   python columns.py foo.columns
+
+Columns are returned as Python arrays, which can be readily converted into
+NumPy arrays or a pandas DataFrame.
+'''
+
+
+import array
+import optparse
+import struct
+import sys
+
+
+MAGIC = b'APITRCOL'
+
+COLUMNS = [
+    ('call_no', 'I'),
+    ('thread', 'I'),
+    ('function', 'I'),
+    ('flags', 'I'),
+    ('frame', 'I'),
+    ('arg_offsets', 'Q'),
+    ('arg_index', 'H'),
+    ('arg_type', 'B'),
+    ('arg_value', 'Q'),
+    ('blob_offsets', 'Q'),
+    ('blob_size', 'Q'),
+]
+
+# Offsets columns, and the columns they index
+OFFSETS = {
+    'arg_offsets': 'arg_value',
+    'blob_offsets': 'blob_size',
+}
+
+
+def _pad(size):
+    return (8 - size % 8) % 8
+
+
+def _array(typecode, data):
+    values = array.array(typecode)
+    assert values.itemsize == struct.calcsize('<' + typecode)
+    values.frombytes(data)
+    if sys.byteorder != 'little':
+        values.byteswap()
+    return values
+
+
+class ColumnsFile:
+
+    def __init__(self, stream):
+        self.stream = stream
+
+        if self._read(8) != MAGIC:
+            raise ValueError('not an exported columns file')
+        self.version, _ = struct.unpack('<II', self._read(8))
+
+        stream.seek(-16, 2)
+        footerOffset, = struct.unpack('<Q', self._read(8))
+        if self._read(8) != MAGIC:
+            raise ValueError('truncated exported columns file')
+
+        stream.seek(footerOffset)
+        numRowGroups, = struct.unpack('<Q', self._read(8))
+        self.rowGroups = []
+        for i in range(numRowGroups):
+            self.rowGroups.append(struct.unpack('<QQ', self._read(16)))
+
+        numFunctions, = struct.unpack('<Q', self._read(8))
+        self.functions = {}
+        for i in range(numFunctions):
+            functionId, nameSize = struct.unpack('<II', self._read(8))
+            self.functions[functionId] = self._read(nameSize).decode()
+            self._read(_pad(nameSize))
+
+    def _read(self, size):
+        data = self.stream.read(size)
+        assert len(data) == size
+        return data
+
+    def readRowGroup(self, index):
+        '''Read the columns of a row group, as a dictionary of arrays.'''
+
+        offset, numRows = self.rowGroups[index]
+        self.stream.seek(offset)
+        numRows, numColumns, _ = struct.unpack('<QII', self._read(16))
+        columns = {}
+        for i in range(numColumns):
+            columnId, elementSize, size = struct.unpack('<IIQ', self._read(16))
+            data = self._read(size)
+            self._read(_pad(size))
+            if columnId < len(COLUMNS):
+                name, typecode = COLUMNS[columnId]
+                columns[name] = _array(typecode, data)
+        return columns
+
+    def readAll(self):
+        '''Read and concatenate the columns of all row groups.  Offsets
+        columns are adjusted to index the concatenated columns.'''
+
+        result = dict((name, array.array(typecode)) for name, typecode in COLUMNS)
+        for name in OFFSETS:
+            result[name].append(0)
+        for index in range(len(self.rowGroups)):
+            columns = self.readRowGroup(index)
+            for name, target in OFFSETS.items():
+                base = len(result[target])
+                result[name].extend(base + offset for offset in columns.pop(name)[1:])
+            for name, values in columns.items():
+                result[name].extend(values)
+        return result
+
+
+def main():
+    optparser = optparse.OptionParser(
+        usage="\n\t%prog [options] COLUMNS_FILE")
+    (options, args) = optparser.parse_args(sys.argv[1:])
+    if len(args) != 1:
+        optparser.error('wrong number of arguments')
+
+    with open(args[0], 'rb') as stream:
+        columnsFile = ColumnsFile(stream)
+        columns = columnsFile.readAll()
+
+    numCalls = len(columns['call_no'])
+    numFrames = max(columns['frame']) + 1 if numCalls else 0
+    sys.stdout.write('%u calls, %u frames, %u row groups\n' % (numCalls, numFrames, len(columnsFile.rowGroups)))
+
+    counts = {}
+    for functionId in columns['function']:
+        counts[functionId] = counts.get(functionId, 0) + 1
+    for functionId, count in sorted(counts.items(), key=lambda item: -item[1]):
+        sys.stdout.write('%8u %s\n' % (count, columnsFile.functions[functionId]))
+
+    sys.stdout.write('%u scalar arguments, %u blobs totalling %u bytes\n' % (
+        len(columns['arg_value']), len(columns['blob_size']), sum(columns['blob_size'])))
+
+
+if __name__ == '__main__':
+    main()